@@ -0,0 +1,154 @@
+// Compare the compile-time perfect hash of the built-in commands with the unordered_map it replaced : same commands
+// found, time per lookup
+//
+// g++ -std=c++17 -O2 -pthread -Isrc benchmarks/registry.cpp -o registry_bench
+// ./registry_bench [<iterations>]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "registry.h"
+
+namespace
+{
+    class NoopCommand : public Command
+    {
+    public:
+        void execute(const std::vector<Token> &, std::istream &, std::ostream &) override {}
+    };
+
+    // Same names as the table of registry.cpp, the commands themselves don't matter here
+    constexpr std::array<CommandEntry, 37> entries{{
+        {"echo", makeCommand<NoopCommand>},
+        {"cd", makeCommand<NoopCommand>},
+        {"assoc", makeCommand<NoopCommand>},
+        {"cls", makeCommand<NoopCommand>},
+        {"cmd", makeCommand<NoopCommand>},
+        {"cmd++", makeCommand<NoopCommand>},
+        {"color", makeCommand<NoopCommand>},
+        {"comp", makeCommand<NoopCommand>},
+        {"fc", makeCommand<NoopCommand>},
+        {"copy", makeCommand<NoopCommand>},
+        {"time", makeCommand<NoopCommand>},
+        {"timer", makeCommand<NoopCommand>},
+        {"lsof", makeCommand<NoopCommand>},
+        {"memadrs", makeCommand<NoopCommand>},
+        {"memstats", makeCommand<NoopCommand>},
+        {"rma", makeCommand<NoopCommand>},
+        {"hexdump", makeCommand<NoopCommand>},
+        {"findstr", makeCommand<NoopCommand>},
+        {"xml", makeCommand<NoopCommand>},
+        {"encoding", makeCommand<NoopCommand>},
+        {"gpw", makeCommand<NoopCommand>},
+        {"quicksearch", makeCommand<NoopCommand>},
+        {"qs", makeCommand<NoopCommand>},
+        {"clc", makeCommand<NoopCommand>},
+        {"kill", makeCommand<NoopCommand>},
+        {"random", makeCommand<NoopCommand>},
+        {"envvar", makeCommand<NoopCommand>},
+        {"rem", makeCommand<NoopCommand>},
+        {"schema", makeCommand<NoopCommand>},
+        {"jobs", makeCommand<NoopCommand>},
+        {"wait", makeCommand<NoopCommand>},
+        {"fg", makeCommand<NoopCommand>},
+        {"bench", makeCommand<NoopCommand>},
+        {"stats", makeCommand<NoopCommand>},
+        {"trace", makeCommand<NoopCommand>},
+        {"profile", makeCommand<NoopCommand>},
+        {"cache", makeCommand<NoopCommand>},
+    }};
+
+    constexpr auto table = Registry::buildPerfectHash(entries);
+
+    // The registry of the first version : every command created at start, looked up with a std::string
+    class MapRegistry
+    {
+    public:
+        void registerCommand(const std::string &name, std::unique_ptr<Command> command)
+        {
+            commands[name] = std::move(command);
+        }
+
+        Command *getCommand(const std::string &name) const
+        {
+            auto it = commands.find(name);
+            return it != commands.end() ? it->second.get() : nullptr;
+        }
+
+    private:
+        std::unordered_map<std::string, std::unique_ptr<Command>> commands;
+    };
+
+    // Command names as the shell sees them : views into the line, built-in commands and programs
+    const std::string line = "echo cd copy rem git cache xml ls findstr python schema memstats make bench hexdump cmd++";
+
+    std::vector<std::string_view> splitNames()
+    {
+        std::vector<std::string_view> names;
+        std::string_view rest(line);
+        while (!rest.empty())
+        {
+            size_t space = rest.find(' ');
+            names.push_back(rest.substr(0, space));
+            rest = space == std::string_view::npos ? std::string_view() : rest.substr(space + 1);
+        }
+        return names;
+    }
+
+    template <typename Function>
+    double nanosecondsPerLookup(size_t iterations, const std::vector<std::string_view> &names, Function function)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            function(names[i % names.size()]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+
+    CommandRegistry registry(table);
+    MapRegistry map;
+    for (const auto &entry : entries)
+    {
+        map.registerCommand(std::string(entry.name), entry.create());
+    }
+
+    std::vector<std::string_view> names = splitNames();
+
+    bool same = true;
+    for (const auto &name : names)
+    {
+        if ((registry.getCommand(name) == nullptr) != (map.getCommand(std::string(name)) == nullptr))
+        {
+            std::cerr << "Different lookup for: " << name << std::endl;
+            same = false;
+        }
+    }
+    if (!same)
+    {
+        return 1;
+    }
+
+    // The commands found are counted so the work isn't optimized away
+    size_t found = 0;
+    double mapped = nanosecondsPerLookup(iterations, names, [&](std::string_view name)
+                                         { found += map.getCommand(std::string(name)) != nullptr; });
+    double hashed = nanosecondsPerLookup(iterations, names, [&](std::string_view name)
+                                         { found += registry.getCommand(name) != nullptr; });
+
+    std::cout << names.size() << " names give the same commands (" << found << " found)\n"
+              << "unordered_map + std::string : " << mapped << " ns per lookup\n"
+              << "perfect hash + string_view  : " << hashed << " ns per lookup (" << mapped / hashed << "x)\n";
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Compare Exe::spawn with the fork + exec it replaced, and the cached PATH lookups of Exe::resolveExecutable with
+// searching the directories every time : same exit codes and paths, time per program and per lookup
+//
+// g++ -std=c++17 -O2 -pthread -Isrc benchmarks/spawn.cpp src/process.cpp src/variables.cpp src/utils.cpp -o spawn_bench
+// ./spawn_bench [<heap in MiB>] [<launches>] [<lookups>]
+//
+// POSIX only : the first version only forked there. The heap is filled before timing, fork copies its page tables
+// while posix_spawn doesn't, which is what a shell with large caches pays on every program
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "process.h"
+
+namespace
+{
+    // Programs found in PATH on most systems, and one which isn't
+    const std::vector<std::string> names = {"true", "sh", "ls", "env", "no-such-program"};
+
+    // The lookup done before the cache : the current directory then every directory of PATH, for each command
+    std::string searchPath(const std::string &name)
+    {
+        const char *value = std::getenv("PATH");
+        std::string path = value ? value : "";
+
+        std::vector<std::string> directories(1, ".");
+        size_t start = 0;
+        while (start <= path.size())
+        {
+            size_t end = path.find(':', start);
+            if (end == std::string::npos)
+            {
+                end = path.size();
+            }
+            if (end > start)
+            {
+                directories.push_back(path.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+
+        for (const auto &directory : directories)
+        {
+            std::string candidate = (std::filesystem::path(directory) / name).string();
+            if (Exe::isExecutable(candidate))
+            {
+                return candidate;
+            }
+        }
+        return "";
+    }
+
+#ifndef _WIN32
+    // How the first version started a program
+    int forkExec(const std::string &filePath)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            execl(filePath.c_str(), filePath.c_str(), static_cast<char *>(nullptr));
+            _exit(127);
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+#endif
+
+    int spawn(const std::string &filePath)
+    {
+        Exe::Process process;
+        if (!Exe::spawn({filePath}, Exe::invalidHandle, Exe::invalidHandle, process))
+        {
+            return 127;
+        }
+        return Exe::wait(process);
+    }
+
+    template <typename Function>
+    double microsecondsPerCall(size_t iterations, Function function)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            function(i);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _WIN32
+    std::cerr << "The spawn benchmark compares with fork, it only runs on POSIX systems" << std::endl;
+    return 1;
+#else
+    size_t heapSize = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16) << 20;
+    size_t launches = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+    size_t lookups = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000;
+
+    bool same = true;
+    for (const auto &name : names)
+    {
+        std::string filePath;
+        Exe::resolveExecutable(name, filePath);
+        if (filePath != searchPath(name))
+        {
+            std::cerr << "Different path for: " << name << std::endl;
+            same = false;
+        }
+    }
+
+    std::string truePath;
+    if (!Exe::resolveExecutable("true", truePath) || forkExec(truePath) != 0 || spawn(truePath) != 0)
+    {
+        std::cerr << "Unable to run true from PATH" << std::endl;
+        same = false;
+    }
+    if (!same)
+    {
+        return 1;
+    }
+
+    // Touched so its pages are really mapped
+    std::vector<char> heap(heapSize);
+    std::memset(heap.data(), 1, heap.size());
+
+    // Exit codes and lookups found are summed so the work isn't optimized away
+    size_t count = 0;
+    double forked = microsecondsPerCall(launches, [&](size_t)
+                                        { count += forkExec(truePath); });
+    double spawned = microsecondsPerCall(launches, [&](size_t)
+                                         { count += spawn(truePath); });
+
+    double searched = microsecondsPerCall(lookups, [&](size_t i)
+                                          { count += !searchPath(names[i % names.size()]).empty(); });
+    std::string filePath;
+    double cached = microsecondsPerCall(lookups, [&](size_t i)
+                                        { count += Exe::resolveExecutable(names[i % names.size()], filePath); });
+
+    std::cout << names.size() << " names resolve to the same paths, " << truePath << " exits with 0 (" << count
+              << " counted)\n"
+              << (heapSize >> 20) << " MiB heap, fork + exec : " << forked << " us per program\n"
+              << (heapSize >> 20) << " MiB heap, Exe::spawn  : " << spawned << " us per program (" << forked / spawned
+              << "x)\n"
+              << "PATH searched          : " << searched << " us per lookup\n"
+              << "resolveExecutable      : " << cached << " us per lookup (" << searched / cached << "x)\n";
+    return 0;
+#endif
+}
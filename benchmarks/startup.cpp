@@ -0,0 +1,124 @@
+// Launch the console with -c, -f and a batch on its standard input : same output, time per launch, compared with the
+// license typed at the start of the first version
+//
+// g++ -std=c++17 -O2 -pthread -Isrc benchmarks/startup.cpp src/process.cpp src/variables.cpp src/utils.cpp -o startup_bench
+// ./startup_bench <cmd++ path> [<launches>] [<limit in ms>]
+//
+// With a limit, the program fails when one of the modes takes longer than it per launch
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "process.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const std::string commandLine = "echo hello";
+    const std::string expected = "hello \n"; // echo ends each argument with a space
+
+    // Run the console once, "input" is written to its standard input when it isn't empty
+    bool launch(const std::vector<std::string> &arguments, const std::string &input, std::string &output)
+    {
+        Exe::NativeHandle inputRead = Exe::invalidHandle, inputWrite = Exe::invalidHandle;
+        Exe::NativeHandle outputRead, outputWrite;
+        if (!Exe::createPipe(outputRead, outputWrite) || (!input.empty() && !Exe::createPipe(inputRead, inputWrite)))
+        {
+            return false;
+        }
+
+        Exe::Process process;
+        bool started = Exe::spawn(arguments, inputRead, outputWrite, process);
+        Exe::closeHandle(inputRead);
+        Exe::closeHandle(outputWrite);
+        if (started && !input.empty())
+        {
+            Exe::writeHandle(inputWrite, input.data(), input.size());
+        }
+        Exe::closeHandle(inputWrite);
+
+        output.clear();
+        char buffer[4096];
+        size_t size;
+        while ((size = Exe::readHandle(outputRead, buffer, sizeof(buffer))) > 0)
+        {
+            output.append(buffer, size);
+        }
+        Exe::closeHandle(outputRead);
+
+        return started && Exe::wait(process) == 0;
+    }
+
+    // Milliseconds per launch, -1 when one of them failed or didn't print the expected output
+    double millisecondsPerLaunch(const std::string &mode, size_t launches, const std::vector<std::string> &arguments,
+                                 const std::string &input)
+    {
+        std::string output;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < launches; ++i)
+        {
+            if (!launch(arguments, input, output) || output != expected)
+            {
+                std::cerr << "Unexpected output of " << mode << ": \"" << output << "\"" << std::endl;
+                return -1;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count() / launches;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: startup_bench <cmd++ path> [<launches>] [<limit in ms>]" << std::endl;
+        return 1;
+    }
+
+    std::string program = fs::absolute(argv[1]).string();
+    size_t launches = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+    double limit = argc > 3 ? std::strtod(argv[3], nullptr) : 0;
+
+    fs::path filePath = fs::temp_directory_path() / "startup_bench.shl";
+    {
+        std::ofstream file(filePath);
+        file << commandLine << "\n";
+    }
+
+    double line = millisecondsPerLaunch("-c", launches, {program, "-c", commandLine}, "");
+    double file = millisecondsPerLaunch("-f", launches, {program, "-f", filePath.string()}, "");
+    double batch = millisecondsPerLaunch("batch", launches, {program}, commandLine + "\n");
+    fs::remove(filePath);
+
+    if (line < 0 || file < 0 || batch < 0)
+    {
+        return 1;
+    }
+
+    // The first version typed the license at 25 ms per character before reading any command
+    std::error_code error;
+    uintmax_t licenseSize = fs::file_size(fs::path(program).parent_path() / "LICENSE.md", error);
+
+    std::cout << "3 modes print the same output (" << launches << " launches each)\n"
+              << "-c <line>          : " << line << " ms per launch\n"
+              << "-f <file>          : " << file << " ms per launch\n"
+              << "batch on stdin     : " << batch << " ms per launch\n";
+    if (!error)
+    {
+        std::cout << "license typed      : " << licenseSize * 25 << " ms per launch\n";
+    }
+
+    if (limit > 0 && (line > limit || file > limit || batch > limit))
+    {
+        std::cerr << "Startup takes longer than " << limit << " ms" << std::endl;
+        return 1;
+    }
+    return 0;
+}
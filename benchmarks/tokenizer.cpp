@@ -0,0 +1,146 @@
+// Compare Tokenizer::scan + toTokens with the string stream tokenizer it replaced : same tokens, time per line
+//
+// g++ -std=c++17 -O2 -Isrc benchmarks/tokenizer.cpp src/tokenizer.cpp src/variables.cpp src/utils.cpp -o tokenizer_bench
+// ./tokenizer_bench [<iterations>]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tokenizer.h"
+
+using namespace Tokenizer;
+
+namespace
+{
+    // The tokenizer of the first version of the console, kept as it was
+    std::vector<Token> streamTokenize(const std::string &input)
+    {
+        std::vector<Token> tokens;
+        std::istringstream stream(input);
+        std::string token;
+
+        bool inQuotes = false;
+
+        while (stream >> std::ws)
+        {
+            if (stream.peek() == '"')
+            {
+                stream.ignore();
+                std::getline(stream, token, '"');
+                inQuotes = true;
+            }
+            else
+            {
+                stream >> token;
+                inQuotes = false;
+            }
+
+            if (token == "|")
+            {
+                tokens.push_back({TokenType::PIPE, token});
+            }
+            else if (token == ">")
+            {
+                tokens.push_back({TokenType::REDIRECTION, token});
+            }
+            else
+            {
+                tokens.push_back({TokenType::ARGUMENT, token});
+            }
+
+            if (inQuotes)
+            {
+                stream.ignore(); // Skip the closing quote
+            }
+        }
+
+        return tokens;
+    }
+
+    // Lines both tokenizers split the same way. The scanner differs on purpose for a quoted "|" or ">" (an argument),
+    // ">>" and "&" (operators), "$(...)" (one word, spaces included), a blank line (no token) and spaces at the end
+    // of a line (the stream tokenizer gave its last token twice)
+    const std::vector<std::string> lines = {
+        "echo hello",
+        "xml cp C:\\some\\folder \"param name\" value | rem out.txt > f",
+        "   copy   -j 16\t--update  build   \\\\backup\\build",
+        "hexdump \"C:\\Program Files\\app.exe\" | findstr app.exe - > strings.txt",
+        "rem -c \"a b c\" notes.txt",
+        "echo \"unclosed quote runs to the end",
+        "echo \"\" empty \"\"",
+        "schema folder src",
+        "a|b c>d",
+        "goto loop",
+    };
+
+    bool sameTokens(const std::vector<Token> &expected, const std::vector<Token> &actual)
+    {
+        if (expected.size() != actual.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            if (expected[i].type != actual[i].type || expected[i].value != actual[i].value)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Function>
+    double nanosecondsPerLine(size_t iterations, Function function)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            function(lines[i % lines.size()]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<TokenView> views;
+    std::vector<Token> tokens;
+
+    bool same = true;
+    for (const auto &line : lines)
+    {
+        scan(line, views);
+        toTokens(views, 0, tokens);
+        if (!sameTokens(streamTokenize(line), tokens))
+        {
+            std::cerr << "Different tokens for: " << line << std::endl;
+            same = false;
+        }
+    }
+    if (!same)
+    {
+        return 1;
+    }
+
+    // The sizes are summed so the work isn't optimized away
+    size_t count = 0;
+    double stream = nanosecondsPerLine(iterations, [&count](const std::string &line)
+                                       { count += streamTokenize(line).size(); });
+    double scanned = nanosecondsPerLine(iterations, [&](const std::string &line)
+                                        {
+                                            scan(line, views);
+                                            toTokens(views, 0, tokens);
+                                            count += tokens.size(); });
+
+    std::cout << lines.size() << " lines give the same tokens (" << count << " tokens counted)\n"
+              << "string stream tokenizer : " << stream << " ns per line\n"
+              << "scan + toTokens         : " << scanned << " ns per line (" << stream / scanned << "x)\n";
+    return 0;
+}
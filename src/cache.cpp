@@ -0,0 +1,348 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "output.h"
+#include "utils.h"
+#include "variables.h"
+
+namespace
+{
+    const char entryMagic[] = "cmdpp-cache 1\n";
+
+    // Output of the command written to its destination and kept for the cache, until it gets too large
+    class RecordingSink : public Output::Sink
+    {
+    public:
+        explicit RecordingSink(std::ostream &target) : target(target) {}
+
+        const std::string &recorded() const
+        {
+            return content;
+        }
+
+        bool complete() const
+        {
+            return !overflowed;
+        }
+
+    protected:
+        bool writeBlock(std::vector<char> &block, size_t size) override
+        {
+            if (!overflowed && size <= Cache::maxEntrySize - content.size())
+            {
+                content.append(block.data(), size);
+            }
+            else if (!overflowed)
+            {
+                overflowed = true;
+                std::string().swap(content);
+            }
+
+            return static_cast<bool>(target.write(block.data(), size));
+        }
+
+        int sync() override
+        {
+            int result = Sink::sync();
+            target.flush();
+            return result;
+        }
+
+    private:
+        std::ostream &target;
+        std::string content;
+        bool overflowed = false;
+    };
+
+    std::streamoff inputPosition(std::istream &input)
+    {
+        return input.rdbuf() != nullptr ? static_cast<std::streamoff>(input.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in)) : -1;
+    }
+
+    void appendField(std::string &key, std::string_view value)
+    {
+        // Length prefixed, so no two lists of fields give the same key
+        key += std::to_string(value.size());
+        key += ':';
+        key.append(value.data(), value.size());
+    }
+
+    // Every entry a folder holds, with the size and modification time of its files : the modification time of
+    // the folder only changes when an entry is added to it or removed, not when a file below it is written
+    bool appendTreeFingerprint(std::string &key, const std::filesystem::path &folderPath)
+    {
+        std::vector<std::string> entries;
+        std::error_code error;
+
+        std::filesystem::recursive_directory_iterator entry(folderPath, std::filesystem::directory_options::skip_permission_denied, error);
+        for (; !error && entry != std::filesystem::recursive_directory_iterator(); entry.increment(error))
+        {
+            std::error_code entryError;
+            std::string fields = entry->path().lexically_relative(folderPath).string();
+            if (entry->is_regular_file(entryError))
+            {
+                fields += ' ' + std::to_string(entry->file_size(entryError)) + ' ' +
+                          std::to_string(entry->last_write_time(entryError).time_since_epoch().count());
+            }
+            entries.push_back(std::move(fields));
+        }
+        if (error)
+        {
+            return false;
+        }
+
+        // The order of a walk isn't guaranteed
+        std::sort(entries.begin(), entries.end());
+        for (const auto &fields : entries)
+        {
+            appendField(key, fields);
+        }
+        return true;
+    }
+
+    // Size, modification time and identity of a file or directory, false when it doesn't exist
+    bool appendFingerprint(std::string &key, const std::string &filePath)
+    {
+        std::error_code error;
+        std::filesystem::path absolutePath = std::filesystem::absolute(filePath, error);
+        if (error)
+        {
+            return false;
+        }
+
+#ifdef _WIN32
+        HANDLE handle = CreateFileW(absolutePath.wstring().c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                    OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        BY_HANDLE_FILE_INFORMATION information;
+        BOOL found = GetFileInformationByHandle(handle, &information);
+        CloseHandle(handle);
+        if (!found)
+        {
+            return false;
+        }
+
+        uint64_t size = (static_cast<uint64_t>(information.nFileSizeHigh) << 32) | information.nFileSizeLow;
+        uint64_t modified = (static_cast<uint64_t>(information.ftLastWriteTime.dwHighDateTime) << 32) | information.ftLastWriteTime.dwLowDateTime;
+        uint64_t identity = (static_cast<uint64_t>(information.nFileIndexHigh) << 32) | information.nFileIndexLow;
+        uint64_t device = information.dwVolumeSerialNumber;
+#else
+        struct stat status;
+        if (stat(absolutePath.c_str(), &status) != 0)
+        {
+            return false;
+        }
+
+        uint64_t size = static_cast<uint64_t>(status.st_size);
+        uint64_t modified = static_cast<uint64_t>(status.st_mtim.tv_sec) * 1000000000ull + status.st_mtim.tv_nsec;
+        uint64_t identity = static_cast<uint64_t>(status.st_ino);
+        uint64_t device = static_cast<uint64_t>(status.st_dev);
+#endif
+
+        appendField(key, absolutePath.string());
+        appendField(key, std::to_string(size) + ' ' + std::to_string(modified) + ' ' + std::to_string(identity) + ' ' + std::to_string(device));
+        return !std::filesystem::is_directory(absolutePath, error) || appendTreeFingerprint(key, absolutePath);
+    }
+
+    // Command, arguments and fingerprint of every input ; false when an input is missing
+    bool buildKey(std::string_view name, const std::vector<Token> &arguments, const std::vector<std::string> &inputs, std::string &key)
+    {
+        appendField(key, name);
+        key += '\n';
+        for (const auto &argument : arguments)
+        {
+            appendField(key, argument.value);
+        }
+        key += '\n';
+        for (const auto &input : inputs)
+        {
+            if (!appendFingerprint(key, input))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The result is stored in a file named after the hash of its key, the key is stored too and compared
+    std::string entryName(const std::string &key)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : key)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+
+        static const char digits[] = "0123456789abcdef";
+        std::string name(16, '0');
+        for (int i = 15; i >= 0; --i, hash >>= 4)
+        {
+            name[i] = digits[hash & 0xF];
+        }
+        return name;
+    }
+
+    bool replay(const std::filesystem::path &entryPath, const std::string &key, std::ostream &output)
+    {
+        std::ifstream entry(entryPath.string(), std::ios::binary);
+        if (!entry)
+        {
+            return false;
+        }
+
+        std::string content((std::istreambuf_iterator<char>(entry)), std::istreambuf_iterator<char>());
+
+        std::string header = entryMagic + std::to_string(key.size()) + '\n';
+        if (content.compare(0, header.size(), header) != 0 || content.compare(header.size(), key.size(), key) != 0)
+        {
+            return false;
+        }
+
+        size_t offset = header.size() + key.size();
+        output.write(content.data() + offset, content.size() - offset);
+        return true;
+    }
+
+    // Written to a temporary file then renamed, so a reader never sees a partial result
+    void store(const std::filesystem::path &entryPath, const std::string &key, const std::string &result)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(entryPath.parent_path(), error);
+
+        static std::atomic<uint64_t> counter{0};
+        std::ostringstream suffix;
+        suffix << ".tmp" << std::this_thread::get_id() << '_' << counter.fetch_add(1);
+        std::filesystem::path temporaryPath = entryPath;
+        temporaryPath += suffix.str();
+
+        {
+            std::ofstream entry(temporaryPath.string(), std::ios::binary | std::ios::trunc);
+            entry << entryMagic << key.size() << '\n';
+            entry.write(key.data(), key.size());
+            entry.write(result.data(), result.size());
+            if (!entry.flush())
+            {
+                entry.close();
+                std::filesystem::remove(temporaryPath, error);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temporaryPath, entryPath, error);
+        if (error)
+        {
+            std::filesystem::remove(temporaryPath, error);
+        }
+    }
+}
+
+Cache::Result Cache::execute(std::string_view name, Command &command, const std::vector<Token> &arguments, std::istream &input, std::ostream &output, bool forced)
+{
+    std::string key;
+    std::vector<std::string> inputs;
+    if (!command.cacheInputs(arguments, inputs))
+    {
+        if (!forced)
+        {
+            command.execute(arguments, input, output);
+            return Result::UNCACHED;
+        }
+
+        inputs.clear();
+        for (const auto &argument : arguments)
+        {
+            std::error_code error;
+            if (std::filesystem::exists(argument.value, error))
+            {
+                inputs.push_back(argument.value);
+            }
+        }
+
+        // An undeclared command may read the working directory : the same line run from another folder
+        // is another result
+        std::error_code error;
+        appendField(key, std::filesystem::current_path(error).string());
+        if (error)
+        {
+            command.execute(arguments, input, output);
+            return Result::UNCACHED;
+        }
+    }
+
+    if (!buildKey(name, arguments, inputs, key))
+    {
+        command.execute(arguments, input, output);
+        return Result::UNCACHED;
+    }
+
+    std::filesystem::path entryPath = std::filesystem::path(directory()) / entryName(key);
+    if (replay(entryPath, key, output))
+    {
+        return Result::HIT;
+    }
+
+    std::streamoff readBefore = inputPosition(input);
+
+    RecordingSink recording(output);
+    std::ostream recorded(&recording);
+    command.execute(arguments, input, recorded);
+    recorded.flush();
+
+    // A command which read its input gave an output the key doesn't describe
+    std::streamoff readAfter = inputPosition(input);
+    bool readInput = readBefore >= 0 && readAfter != readBefore;
+
+    if (recording.complete() && recorded && !readInput)
+    {
+        store(entryPath, key, recording.recorded());
+    }
+    return Result::MISS;
+}
+
+std::string Cache::directory()
+{
+    std::string path;
+    if (Variables::get("CMDPP_CACHE_DIR", path) && !path.empty())
+    {
+        return path;
+    }
+
+    std::error_code error;
+    std::filesystem::path temporary = std::filesystem::temp_directory_path(error);
+    return ((error ? std::filesystem::path(".") : temporary) / "cmdpp-cache").string();
+}
+
+size_t Cache::clear()
+{
+    size_t removed = 0;
+    std::error_code error;
+
+    for (const auto &entry : std::filesystem::directory_iterator(directory(), error))
+    {
+        std::error_code removeError;
+        if (entry.is_regular_file(removeError) && std::filesystem::remove(entry.path(), removeError))
+        {
+            ++removed;
+        }
+    }
+    return removed;
+}
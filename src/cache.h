@@ -0,0 +1,37 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "command.h"
+
+namespace Cache
+{
+    // Largest output kept for a command, a larger one is only written to the output
+    constexpr size_t maxEntrySize = 16 * 1024 * 1024;
+
+    enum class Result
+    {
+        UNCACHED, // The command doesn't declare its inputs (and isn't forced) or an input is missing
+        HIT,      // The stored output was replayed without running the command
+        MISS      // The command ran, its output was stored when it could be
+    };
+
+    // Execute a built-in command, or write the output it gave the last time it ran with the same arguments on
+    // input files which haven't changed since (same size, modification time and inode). A folder input is
+    // walked : its entries and the size and modification time of every file below it are part of the key.
+    // "forced" caches a command which doesn't declare its inputs : the arguments naming a file and the working
+    // directory are its inputs, the variables it may read are not
+    Result execute(std::string_view name, Command &command, const std::vector<Token> &arguments, std::istream &input, std::ostream &output, bool forced);
+
+    // Directory of the results, CMDPP_CACHE_DIR or "cmdpp-cache" in the temporary directory
+    std::string directory();
+
+    // Remove every stored result, the number of results removed
+    size_t clear();
+}
+
+#endif
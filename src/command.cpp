@@ -7,6 +7,7 @@
 #include <string>
 #include <chrono>
 #include <thread>
+#include <future>
 #include <ctime>
 #include <cmath>
 #include <cstdlib>
@@ -15,6 +16,8 @@
 #include <unordered_set>
 #include <memory>
 #include <regex>
+#include <algorithm>
+#include <iomanip>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -26,49 +29,41 @@
 #pragma comment(lib, "Dbghelp.lib")
 #pragma comment(lib, "Shlwapi.lib")
 #else
+#include <poll.h>
+#include <signal.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #endif
 
+#include "cache.h"
 #include "command.h"
+#include "copy.h"
+#include "jobs.h"
+#include "metrics.h"
+#include "output.h"
+#include "registry.h"
+#include "script.h"
+#include "shell.h"
 #include "tokenizer.h"
+#include "trace.h"
 #include "utils.h"
+#include "variables.h"
 
 using namespace Tokenizer;
 using namespace Utils;
 using namespace fs;
 
-void Exe::executeCommand(const std::wstring &command)
-{
-    STARTUPINFOW startupInfo = {sizeof(STARTUPINFOW)};
-    PROCESS_INFORMATION processInfo;
-
-    if (CreateProcessW(NULL, const_cast<LPWSTR>(command.c_str()), NULL, NULL, FALSE, DETACHED_PROCESS, NULL, NULL, &startupInfo, &processInfo))
-    {
-        // Wait for the process to finish (optional)
-        WaitForSingleObject(processInfo.hProcess, INFINITE);
-
-        // Close process and thread handles
-        CloseHandle(processInfo.hProcess);
-        CloseHandle(processInfo.hThread);
-    }
-    else
-    {
-        std::cerr << "Failed to execute command: " << command.c_str() << std::endl;
-    }
-}
-
-void EchoCommand::execute(const std::vector<Token> &arguments)
+void EchoCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     for (const auto &arg : arguments)
     {
-        std::cout << arg.value << " ";
+        output << arg.value << " ";
     }
-    std::cout << std::endl;
+    output << '\n';
 }
 
-void CdCommand::execute(const std::vector<Token> &arguments)
+void CdCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() == 1)
     {
@@ -76,7 +71,7 @@ void CdCommand::execute(const std::vector<Token> &arguments)
     }
     else
     {
-        std::cout << "Current directory: " << getCurrentDir() << std::endl;
+        output << "Current directory: " << getCurrentDir() << '\n';
         std::cerr << "Usage: cd <directory>" << std::endl;
     }
 }
@@ -90,6 +85,9 @@ void CdCommand::changeDirectory(const std::string &newDir)
     {
         Utils::currentDirectory = newPath.string();
         fs::current_path(newPath);
+
+        // Commands are first looked up in the current directory
+        Exe::invalidateExecutableCache();
     }
     else
     {
@@ -97,7 +95,8 @@ void CdCommand::changeDirectory(const std::string &newDir)
     }
 }
 
-void AssocCommand::execute(const std::vector<Token> &arguments)
+#ifdef _WIN32
+void AssocCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() != 1 && arguments[0].type != TokenType::ARGUMENT)
     {
@@ -110,8 +109,8 @@ void AssocCommand::execute(const std::vector<Token> &arguments)
 
         if (AssocQueryStringW(ASSOCF_INIT_IGNOREUNKNOWN, ASSOCSTR_COMMAND, fileExtension.c_str(), nullptr, buffer, (DWORD *)&bufferSize) == S_OK)
         {
-            std::wcout << L"Command associated with " << fileExtension << L":\n";
-            std::wcout << buffer << std::endl;
+            output << "Command associated with " << fileExtensionStr << ":\n";
+            output << wstringToString(buffer) << '\n';
         }
         else
         {
@@ -124,8 +123,14 @@ void AssocCommand::execute(const std::vector<Token> &arguments)
         return;
     }
 }
+#else
+void AssocCommand::execute(const std::vector<Token> &, std::istream &, std::ostream &)
+{
+    std::cerr << "assoc is only available on Windows" << std::endl;
+}
+#endif
 
-void ClsCommand::execute(const std::vector<Token> &arguments)
+void ClsCommand::execute(const std::vector<Token> &, std::istream &, std::ostream &)
 {
     clearScreen();
 
@@ -141,7 +146,7 @@ void ClsCommand::clearScreen()
 #endif
 }
 
-void CmdCommand::execute(const std::vector<Token> &arguments)
+void CmdCommand::execute(const std::vector<Token> &, std::istream &, std::ostream &)
 {
 #ifdef _WIN32
     startNewProcess();
@@ -183,31 +188,16 @@ void CmdCommand::startNewProcess()
 #else
 void CmdCommand::forkAndExec()
 {
-    pid_t childPid = fork();
-
-    if (childPid == -1)
-    {
-        std::cerr << "Failed to fork a new process." << std::endl;
-        return;
-    }
-
-    if (childPid == 0)
+    // Started with posix_spawn like the other programs, the console is shared until it exits
+    Exe::Process process;
+    if (Exe::spawn({"./cmdplusplus"}, Exe::invalidHandle, Exe::invalidHandle, process)) // Change to your executable name and path
     {
-        // Child process
-        execl("./cmdplusplus", "cmdplusplus", nullptr); // Change to your executable name and path
-        std::cerr << "Failed to execute a new process." << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    else
-    {
-        // Parent process
-        int status;
-        waitpid(childPid, &status, 0);
+        Exe::wait(process);
     }
 }
 #endif
 
-void ColorCommand::execute(const std::vector<Token> &arguments)
+void ColorCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &)
 {
     if (arguments.size() == 1)
     {
@@ -258,11 +248,11 @@ int ColorCommand::parseHexColor(const std::string &hexColor)
     }
 }
 
-void CompCommand::execute(const std::vector<Token> &arguments)
+void CompCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() == 2)
     {
-        compFile(arguments[0].value, arguments[1].value);
+        compFile(arguments[0].value, arguments[1].value, output);
     }
     else
     {
@@ -270,7 +260,7 @@ void CompCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void CompCommand::compFile(const std::string &filePath1, const std::string &filePath2)
+void CompCommand::compFile(const std::string &filePath1, const std::string &filePath2, std::ostream &output)
 {
 
     std::ifstream file1(filePath1, std::ios::binary);
@@ -288,43 +278,81 @@ void CompCommand::compFile(const std::string &filePath1, const std::string &file
 
         if (buffer1.size() != buffer2.size())
         {
-            std::cout << "Files have different sizes." << std::endl;
+            output << "Files have different sizes." << '\n';
         }
         else
         {
-            std::cout << "Files are identical." << std::endl;
+            output << "Files are identical." << '\n';
         }
     }
 }
 
-void CopyCommand::execute(const std::vector<Token> &arguments)
+void CopyCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     std::vector<std::string> sourcePaths;
     std::string destinationPath;
+    Copy::Options options;
+    bool progress = false;
+    size_t first = 0;
+
+    // "-j <workers>" : number of files a folder is copied with at the same time
+    // "--update" : only copy what changed since the previous copy
+    // "--compare" : update, comparing the contents even of the files which look unchanged
+    // "--direct" : read and write around the page cache
+    // "--progress" : display the throughput and the time left while copying
+    while (first < arguments.size() && (arguments[first].value == "-j" || arguments[first].value == "--update" || arguments[first].value == "--compare" ||
+                                        arguments[first].value == "--direct" || arguments[first].value == "--progress"))
+    {
+        if (arguments[first].value != "-j")
+        {
+            options.compare = options.compare || arguments[first].value == "--compare";
+            options.update = options.update || options.compare || arguments[first].value == "--update";
+            options.direct = options.direct || arguments[first].value == "--direct";
+            progress = progress || arguments[first].value == "--progress";
+            ++first;
+            continue;
+        }
+
+        try
+        {
+            options.workers = first + 1 < arguments.size() ? std::stoul(arguments[first + 1].value) : 0;
+        }
+        catch (const std::exception &)
+        {
+            options.workers = 0;
+        }
+        first += 2;
+    }
 
-    for (int i = 0; i < arguments.size() - 1; ++i)
+    if (arguments.size() < first + 2 || options.workers == 0 || options.workers > 1024)
+    {
+        std::cerr << "Usage: copy [-j <workers>] [--update | --compare] [--direct] [--progress] <source_paths> <destination_path>" << std::endl;
+        return;
+    }
+
+    for (size_t i = first; i < arguments.size() - 1; ++i)
     {
         sourcePaths.push_back(arguments[i].value);
     }
 
     destinationPath = arguments[arguments.size() - 1].value;
 
-    if (sourcePaths.size() == 1 && fs::is_directory(sourcePaths[0]))
+    if (progress)
     {
-        // Copy all files in a directory
-        if (destinationPath.back() != fs::path::preferred_separator)
-        {
-            destinationPath += fs::path::preferred_separator;
-        }
+        copyWithProgress(sourcePaths, destinationPath, options, output);
+    }
+    else
+    {
+        copyPaths(sourcePaths, destinationPath, options, output);
+    }
+}
 
-        try
-        {
-            copyDirectory(sourcePaths[0], destinationPath);
-        }
-        catch (const std::invalid_argument &e)
-        {
-            std::cerr << "Error encountering while copying the file" << std::endl;
-        }
+void CopyCommand::copyPaths(const std::vector<std::string> &sourcePaths, std::string destinationPath, const Copy::Options &options, std::ostream &output)
+{
+    if (sourcePaths.size() == 1 && fs::is_directory(sourcePaths[0]))
+    {
+        // Copy a directory and all its subdirectories
+        copyDirectory(sourcePaths[0], destinationPath, options, output);
     }
     else if (sourcePaths.size() > 1)
     {
@@ -336,7 +364,7 @@ void CopyCommand::execute(const std::vector<Token> &arguments)
 
         try
         {
-            copyFiles(sourcePaths, destinationPath);
+            copyFiles(sourcePaths, destinationPath, options, output);
         }
         catch (const std::invalid_argument &e)
         {
@@ -355,7 +383,7 @@ void CopyCommand::execute(const std::vector<Token> &arguments)
                     destinationPath += "\\" + fs::path(sourcePath).filename().string();
                 }
             }
-            copyFile(sourcePaths[0], destinationPath);
+            copyFile(sourcePaths[0], destinationPath, options, output);
         }
         catch (const std::invalid_argument &e)
         {
@@ -364,34 +392,109 @@ void CopyCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void CopyCommand::copyFile(const std::string &sourcePath, const std::string &destinationPath)
+void CopyCommand::copyWithProgress(const std::vector<std::string> &sourcePaths, const std::string &destinationPath, Copy::Options options, std::ostream &output)
 {
-    std::ifstream sourceFile(sourcePath, std::ios::binary);
-    if (!sourceFile.is_open())
+    // The files to copy are known now, the files of a folder once it is walked
+    Copy::Progress progress;
+    options.progress = &progress;
+    for (const auto &sourcePath : sourcePaths)
     {
-        std::cerr << "Error opening source file: " << sourcePath << std::endl;
+        std::error_code error;
+        if (fs::is_regular_file(sourcePath, error))
+        {
+            progress.total += fs::file_size(sourcePath, error);
+        }
     }
 
-    std::ofstream destinationFile(destinationPath, std::ios::binary);
-    if (!destinationFile.is_open())
+    // The copy runs on another thread, this one displays its progress then writes its results
+    std::ostringstream results;
+    auto start = std::chrono::steady_clock::now();
+    std::future<void> copying = std::async(std::launch::async, [&]()
+                                           { copyPaths(sourcePaths, destinationPath, options, results); });
+
+    size_t width = 0;
+    while (copying.wait_for(std::chrono::milliseconds(250)) != std::future_status::ready)
     {
-        std::cerr << "Error opening destination file: " << destinationPath << std::endl;
+        uint64_t done = progress.done.load(std::memory_order_relaxed);
+        uint64_t total = std::max(progress.total.load(std::memory_order_relaxed), done);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double rate = done / seconds;
+
+        std::ostringstream line;
+        line << Metrics::formatSize(done) << " of " << Metrics::formatSize(total);
+        if (total > 0)
+        {
+            line << " (" << done * 100 / total << " %)";
+        }
+        line << " at " << Metrics::formatSize(static_cast<uint64_t>(rate)) << "/s";
+        if (rate > 0 && total > done)
+        {
+            uint64_t left = static_cast<uint64_t>((total - done) / rate);
+            line << ", ";
+            if (left >= 3600)
+            {
+                line << left / 3600 << " h ";
+            }
+            if (left >= 60)
+            {
+                line << left / 60 % 60 << " min ";
+            }
+            line << left % 60 << " s left";
+        }
+
+        // Spaces erase the end of a longer previous line
+        std::string text = line.str();
+        output << '\r' << text << std::string(width > text.size() ? width - text.size() : 0, ' ') << std::flush;
+        width = text.size();
     }
+    copying.get();
 
-    std::vector<char> buffer(std::istreambuf_iterator<char>(sourceFile), {});
+    if (width > 0)
+    {
+        output << '\r' << std::string(width, ' ') << '\r';
+    }
+    output << results.str();
+}
 
-    destinationFile.write(buffer.data(), buffer.size());
+Copy::Result CopyCommand::copyFile(const std::string &sourcePath, const std::string &destinationPath, const Copy::Options &options, std::ostream &output)
+{
+    Copy::Result result;
+    if (!Copy::copyFile(sourcePath, destinationPath, options, result))
+    {
+        return Copy::Result();
+    }
 
-    if (!destinationFile.good())
+    if (result.unchanged)
     {
-        std::cerr << "Error writing to destination file: " << destinationPath << std::endl;
+        output << "File unchanged, skipped: " << Metrics::formatSize(result.skippedBytes) << '\n';
+        return result;
     }
 
-    std::cout << "File copied successfully." << std::endl;
+    if (options.update)
+    {
+        output << "File updated: " << Metrics::formatSize(result.bytes) << " written, " << Metrics::formatSize(result.skippedBytes) << " unchanged";
+    }
+    else
+    {
+        output << "File copied successfully: " << Metrics::formatSize(result.bytes) << " with " << Copy::methodName(result.method);
+    }
+    if (result.holeBytes > 0)
+    {
+        output << ", " << Metrics::formatSize(result.holeBytes) << " left as holes";
+    }
+    if (result.seconds > 0)
+    {
+        output << " at " << Metrics::formatSize(static_cast<uint64_t>((result.bytes + result.skippedBytes) / result.seconds)) << "/s";
+    }
+    output << '\n';
+    return result;
 }
 
-void CopyCommand::copyFiles(const std::vector<std::string> &sourcePaths, const std::string &destinationDir)
+void CopyCommand::copyFiles(const std::vector<std::string> &sourcePaths, const std::string &destinationDir, const Copy::Options &options, std::ostream &output)
 {
+    uint64_t written = 0;
+    uint64_t skipped = 0;
+
     for (const auto &sourcePath : sourcePaths)
     {
         std::string destinationPath = destinationDir;
@@ -402,21 +505,57 @@ void CopyCommand::copyFiles(const std::vector<std::string> &sourcePaths, const s
             destinationPath += fs::path(sourcePath).filename().string();
         }
 
-        copyFile(sourcePath, destinationPath);
+        Copy::Result result = copyFile(sourcePath, destinationPath, options, output);
+        written += result.bytes;
+        skipped += result.skippedBytes;
+    }
+
+    if (options.update)
+    {
+        output << "Update: " << Metrics::formatSize(written) << " written, " << Metrics::formatSize(skipped) << " skipped" << '\n';
     }
 }
 
-void CopyCommand::copyDirectory(const std::string &sourceDir, const std::string &destinationDir)
+void CopyCommand::copyDirectory(const std::string &sourceDir, const std::string &destinationDir, const Copy::Options &options, std::ostream &output)
 {
-    for (const auto &entry : fs::directory_iterator(sourceDir))
+    Copy::TreeResult result;
+    Copy::copyTree(sourceDir, destinationDir, options, result);
+
+    for (const auto &error : result.errors)
+    {
+        std::cerr << error << std::endl;
+    }
+
+    if (result.files + result.unchangedFiles + result.directories + result.links == 0 && !result.errors.empty())
+    {
+        return;
+    }
+
+    output << "Copied " << result.files << " file" << (result.files == 1 ? "" : "s") << " (" << Metrics::formatSize(result.bytes) << "), "
+           << result.directories << " folder" << (result.directories == 1 ? "" : "s");
+    if (result.links > 0)
+    {
+        output << " and " << result.links << " link" << (result.links == 1 ? "" : "s");
+    }
+    if (result.holeBytes > 0)
     {
-        std::string destinationPath = destinationDir + entry.path().filename().string();
+        output << ", " << Metrics::formatSize(result.holeBytes) << " left as holes";
+    }
+    output << " in " << std::fixed << std::setprecision(2) << result.seconds << std::defaultfloat << " s";
+    if (result.seconds > 0)
+    {
+        output << " at " << Metrics::formatSize(static_cast<uint64_t>(result.bytes / result.seconds)) << "/s";
+    }
+    output << " with " << options.workers << " worker" << (options.workers == 1 ? "" : "s") << '\n';
 
-        copyFile(entry.path().string(), destinationPath);
+    if (options.update)
+    {
+        output << "Update: " << result.unchangedFiles << " unchanged file" << (result.unchangedFiles == 1 ? "" : "s") << " skipped, "
+               << Metrics::formatSize(result.bytes) << " written, " << Metrics::formatSize(result.skippedBytes) << " skipped" << '\n';
     }
 }
 
-void TimeCommand::execute(const std::vector<Token> &arguments)
+void TimeCommand::execute(const std::vector<Token> &, std::istream &, std::ostream &output)
 {
     // Get the current time using the system clock
     auto startT = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -424,7 +563,7 @@ void TimeCommand::execute(const std::vector<Token> &arguments)
     // Convert the time to a string
     std::string startTimeString = std::ctime(&startT);
 
-    std::cout << "Started at: " << startTimeString << std::endl;
+    output << "Started at: " << startTimeString << '\n';
 
     while (!keyPressed())
     {
@@ -434,17 +573,17 @@ void TimeCommand::execute(const std::vector<Token> &arguments)
         std::string currentTime = std::ctime(&now);
 
         // Display the current date and time
-        displayTime(currentTime);
+        displayTime(currentTime, output);
 
         std::this_thread::sleep_for(std::chrono::seconds(1));
     }
-    std::cout << "\n";
+    output << "\n";
 
     auto endT = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
     std::string endTimeString = std::ctime(&endT);
 
-    std::cout << "Ended at: " << endTimeString << std::endl;
+    output << "Ended at: " << endTimeString << '\n';
 
     // Convert start and end time strings to std::time_t
     std::time_t startTime = convertToTimeT(startTimeString);
@@ -456,20 +595,26 @@ void TimeCommand::execute(const std::vector<Token> &arguments)
     // Format the elapsed time
     std::string formattedElapsedTime = formatElapsedTime(elapsed_seconds);
 
-    std::cout << "Time elapsed: " << formattedElapsedTime << std::endl;
+    output << "Time elapsed: " << formattedElapsedTime << '\n';
 }
 
 bool TimeCommand::keyPressed()
 {
+#ifdef _WIN32
     return _kbhit();
+#else
+    // The terminal is line buffered, a key counts once Enter is pressed
+    pollfd standardInput{STDIN_FILENO, POLLIN, 0};
+    return poll(&standardInput, 1, 0) > 0;
+#endif
 }
 
-void TimeCommand::displayTime(std::string currentTime)
+void TimeCommand::displayTime(std::string currentTime, std::ostream &output)
 {
     // Remove the newline character from the currentTime string
     currentTime.erase(std::remove(currentTime.begin(), currentTime.end(), '\n'), currentTime.end());
 
-    std::cout << "\rTime: " << currentTime << std::flush;
+    output << "\rTime: " << currentTime << std::flush;
 }
 
 std::time_t TimeCommand::convertToTimeT(const std::string &timeString)
@@ -494,19 +639,19 @@ std::string TimeCommand::formatElapsedTime(double elapsedSeconds)
     return oss.str();
 }
 
-void TimerCommand::execute(const std::vector<Token> &arguments)
+void TimerCommand::execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
 {
     int hours, minutes, seconds = 0;
     bool s_init, m_init, h_init = false;
 
     if (arguments.size() == 0)
     {
-        std::cout << "Enter hours: ";
-        std::cin >> hours;
-        std::cout << "Enter minutes: ";
-        std::cin >> minutes;
-        std::cout << "Enter seconds: ";
-        std::cin >> seconds;
+        output << "Enter hours: ";
+        input >> hours;
+        output << "Enter minutes: ";
+        input >> minutes;
+        output << "Enter seconds: ";
+        input >> seconds;
     }
     else if (arguments.size() == 6)
     {
@@ -521,7 +666,7 @@ void TimerCommand::execute(const std::vector<Token> &arguments)
                 }
                 else
                 {
-                    std::cout << "Seconds value already initialized, set to 0 to avoid error" << std::endl;
+                    output << "Seconds value already initialized, set to 0 to avoid error" << '\n';
                     seconds = 0;
                 }
             }
@@ -534,7 +679,7 @@ void TimerCommand::execute(const std::vector<Token> &arguments)
                 }
                 else
                 {
-                    std::cout << "Minutes value already initialized, set to 0 to avoid error" << std::endl;
+                    output << "Minutes value already initialized, set to 0 to avoid error" << '\n';
                     minutes = 0;
                 }
             }
@@ -547,7 +692,7 @@ void TimerCommand::execute(const std::vector<Token> &arguments)
                 }
                 else
                 {
-                    std::cout << "Hours value already initialized, set to 0 to avoid error" << std::endl;
+                    output << "Hours value already initialized, set to 0 to avoid error" << '\n';
                     hours = 0;
                 }
             }
@@ -566,18 +711,18 @@ void TimerCommand::execute(const std::vector<Token> &arguments)
     auto duration = std::chrono::hours(hours) + std::chrono::minutes(minutes) + std::chrono::seconds(seconds);
 
     // Start timer
-    std::cout << "Timer started!" << std::endl;
+    output << "Timer started!" << '\n';
     while (duration.count() > 0)
     {
-        display_timer(duration);
+        display_timer(duration, output);
         std::this_thread::sleep_for(std::chrono::seconds(1));
         duration -= std::chrono::seconds(1);
     }
 
-    std::cout << "\nTimer expired!" << std::endl;
+    output << "\nTimer expired!" << '\n';
 }
 
-void TimerCommand::display_timer(std::chrono::seconds duration)
+void TimerCommand::display_timer(std::chrono::seconds duration, std::ostream &output)
 {
     auto hours = std::chrono::duration_cast<std::chrono::hours>(duration);
     duration -= hours;
@@ -585,19 +730,21 @@ void TimerCommand::display_timer(std::chrono::seconds duration)
     duration -= minutes;
     auto seconds = duration;
 
-    std::cout << "\rTimer: ";
+    output << "\rTimer: ";
     if (hours.count() < 10)
-        std::cout << "0";
-    std::cout << hours.count() << ":";
+        output << "0";
+    output << hours.count() << ":";
     if (minutes.count() < 10)
-        std::cout << "0";
-    std::cout << minutes.count() << ":";
+        output << "0";
+    output << minutes.count() << ":";
     if (seconds.count() < 10)
-        std::cout << "0";
-    std::cout << seconds.count() << std::flush;
+        output << "0";
+    output << seconds.count() << std::flush;
 }
 
-void LsofCommand::execute(const std::vector<Token> &arguments)
+// Process inspection relies on the Win32 debugging API
+#ifdef _WIN32
+void LsofCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() == 1)
     {
@@ -605,7 +752,7 @@ void LsofCommand::execute(const std::vector<Token> &arguments)
         {
             int pidBase = detectNumberBase(arguments[0].value);
             DWORD processId = std::stoul(arguments[0].value, nullptr, pidBase);
-            listOpenFiles(processId);
+            listOpenFiles(processId, output);
         }
         catch (const std::exception &e)
         {
@@ -618,7 +765,7 @@ void LsofCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void LsofCommand::listOpenFiles(DWORD processId)
+void LsofCommand::listOpenFiles(DWORD processId, std::ostream &output)
 {
     HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, processId);
 
@@ -638,7 +785,7 @@ void LsofCommand::listOpenFiles(DWORD processId)
             char szModuleName[MAX_PATH];
             if (GetModuleFileNameExA(hProcess, hModules[i], szModuleName, sizeof(szModuleName) / sizeof(char)))
             {
-                std::cout << "File: " << szModuleName << std::endl;
+                output << "File: " << szModuleName << '\n';
             }
         }
     }
@@ -650,7 +797,7 @@ void LsofCommand::listOpenFiles(DWORD processId)
     CloseHandle(hProcess);
 }
 
-void MemadrsCommand::execute(const std::vector<Token> &arguments)
+void MemadrsCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() == 2)
     {
@@ -659,7 +806,7 @@ void MemadrsCommand::execute(const std::vector<Token> &arguments)
             DWORD processId = std::stoul(arguments[0].value, nullptr);
             std::string outputFilePath = arguments[1].value;
 
-            extractMemoryAddresses(processId, outputFilePath);
+            extractMemoryAddresses(processId, outputFilePath, output);
         }
         catch (const std::exception &e)
         {
@@ -673,7 +820,7 @@ void MemadrsCommand::execute(const std::vector<Token> &arguments)
             DWORD processId = std::stoul(arguments[0].value, nullptr);
             std::string outputFilePath = "./\\memory_address";
 
-            extractMemoryAddresses(processId, outputFilePath);
+            extractMemoryAddresses(processId, outputFilePath, output);
         }
         catch (const std::exception &e)
         {
@@ -686,7 +833,7 @@ void MemadrsCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &outputFilePath)
+void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &outputFilePath, std::ostream &output)
 {
     EnableDebugPrivileges();
 
@@ -713,8 +860,8 @@ void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &
     if (GetModuleInformation(hProcess, GetProcessModuleHandle(processId), &moduleInfo, sizeof(moduleInfo)))
     {
         // Code Section
-        std::cout << "Code Section: " << std::hex << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) << " - "
-                  << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) + moduleInfo.SizeOfImage << std::endl;
+        output << "Code Section: " << std::hex << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) << " - "
+                  << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) + moduleInfo.SizeOfImage << '\n';
 
         // Data Section
         PIMAGE_NT_HEADERS pNTHeader = ImageNtHeader(moduleInfo.lpBaseOfDll);
@@ -723,12 +870,12 @@ void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &
             IMAGE_SECTION_HEADER *pSectionHeader = IMAGE_FIRST_SECTION(pNTHeader);
             for (int i = 0; i < pNTHeader->FileHeader.NumberOfSections; ++i)
             {
-                std::cout << "Data Section: " << std::hex
+                output << "Data Section: " << std::hex
                           << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) + pSectionHeader[i].VirtualAddress
                           << " - "
                           << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) + pSectionHeader[i].VirtualAddress +
                                  pSectionHeader[i].Misc.VirtualSize
-                          << std::endl;
+                          << '\n';
             }
         }
 
@@ -736,7 +883,7 @@ void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &
         PROCESS_MEMORY_COUNTERS_EX pmc;
         if (GetProcessMemoryInfo(hProcess, reinterpret_cast<PROCESS_MEMORY_COUNTERS *>(&pmc), sizeof(pmc)))
         {
-            std::cout << "Heap: " << std::hex << pmc.PrivateUsage << " - " << pmc.PrivateUsage + pmc.PagefileUsage << std::endl;
+            output << "Heap: " << std::hex << pmc.PrivateUsage << " - " << pmc.PrivateUsage + pmc.PagefileUsage << '\n';
         }
 
         // Stack
@@ -750,8 +897,8 @@ void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &
                 (memoryInfo.AllocationProtect == PAGE_READWRITE ||
                  memoryInfo.AllocationProtect == PAGE_EXECUTE_READWRITE))
             {
-                std::cout << "Stack: " << std::hex << reinterpret_cast<uintptr_t>(memoryInfo.BaseAddress) << " - "
-                          << reinterpret_cast<uintptr_t>(memoryInfo.BaseAddress) + memoryInfo.RegionSize << std::endl;
+                output << "Stack: " << std::hex << reinterpret_cast<uintptr_t>(memoryInfo.BaseAddress) << " - "
+                          << reinterpret_cast<uintptr_t>(memoryInfo.BaseAddress) + memoryInfo.RegionSize << '\n';
             }
             stackPointer = reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(memoryInfo.BaseAddress) + memoryInfo.RegionSize);
         }
@@ -761,7 +908,7 @@ void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &
         if (outputFile.is_open())
         {
             outputFile << "Code Section: " << std::hex << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) << " - "
-                       << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) + moduleInfo.SizeOfImage << std::endl;
+                       << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) + moduleInfo.SizeOfImage << '\n';
             if (pNTHeader != NULL)
             {
                 IMAGE_SECTION_HEADER *pSectionHeader = IMAGE_FIRST_SECTION(pNTHeader);
@@ -772,11 +919,11 @@ void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &
                                << " - "
                                << reinterpret_cast<uintptr_t>(moduleInfo.lpBaseOfDll) + pSectionHeader[i].VirtualAddress +
                                       pSectionHeader[i].Misc.VirtualSize
-                               << std::endl;
+                               << '\n';
                 }
             }
             outputFile << "Heap: " << std::hex << pmc.PrivateUsage << " - " << pmc.PrivateUsage + pmc.PagefileUsage
-                       << std::endl;
+                       << '\n';
             stackPointer = nullptr;
             while (VirtualQueryEx(hProcess, stackPointer, &memoryInfo, sizeof(memoryInfo)) == sizeof(memoryInfo))
             {
@@ -787,12 +934,12 @@ void MemadrsCommand::extractMemoryAddresses(DWORD processId, const std::string &
                     outputFile << "Stack: " << std::hex
                                << reinterpret_cast<uintptr_t>(memoryInfo.BaseAddress) << " - "
                                << reinterpret_cast<uintptr_t>(memoryInfo.BaseAddress) + memoryInfo.RegionSize
-                               << std::endl;
+                               << '\n';
                 }
                 stackPointer =
                     reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(memoryInfo.BaseAddress) + memoryInfo.RegionSize);
             }
-            std::cout << "Memory addresses saved to: " << outputFilePath << std::endl;
+            output << "Memory addresses saved to: " << outputFilePath << '\n';
         }
         else
         {
@@ -850,7 +997,7 @@ HMODULE MemadrsCommand::GetProcessModuleHandle(DWORD processId)
     return NULL;
 }
 
-void RmaCommand::execute(const std::vector<Token> &arguments)
+void RmaCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() == 3)
     {
@@ -865,7 +1012,7 @@ void RmaCommand::execute(const std::vector<Token> &arguments)
             unsigned long ulMemoryAddress = std::stoul(stringMemoryAddress, nullptr, memoryBase);
             uintptr_t memoryAddress = static_cast<uintptr_t>(ulMemoryAddress);
 
-            readMemoryAddresses(processId, memoryType, memoryAddress);
+            readMemoryAddresses(processId, memoryType, memoryAddress, output);
         }
         catch (const std::exception &e)
         {
@@ -899,7 +1046,7 @@ bool RmaCommand::IsMemoryAddressValid(HANDLE hProcess, uintptr_t address)
     return VirtualQueryEx(hProcess, reinterpret_cast<LPCVOID>(address), &memInfo, sizeof(memInfo)) == sizeof(memInfo);
 }
 
-void RmaCommand::VerifyMemoryAccess(HANDLE hProcess, LPVOID address)
+void RmaCommand::VerifyMemoryAccess(HANDLE hProcess, LPVOID address, std::ostream &output)
 {
     MEMORY_BASIC_INFORMATION memoryInfo;
 
@@ -909,10 +1056,10 @@ void RmaCommand::VerifyMemoryAccess(HANDLE hProcess, LPVOID address)
     {
         if (memoryInfo.State == MEM_COMMIT && memoryInfo.Protect != PAGE_NOACCESS)
         {
-            std::cout << "Memory at address " << address << " is accessible." << std::endl;
-            std::cout << "Base Address: " << memoryInfo.BaseAddress << std::endl;
-            std::cout << "Region Size: " << memoryInfo.RegionSize << " bytes" << std::endl;
-            std::cout << "Protection: " << memoryInfo.Protect << std::endl;
+            output << "Memory at address " << address << " is accessible." << '\n';
+            output << "Base Address: " << memoryInfo.BaseAddress << '\n';
+            output << "Region Size: " << memoryInfo.RegionSize << " bytes" << '\n';
+            output << "Protection: " << memoryInfo.Protect << '\n';
         }
         else
         {
@@ -926,7 +1073,7 @@ void RmaCommand::VerifyMemoryAccess(HANDLE hProcess, LPVOID address)
 }
 
 /*
-void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, uintptr_t &memoryAddress)
+void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, uintptr_t &memoryAddress, std::ostream &output)
 {
     // Open the process with appropriate access rights
     HANDLE hProcess = OpenProcess(PROCESS_VM_READ, FALSE, processId);
@@ -944,12 +1091,12 @@ void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, u
     if (ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(memoryAddress), buffer, sizeof(buffer), &bytesRead))
     {
         // Print the first few bytes from the specified memory region
-        std::cout << "Bytes from " << memoryType << " at address " << std::hex << memoryAddress << ": ";
+        output << "Bytes from " << memoryType << " at address " << std::hex << memoryAddress << ": ";
         for (SIZE_T i = 0; i < bytesRead; ++i)
         {
-            std::cout << std::hex << static_cast<int>(buffer[i]) << " ";
+            output << std::hex << static_cast<int>(buffer[i]) << " ";
         }
-        std::cout << std::endl;
+        output << '\n';
     }
     else
     {
@@ -967,7 +1114,7 @@ void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, u
 }
 */
 
-void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, uintptr_t &memoryAddress)
+void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, uintptr_t &memoryAddress, std::ostream &output)
 {
     HANDLE hProcess = OpenProcess(PROCESS_VM_READ | PROCESS_QUERY_INFORMATION, FALSE, processId);
 
@@ -986,7 +1133,7 @@ void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, u
         }
     }
 
-    // VerifyMemoryAccess(hProcess, static_cast<LPVOID>(reinterpret_cast<void *>(memoryAddress)));
+    // VerifyMemoryAccess(hProcess, static_cast<LPVOID>(reinterpret_cast<void *>(memoryAddress)), output);
 
     // Read the data from the address
     const size_t bufferSize = 1024; // Adjust the buffer size as needed
@@ -1022,12 +1169,12 @@ void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, u
         if (ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(memoryAddress), buffer, sizeof(buffer), &bytesRead))
         {
             // Print the first few bytes from the Code Section
-            std::cout << "Bytes from Code Section at address " << std::hex << memoryAddress << ": ";
+            output << "Bytes from Code Section at address " << std::hex << memoryAddress << ": ";
             for (SIZE_T i = 0; i < bytesRead; ++i)
             {
-                std::cout << std::hex << (int)buffer[i] << " ";
+                output << std::hex << (int)buffer[i] << " ";
             }
-            std::cout << std::endl;
+            output << '\n';
         }
         else
         {
@@ -1042,12 +1189,12 @@ void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, u
         if (ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(memoryAddress), buffer, sizeof(buffer), &bytesRead))
         {
             // Print the first few bytes from the Data Section
-            std::cout << "Bytes from Data Section at address " << std::hex << memoryAddress << ": ";
+            output << "Bytes from Data Section at address " << std::hex << memoryAddress << ": ";
             for (SIZE_T i = 0; i < bytesRead; ++i)
             {
-                std::cout << std::hex << static_cast<int>(buffer[i]) << " ";
+                output << std::hex << static_cast<int>(buffer[i]) << " ";
             }
-            std::cout << std::endl;
+            output << '\n';
         }
         else
         {
@@ -1068,12 +1215,12 @@ void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, u
         if (ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(memoryAddress), buffer, sizeof(buffer), &bytesRead))
         {
             // Print the first few bytes from the Heap
-            std::cout << "Bytes from Heap at address " << std::hex << memoryAddress << ": ";
+            output << "Bytes from Heap at address " << std::hex << memoryAddress << ": ";
             for (SIZE_T i = 0; i < bytesRead; ++i)
             {
-                std::cout << std::hex << static_cast<int>(buffer[i]) << " ";
+                output << std::hex << static_cast<int>(buffer[i]) << " ";
             }
-            std::cout << std::endl;
+            output << '\n';
         }
         else
         {
@@ -1088,12 +1235,12 @@ void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, u
         if (ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(memoryAddress), buffer, sizeof(buffer), &bytesRead))
         {
             // Print the first few bytes from the Stack
-            std::cout << "Bytes from Stack at address " << std::hex << memoryAddress << ": ";
+            output << "Bytes from Stack at address " << std::hex << memoryAddress << ": ";
             for (SIZE_T i = 0; i < bytesRead; ++i)
             {
-                std::cout << std::hex << static_cast<int>(buffer[i]) << " ";
+                output << std::hex << static_cast<int>(buffer[i]) << " ";
             }
-            std::cout << std::endl;
+            output << '\n';
         }
         else
         {
@@ -1108,16 +1255,32 @@ void RmaCommand::readMemoryAddresses(DWORD processId, std::string &memoryType, u
         std::cerr << "Unknow process memory type. Error code: " << GetLastError() << std::endl;
     }
 }
+#else
+void LsofCommand::execute(const std::vector<Token> &, std::istream &, std::ostream &)
+{
+    std::cerr << "lsof is only available on Windows" << std::endl;
+}
+
+void MemadrsCommand::execute(const std::vector<Token> &, std::istream &, std::ostream &)
+{
+    std::cerr << "memadrs is only available on Windows" << std::endl;
+}
+
+void RmaCommand::execute(const std::vector<Token> &, std::istream &, std::ostream &)
+{
+    std::cerr << "rma is only available on Windows" << std::endl;
+}
+#endif
 
-void HexdumpCommand::execute(const std::vector<Token> &arguments)
+void HexdumpCommand::execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
 {
     if (arguments.size() == 1)
     {
         std::string filePath = arguments[0].value;
 
-        hexdumpC(filePath);
+        hexdumpC(filePath, input, output);
     }
-    else if (arguments.size() == 2 || arguments.size() == 3 && arguments[1].value == "-sf")
+    else if (arguments.size() == 2 || (arguments.size() == 3 && arguments[1].value == "-sf"))
     {
         if (arguments.size() == 2)
         {
@@ -1126,7 +1289,7 @@ void HexdumpCommand::execute(const std::vector<Token> &arguments)
                 std::string filePath = arguments[0].value;
                 std::string saveFilePath = "./\\hexdump.txt";
 
-                hexdumpF(filePath, saveFilePath);
+                hexdumpF(filePath, saveFilePath, input);
             }
             catch (const std::exception &e)
             {
@@ -1140,7 +1303,7 @@ void HexdumpCommand::execute(const std::vector<Token> &arguments)
                 std::string filePath = arguments[0].value;
                 std::string saveFilePath = arguments[2].value;
 
-                hexdumpF(filePath, saveFilePath);
+                hexdumpF(filePath, saveFilePath, input);
             }
             catch (const std::exception &e)
             {
@@ -1154,81 +1317,97 @@ void HexdumpCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void HexdumpCommand::hexdumpC(const std::string &filePath)
+void HexdumpCommand::hexdumpC(const std::string &filePath, std::istream &input, std::ostream &output)
 {
-    std::ifstream file(filePath, std::ios::binary);
+    // "-" reads the data coming from the previous command of a pipeline
+    std::ifstream file;
+    std::istream *source = &input;
 
-    if (!file.is_open())
+    if (filePath != "-")
     {
-        std::cerr << "Error opening file: " << filePath << std::endl;
-        return;
+        file.open(filePath, std::ios::binary);
+
+        if (!file.is_open())
+        {
+            std::cerr << "Error opening file: " << filePath << std::endl;
+            return;
+        }
+        source = &file;
     }
 
-    std::cout << "Hexadecimal dump of file: " << filePath << std::endl;
+    output << "Hexadecimal dump of file: " << filePath << '\n';
 
     // Set width for better formatting
     const int width = 16;
 
     // Read and display the file content in hexadecimal
     char buffer[width];
-    while (file.read(buffer, width))
+    while (source->read(buffer, width))
     {
         for (int i = 0; i < width; ++i)
         {
             // Print hex representation with leading zeros
-            std::cout << std::hex << std::setw(2) << std::setfill('0')
+            output << std::hex << std::setw(2) << std::setfill('0')
                       << static_cast<int>(buffer[i]) << " ";
         }
 
-        std::cout << "  | ";
+        output << "  | ";
 
         // Print ASCII representation
         for (int i = 0; i < width; ++i)
         {
             char c = buffer[i];
             // Print printable characters, replace others with a dot
-            std::cout << (isprint(c) ? c : '.');
+            output << (isprint(c) ? c : '.');
         }
 
-        std::cout << std::endl;
+        output << '\n';
     }
 
     // Handle the remaining bytes
-    int remaining_bytes = file.gcount();
+    int remaining_bytes = source->gcount();
     for (int i = 0; i < remaining_bytes; ++i)
     {
-        std::cout << std::hex << std::setw(2) << std::setfill('0')
+        output << std::hex << std::setw(2) << std::setfill('0')
                   << static_cast<int>(buffer[i]) << " ";
     }
 
     // Add padding spaces for alignment
     for (int i = 0; i < width - remaining_bytes; ++i)
     {
-        std::cout << "   ";
+        output << "   ";
     }
 
-    std::cout << "  | ";
+    output << "  | ";
 
     // Print ASCII representation for the remaining bytes
     for (int i = 0; i < remaining_bytes; ++i)
     {
         char c = buffer[i];
-        std::cout << (isprint(c) ? c : '.');
+        output << (isprint(c) ? c : '.');
     }
 
-    std::cout << std::endl;
+    output << '\n';
 
     file.close();
 }
 
-void HexdumpCommand::hexdumpF(const std::string &filePath, const std::string &saveFilePath)
+void HexdumpCommand::hexdumpF(const std::string &filePath, const std::string &saveFilePath, std::istream &input)
 {
-    std::ifstream file(filePath, std::ios::binary);
+    // "-" reads the data coming from the previous command of a pipeline
+    std::ifstream file;
+    std::istream *source = &input;
 
-    if (!file.is_open())
+    if (filePath != "-")
     {
-        std::cerr << "Error opening file: " << filePath << std::endl;
-        return;
+        file.open(filePath, std::ios::binary);
+
+        if (!file.is_open())
+        {
+            std::cerr << "Error opening file: " << filePath << std::endl;
+            return;
+        }
+        source = &file;
     }
 
     std::ostream *output_stream;
@@ -1242,14 +1421,14 @@ void HexdumpCommand::hexdumpF(const std::string &filePath, const std::string &sa
     }
     output_stream = &save_file;
 
-    (*output_stream) << "Hexadecimal dump of file: " << filePath << std::endl;
+    (*output_stream) << "Hexadecimal dump of file: " << filePath << '\n';
 
     // Set width for better formatting
     const int width = 16;
 
     // Read and display the file content in hexadecimal
     char buffer[width];
-    while (file.read(buffer, width))
+    while (source->read(buffer, width))
     {
         for (int i = 0; i < width; ++i)
         {
@@ -1268,11 +1447,11 @@ void HexdumpCommand::hexdumpF(const std::string &filePath, const std::string &sa
             (*output_stream) << (isprint(c) ? c : '.');
         }
 
-        (*output_stream) << std::endl;
+        (*output_stream) << '\n';
     }
 
     // Handle the remaining bytes
-    int remaining_bytes = file.gcount();
+    int remaining_bytes = source->gcount();
     for (int i = 0; i < remaining_bytes; ++i)
     {
         (*output_stream) << std::hex << std::setw(2) << std::setfill('0')
@@ -1294,13 +1473,13 @@ void HexdumpCommand::hexdumpF(const std::string &filePath, const std::string &sa
         (*output_stream) << (isprint(c) ? c : '.');
     }
 
-    (*output_stream) << std::endl;
+    (*output_stream) << '\n';
 
     file.close();
     save_file.close(); // Close the save file stream if it was opened
 }
 
-void ExtractstrCommand::execute(const std::vector<Token> &arguments)
+void ExtractstrCommand::execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
 {
     if (arguments.size() == 1)
     {
@@ -1309,7 +1488,7 @@ void ExtractstrCommand::execute(const std::vector<Token> &arguments)
             std::string filePath = arguments[0].value;
             std::string saveFilePath = "./\\extracted_str.txt";
 
-            extractStrings(filePath, saveFilePath);
+            extractStrings(filePath, saveFilePath, input, output);
         }
         catch (const std::exception &e)
         {
@@ -1323,7 +1502,7 @@ void ExtractstrCommand::execute(const std::vector<Token> &arguments)
             std::string filePath = arguments[0].value;
             std::string saveFilePath = arguments[1].value;
 
-            extractStrings(filePath, saveFilePath);
+            extractStrings(filePath, saveFilePath, input, output);
         }
         catch (const std::exception &e)
         {
@@ -1336,31 +1515,43 @@ void ExtractstrCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void ExtractstrCommand::extractStrings(const std::string &filePath, const std::string &saveFilePath)
+void ExtractstrCommand::extractStrings(const std::string &filePath, const std::string &saveFilePath, std::istream &input, std::ostream &output)
 {
     std::vector<std::string> strings;
-    std::ifstream file(filePath, std::ios::binary);
 
-    if (!file.is_open())
+    // "-" as file path reads from the previous command of a pipeline, "-" as save file path writes to the command output
+    std::ifstream file;
+    std::istream *source = &input;
+
+    if (filePath != "-")
     {
-        std::cerr << "Error opening file: " << filePath << std::endl;
+        file.open(filePath, std::ios::binary);
+
+        if (!file.is_open())
+        {
+            std::cerr << "Error opening file: " << filePath << std::endl;
+        }
+        source = &file;
     }
 
-    std::ostream *output_stream;
+    std::ostream *output_stream = &output;
     std::ofstream save_file;
 
-    save_file.open(saveFilePath, std::ios::out | std::ios::trunc);
-    if (!save_file.is_open())
+    if (saveFilePath != "-")
     {
-        std::cerr << "Error opening save file: " << saveFilePath << std::endl;
-        return;
+        save_file.open(saveFilePath, std::ios::out | std::ios::trunc);
+        if (!save_file.is_open())
+        {
+            std::cerr << "Error opening save file: " << saveFilePath << std::endl;
+            return;
+        }
+        output_stream = &save_file;
     }
-    output_stream = &save_file;
 
     std::string buffer;
     char ch;
 
-    while (file.get(ch))
+    while (source->get(ch))
     {
         if (isprint(ch) || ch == '\r' || ch == '\n' || ch == '\t')
         {
@@ -1380,14 +1571,14 @@ void ExtractstrCommand::extractStrings(const std::string &filePath, const std::s
 
     file.close();
 
-    *output_stream << "Extracted Strings:" << std::endl;
+    *output_stream << "Extracted Strings:" << '\n';
     for (const auto &extractedStrings : strings)
     {
-        *output_stream << extractedStrings << std::endl;
+        *output_stream << extractedStrings << '\n';
     }
 }
 
-void XmlCommand::execute(const std::vector<Token> &arguments)
+void XmlCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments[0].value == "cp")
     {
@@ -1399,7 +1590,7 @@ void XmlCommand::execute(const std::vector<Token> &arguments)
                 std::string paramName = arguments[2].value;
                 std::string newValue = arguments[3].value;
 
-                processFolder(folderPath, paramName, newValue);
+                processFolder(folderPath, paramName, newValue, output);
             }
             catch (const std::exception &e)
             {
@@ -1417,7 +1608,7 @@ void XmlCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void XmlCommand::processFolder(const std::string &folderPath, const std::string &paramName, const std::string &newValue)
+void XmlCommand::processFolder(const std::string &folderPath, const std::string &paramName, const std::string &newValue, std::ostream &output)
 {
     int totalCount = 0;
 
@@ -1429,7 +1620,7 @@ void XmlCommand::processFolder(const std::string &folderPath, const std::string
         }
     }
 
-    std::cout << "Total occurrences modified: " << totalCount << std::endl;
+    output << "Total occurrences modified: " << totalCount << '\n';
 }
 
 int XmlCommand::changeParameterInXML(const std::string &xmlFile, const std::string &paramName, const std::string &newValue)
@@ -1475,7 +1666,7 @@ int XmlCommand::changeParameterInXML(const std::string &xmlFile, const std::stri
     }
 }
 
-void EncodingCommand::execute(const std::vector<Token> &arguments)
+void EncodingCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments[0].value == "xor")
     {
@@ -1487,7 +1678,7 @@ void EncodingCommand::execute(const std::vector<Token> &arguments)
                 std::string output_file = arguments[3].value;
                 std::string encryption_key = arguments[4].value;
 
-                xor_encrypt(input_file, output_file, encryption_key);
+                xor_encrypt(input_file, output_file, encryption_key, output);
             }
             catch (const std::exception &e)
             {
@@ -1502,7 +1693,7 @@ void EncodingCommand::execute(const std::vector<Token> &arguments)
                 std::string output_file = arguments[3].value;
                 std::string decryption_key = arguments[4].value;
 
-                xor_decrypt(input_file, output_file, decryption_key);
+                xor_decrypt(input_file, output_file, decryption_key, output);
             }
             catch (const std::exception &e)
             {
@@ -1520,7 +1711,7 @@ void EncodingCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void EncodingCommand::xor_encrypt(const std::string &input_file, const std::string &output_file, const std::string &encryption_key)
+void EncodingCommand::xor_encrypt(const std::string &input_file, const std::string &output_file, const std::string &encryption_key, std::ostream &output)
 {
     try
     {
@@ -1543,7 +1734,7 @@ void EncodingCommand::xor_encrypt(const std::string &input_file, const std::stri
             i++;
         }
 
-        std::cout << "File encrypted successfully. Encrypted file saved at: " << output_file << std::endl;
+        output << "File encrypted successfully. Encrypted file saved at: " << output_file << '\n';
 
         input_stream.close();
         output_stream.close();
@@ -1554,7 +1745,7 @@ void EncodingCommand::xor_encrypt(const std::string &input_file, const std::stri
     }
 }
 
-void EncodingCommand::xor_decrypt(const std::string &input_file, const std::string &output_file, const std::string &decryption_key)
+void EncodingCommand::xor_decrypt(const std::string &input_file, const std::string &output_file, const std::string &decryption_key, std::ostream &output)
 {
     try
     {
@@ -1577,7 +1768,7 @@ void EncodingCommand::xor_decrypt(const std::string &input_file, const std::stri
             i++;
         }
 
-        std::cout << "File decrypted successfully. Decrypted file saved at: " << output_file << std::endl;
+        output << "File decrypted successfully. Decrypted file saved at: " << output_file << '\n';
 
         input_stream.close();
         output_stream.close();
@@ -1588,7 +1779,7 @@ void EncodingCommand::xor_decrypt(const std::string &input_file, const std::stri
     }
 }
 
-void PasswordCommand::execute(const std::vector<Token> &arguments)
+void PasswordCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() == 1)
     {
@@ -1600,11 +1791,11 @@ void PasswordCommand::execute(const std::vector<Token> &arguments)
 
             if (!password.empty())
             {
-                std::cout << "Generated Password: " << password << std::endl;
+                output << "Generated Password: " << password << '\n';
             }
             else
             {
-                std::cout << "Error encounter during password generation" << std::endl;
+                output << "Error encounter during password generation" << '\n';
             }
         }
         catch (const std::exception &e)
@@ -1641,7 +1832,7 @@ std::string PasswordCommand::generatePassword(int length)
     return password;
 }
 
-void QuicksearchCommand::execute(const std::vector<Token> &arguments)
+void QuicksearchCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() == 2)
     {
@@ -1660,7 +1851,7 @@ void QuicksearchCommand::execute(const std::vector<Token> &arguments)
 
                 for (const auto &path : filePaths)
                 {
-                    std::wcout << path << std::endl;
+                    output << wstringToString(path) << '\n';
                 }
             }
             catch (const std::exception &e)
@@ -1683,7 +1874,7 @@ void QuicksearchCommand::execute(const std::vector<Token> &arguments)
 
                 for (const auto &path : filePaths)
                 {
-                    std::wcout << path << std::endl;
+                    output << wstringToString(path) << '\n';
                 }
             }
             catch (const std::exception &e)
@@ -1738,6 +1929,7 @@ std::vector<std::wstring> QuicksearchCommand::searchFile(const std::wstring &dir
 // Iterative function using stack
 std::vector<std::wstring> QuicksearchCommand::searchFile(const std::wstring &directory, const std::wstring &fileName, std::vector<std::wstring> &filePaths)
 {
+#ifdef _WIN32
     std::stack<std::wstring> directories;
     directories.push(directory);
 
@@ -1776,6 +1968,16 @@ std::vector<std::wstring> QuicksearchCommand::searchFile(const std::wstring &dir
 
         FindClose(hFind);
     }
+#else
+    std::error_code error;
+    for (fs::recursive_directory_iterator entry(directory, fs::directory_options::skip_permission_denied, error), end; entry != end; entry.increment(error))
+    {
+        if (!entry->is_directory(error) && entry->path().filename().wstring() == fileName)
+        {
+            filePaths.push_back(entry->path().wstring());
+        }
+    }
+#endif
 
     return filePaths;
 }
@@ -1786,7 +1988,7 @@ std::vector<std::wstring> QuicksearchCommand::searchFilesWithExtension(const std
     {
         if (entry.is_regular_file())
         {
-            std::wstring fileName = entry.path().filename();
+            std::wstring fileName = entry.path().filename().wstring();
             if (fileName.size() > extension.size() && fileName.substr(fileName.size() - extension.size()) == extension)
             {
                 filePaths.push_back(entry.path().wstring());
@@ -1796,20 +1998,31 @@ std::vector<std::wstring> QuicksearchCommand::searchFilesWithExtension(const std
     return filePaths;
 }
 
-void MemstatsCommand::execute(const std::vector<Token> &arguments)
+void MemstatsCommand::execute(const std::vector<Token> &, std::istream &, std::ostream &output)
 {
+#ifdef _WIN32
     MEMORYSTATUSEX memStatus;
     memStatus.dwLength = sizeof(memStatus);
     GlobalMemoryStatusEx(&memStatus);
 
-    std::cout << "Memory Statistics:" << std::endl;
-    std::cout << "------------------" << std::endl;
-    std::cout << "Total Physical Memory: " << formatMemory(memStatus.ullTotalPhys) << std::endl;
-    std::cout << "Available Physical Memory: " << formatMemory(memStatus.ullAvailPhys) << std::endl;
-    std::cout << "Memory Load: " << memStatus.dwMemoryLoad << "%" << std::endl;
+    unsigned long long totalPhys = memStatus.ullTotalPhys;
+    unsigned long long availPhys = memStatus.ullAvailPhys;
+    unsigned long memoryLoad = memStatus.dwMemoryLoad;
+#else
+    unsigned long long pageSize = sysconf(_SC_PAGESIZE);
+    unsigned long long totalPhys = sysconf(_SC_PHYS_PAGES) * pageSize;
+    unsigned long long availPhys = sysconf(_SC_AVPHYS_PAGES) * pageSize;
+    unsigned long memoryLoad = totalPhys == 0 ? 0 : 100 - availPhys * 100 / totalPhys;
+#endif
+
+    output << "Memory Statistics:" << '\n';
+    output << "------------------" << '\n';
+    output << "Total Physical Memory: " << formatMemory(totalPhys) << '\n';
+    output << "Available Physical Memory: " << formatMemory(availPhys) << '\n';
+    output << "Memory Load: " << memoryLoad << "%" << '\n';
 }
 
-std::string MemstatsCommand::formatMemory(ULONGLONG bytes)
+std::string MemstatsCommand::formatMemory(unsigned long long bytes)
 {
     const double KB = 1024.0;
     const double MB = KB * 1024.0;
@@ -1835,29 +2048,28 @@ std::string MemstatsCommand::formatMemory(ULONGLONG bytes)
     return oss.str();
 }
 
-void CalculatorCommand::execute(const std::vector<Token> &arguments)
+void CalculatorCommand::execute(const std::vector<Token> &, std::istream &input, std::ostream &output)
 {
-    std::string input;
+    std::string expression;
 
-    std::cout << "Calculator Mode (Basic Version)\n";
+    output << "Calculator Mode (Basic Version)\n";
 
     while (true)
     {
-        std::cout << "> ";
-        getline(std::cin, input);
+        output << "> " << std::flush;
 
-        if (input == "exit")
+        if (!getline(input, expression) || expression == "exit")
             break;
 
-        double result = calculate(input);
+        double result = calculate(expression, output);
         if (!__isnan(result))
-            std::cout << "Result: " << result << std::endl;
+            output << "Result: " << result << '\n';
     }
 
-    std::cout << "Exiting Calculator Mode\n";
+    output << "Exiting Calculator Mode\n";
 }
 
-double CalculatorCommand::calculate(std::string expression)
+double CalculatorCommand::calculate(std::string expression, std::ostream &output)
 {
     std::istringstream iss(expression);
     double result = 0.0;
@@ -1885,22 +2097,23 @@ double CalculatorCommand::calculate(std::string expression)
                 result /= operand;
             else
             {
-                std::cout << "Error: Division by zero!" << std::endl;
+                output << "Error: Division by zero!" << '\n';
                 return NAN; // Not a Number
             }
             break;
         default:
-            std::cout << "Error: Invalid operator " << op << std::endl;
+            output << "Error: Invalid operator " << op << '\n';
             return NAN;
         }
     }
     return result;
 }
 
-void KillCommand::execute(const std::vector<Token> &arguments)
+void KillCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() == 1)
     {
+#ifdef _WIN32
         DWORD pid = std::stoul(arguments[0].value);
 
         // Open the process
@@ -1917,10 +2130,21 @@ void KillCommand::execute(const std::vector<Token> &arguments)
             CloseHandle(hProcess);
         }
 
-        std::cout << "Process with PID " << pid << " terminated successfully." << std::endl;
+        output << "Process with PID " << pid << " terminated successfully." << '\n';
 
         // Close the process handle
         CloseHandle(hProcess);
+#else
+        pid_t pid = std::stoi(arguments[0].value);
+
+        if (::kill(pid, SIGKILL) != 0)
+        {
+            std::cerr << "Failed to terminate process with PID " << pid << std::endl;
+            return;
+        }
+
+        output << "Process with PID " << pid << " terminated successfully." << '\n';
+#endif
     }
     else
     {
@@ -1928,7 +2152,7 @@ void KillCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void RandomCommand::execute(const std::vector<Token> &arguments)
+void RandomCommand::execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
 {
     if (arguments.size() >= 1)
     {
@@ -1947,7 +2171,7 @@ void RandomCommand::execute(const std::vector<Token> &arguments)
                 }
 
                 std::string randomNumber = generateRandomNumber(length);
-                std::cout << "Random number of length " << length << ": " << randomNumber << std::endl;
+                output << "Random number of length " << length << ": " << randomNumber << '\n';
             }
             catch (const std::exception &e)
             {
@@ -1959,11 +2183,11 @@ void RandomCommand::execute(const std::vector<Token> &arguments)
         {
             try
             {
-                std::cout << "Press any key to toss the coin..." << std::endl;
-                std::cin.get(); // Wait for user to press any key
+                output << "Press any key to toss the coin..." << '\n';
+                input.get(); // Wait for user to press any key
 
                 std::string outcome = tossCoin();
-                std::cout << "The coin landed on: " << outcome << std::endl;
+                output << "The coin landed on: " << outcome << '\n';
             }
             catch (const std::exception &e)
             {
@@ -2004,7 +2228,7 @@ std::string RandomCommand::tossCoin()
     return (result == 0) ? "heads" : "tails";
 }
 
-void EnvvarCommand::execute(const std::vector<Token> &arguments)
+void EnvvarCommand::execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
 {
     std::string name;
     std::string value;
@@ -2018,29 +2242,15 @@ void EnvvarCommand::execute(const std::vector<Token> &arguments)
                 name = arguments[1].value;
                 value = arguments[2].value;
 
-                if (containsSpace(value))
-                {
-                    setEnvVar(name, "\"" + value + "\"");
-                }
-                else
-                {
-                    setEnvVar(name, value);
-                }
+                setEnvVar(name, value, output);
             }
             else
             {
-                std::cout << "Enter variable name: ";
-                std::cin >> name;
-                std::cout << "Enter variable value: ";
-                std::cin >> value;
-                if (containsSpace(value))
-                {
-                    setEnvVar(name, "\"" + value + "\"");
-                }
-                else
-                {
-                    setEnvVar(name, value);
-                }
+                output << "Enter variable name: ";
+                input >> name;
+                output << "Enter variable value: ";
+                input >> value;
+                setEnvVar(name, value, output);
             }
         }
         else if (arguments[0].value == "get")
@@ -2049,13 +2259,13 @@ void EnvvarCommand::execute(const std::vector<Token> &arguments)
             {
                 name = arguments[1].value;
 
-                getEnvVar(name);
+                getEnvVar(name, output);
             }
             else
             {
-                std::cout << "Enter variable name: ";
-                std::cin >> name;
-                getEnvVar(name);
+                output << "Enter variable name: ";
+                input >> name;
+                getEnvVar(name, output);
             }
         }
         else if (arguments[0].value == "unset")
@@ -2064,98 +2274,128 @@ void EnvvarCommand::execute(const std::vector<Token> &arguments)
             {
                 name = arguments[1].value;
 
-                unsetEnvVar(name);
+                unsetEnvVar(name, output);
             }
             else
             {
-                std::cout << "Enter variable name: ";
-                std::cin >> name;
-                unsetEnvVar(name);
+                output << "Enter variable name: ";
+                input >> name;
+                unsetEnvVar(name, output);
+            }
+        }
+        else if (arguments[0].value == "export")
+        {
+            if (arguments.size() == 3)
+            {
+                name = arguments[1].value;
+                value = arguments[2].value;
+
+                setEnvVar(name, value, output);
+                exportEnvVar(name, output);
+            }
+            else if (arguments.size() == 2)
+            {
+                name = arguments[1].value;
+
+                exportEnvVar(name, output);
+            }
+            else
+            {
+                output << "Enter variable name: ";
+                input >> name;
+                exportEnvVar(name, output);
             }
         }
         else
         {
-            std::cerr << "Usage: envvar <operation (set/unset/get)>" << std::endl;
+            std::cerr << "Usage: envvar <operation (set/unset/get/export)>" << std::endl;
         }
     }
     else
     {
-        std::cerr << "Usage: envvar <operation (set/unset/get)>" << std::endl;
+        std::cerr << "Usage: envvar <operation (set/unset/get/export)>" << std::endl;
+    }
+}
+
+// Function to set a variable of the session, replacing its value if it already exists
+void EnvvarCommand::setEnvVar(const std::string &name, const std::string &value, std::ostream &output)
+{
+    if (name.empty() || name.find('=') != std::string::npos)
+    {
+        std::cerr << "Invalid variable name: " << name << std::endl;
+        return;
     }
+
+    Variables::set(name, value);
+    output << "Variable " << name << " set to: " << value << '\n';
 }
 
-// Function to set environment variable
-void EnvvarCommand::setEnvVar(const std::string &name, const std::string &value)
+// Function to get a variable
+void EnvvarCommand::getEnvVar(const std::string &name, std::ostream &output)
 {
-    if (getenv(name.c_str()) != nullptr)
+    std::string value;
+    if (Variables::get(name, value))
     {
-        std::cerr << "Environment variable " << name << " already exists" << std::endl;
+        output << "Value of variable " << name << ": " << value << '\n';
     }
     else
     {
-        if (putenv((name + "=" + value).c_str()) != 0)
-        {
-            std::cerr << "Error setting environment variable: " << name << std::endl;
-        }
-        else
-        {
-            std::cout << "Environment variable " << name << " set to: " << value << std::endl;
-        }
+        std::cerr << "Variable " << name << " not found" << std::endl;
     }
 }
 
-// Function to get environment variable
-void EnvvarCommand::getEnvVar(const std::string &name)
+// Function to remove a variable
+void EnvvarCommand::unsetEnvVar(const std::string &name, std::ostream &output)
 {
-    char *value = getenv(name.c_str());
-    if (value != nullptr)
+    if (!Variables::unset(name))
     {
-        std::cout << "Value of environment variable " << name << ": " << value << std::endl;
+        std::cerr << "Variable " << name << " doesn't exists" << std::endl;
     }
     else
     {
-        std::cerr << "Environment variable " << name << " not found" << std::endl;
+        output << "Variable " << name << " unset successfully" << '\n';
     }
 }
 
-// Function to unset environment variable
-void EnvvarCommand::unsetEnvVar(const std::string &name)
+// Function to hand a variable to the programs started by the console
+void EnvvarCommand::exportEnvVar(const std::string &name, std::ostream &output)
 {
-    if (getenv(name.c_str()) == nullptr)
+    if (!Variables::exportVariable(name))
     {
-        std::cerr << "Environment variable " << name << " doesn't exists" << std::endl;
+        std::cerr << "Variable " << name << " not found" << std::endl;
     }
     else
     {
-        if (putenv((name + "=").c_str()) != 0)
-        {
-            std::cerr << "Error unsetting environment variable: " << name << std::endl;
-        }
-        else
-        {
-            std::cout << "Environment variable " << name << " unset successfully" << std::endl;
-        }
+        output << "Variable " << name << " exported" << '\n';
     }
 }
 
-void RemCommand::execute(const std::vector<Token> &arguments)
+void RemCommand::execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
 {
     if (arguments.size() == 2)
     {
         std::string filePath = arguments[0].value;
         std::string pattern = arguments[1].value;
 
-        std::ifstream file(filePath);
-        if (!file)
+        // "-" counts the matches in the data coming from the previous command of a pipeline
+        std::ifstream file;
+        std::istream *source = &input;
+
+        if (filePath != "-")
         {
-            std::cerr << "Error opening file!" << std::endl;
+            file.open(filePath);
+            if (!file)
+            {
+                std::cerr << "Error opening file!" << std::endl;
+            }
+            source = &file;
         }
 
-        std::string text((std::istreambuf_iterator<char>(file)),
+        std::string text((std::istreambuf_iterator<char>(*source)),
                          std::istreambuf_iterator<char>());
 
         int matchCount = countRegexMatches(text, pattern);
-        std::cout << "Number of matches: " << matchCount << std::endl;
+        output << "Number of matches: " << matchCount << '\n';
     }
     else
     {
@@ -2163,6 +2403,18 @@ void RemCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
+bool RemCommand::cacheInputs(const std::vector<Token> &arguments, std::vector<std::string> &filePaths) const
+{
+    // Matches counted in the output of a previous command can't be kept
+    if (arguments.size() != 2 || arguments[0].value == "-")
+    {
+        return false;
+    }
+
+    filePaths.push_back(arguments[0].value);
+    return true;
+}
+
 int RemCommand::countRegexMatches(const std::string &text, const std::string &pattern)
 {
     std::regex regexPattern(pattern);
@@ -2179,7 +2431,7 @@ int RemCommand::countRegexMatches(const std::string &text, const std::string &pa
     return count;
 }
 
-void SchemaCommand::execute(const std::vector<Token> &arguments)
+void SchemaCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
 {
     if (arguments.size() >= 1)
     {
@@ -2189,7 +2441,7 @@ void SchemaCommand::execute(const std::vector<Token> &arguments)
             {
                 std::string entryFile = arguments[1].value;
 
-                dependencyTreeCommand(entryFile);
+                dependencyTreeCommand(entryFile, output);
             }
             else
             {
@@ -2214,8 +2466,8 @@ void SchemaCommand::execute(const std::vector<Token> &arguments)
 
                 size_t currentEntryIndex = 0;
 
-                std::cout << folderPath << "\n";
-                generateFolderTree(folderPath, 0, false, 0, currentEntryIndex, false, 0);
+                output << folderPath << "\n";
+                generateFolderTree(folderPath, 0, false, 0, currentEntryIndex, false, 0, output);
             }
             else
             {
@@ -2229,16 +2481,17 @@ void SchemaCommand::execute(const std::vector<Token> &arguments)
     }
 }
 
-void SchemaCommand::dependencyTreeCommand(const std::string &entryFile)
+void SchemaCommand::dependencyTreeCommand(const std::string &entryFile, std::ostream &output)
 {
-    parseFile(entryFile);
-    std::cout << "Dependency Tree:" << std::endl;
+    DependencyGraph dependencyGraph;
+    parseFile(entryFile, dependencyGraph);
+    output << "Dependency Tree:" << '\n';
     std::unordered_set<std::string> visited;
-    generateDependencyTree(entryFile, 0, visited);
+    generateDependencyTree(entryFile, 0, dependencyGraph, visited, output);
 }
 
 // Function to parse a file and extract its dependencies
-void SchemaCommand::parseFile(const std::string &filename)
+void SchemaCommand::parseFile(const std::string &filename, DependencyGraph &dependencyGraph)
 {
     std::ifstream file(filename);
     if (!file.is_open())
@@ -2267,7 +2520,7 @@ void SchemaCommand::parseFile(const std::string &filename)
 }
 
 // Function to recursively generate the dependency tree
-void SchemaCommand::generateDependencyTree(const std::string &file, int depth, std::unordered_set<std::string> &visited)
+void SchemaCommand::generateDependencyTree(const std::string &file, int depth, DependencyGraph &dependencyGraph, std::unordered_set<std::string> &visited, std::ostream &output)
 {
     if (visited.count(file) > 0) // Limiting depth and preventing cyclic dependencies
         return;
@@ -2276,28 +2529,24 @@ void SchemaCommand::generateDependencyTree(const std::string &file, int depth, s
 
     // Print indentation based on depth
     for (int i = 0; i < depth; ++i)
-        std::cout << "  ";
+        output << "  ";
 
-    std::cout << "|-- " << file << std::endl;
+    output << "|-- " << file << '\n';
 
     // Recursively call for dependencies
     for (const std::string &dependency : dependencyGraph[file])
     {
-        generateDependencyTree(dependency, depth + 1, visited);
+        generateDependencyTree(dependency, depth + 1, dependencyGraph, visited, output);
     }
 }
 
-void SchemaCommand::generateFolderTree(const fs::path &folderPath, int level, bool isLast, size_t totalEntries, size_t currentEntryIndex, bool parentIsLast, size_t lastFolderCount)
+void SchemaCommand::generateFolderTree(const fs::path &folderPath, int level, bool, size_t, size_t currentEntryIndex, bool parentIsLast, size_t lastFolderCount, std::ostream &output)
 {
     if (fs::is_directory(folderPath))
     {
 
         // Get the number of entries in the current directory
-        size_t totalEntries = 0;
-        for (const auto &entryTemp : fs::directory_iterator(folderPath))
-        {
-            ++totalEntries;
-        }
+        size_t totalEntries = std::distance(fs::directory_iterator(folderPath), fs::directory_iterator());
 
         size_t currentIndex = 0;
         for (const auto &entry : fs::directory_iterator(folderPath))
@@ -2311,7 +2560,7 @@ void SchemaCommand::generateFolderTree(const fs::path &folderPath, int level, bo
 
             if (parentIsLast)
             {
-                for (int i = 0; i < level - (4 * lastFolderCount); ++i)
+                for (int i = 0; i < level - 4 * static_cast<int>(lastFolderCount); ++i)
                 {
                     if (i % 4 == 0)
                     {
@@ -2346,38 +2595,497 @@ void SchemaCommand::generateFolderTree(const fs::path &folderPath, int level, bo
             std::string entryStr = entry.path().filename().string();
             if (entry.is_directory())
             {
-                std::cout << indent;
+                output << indent;
                 if (currentIndex < totalEntries)
                 {
-                    std::cout << "├── ";
+                    output << "├── ";
                     parentIsLast = false;
                 }
                 else
                 {
-                    std::cout << "└── ";
+                    output << "└── ";
                     parentIsLast = true;
                     lastFolderCount += 1;
                 }
-                std::cout << entryStr << " " << lastFolderCount << "/\n";
-                generateFolderTree(entry.path(), level + 4, isLastEntry, totalEntries, currentEntryIndex, parentIsLast, lastFolderCount);
+                output << entryStr << " " << lastFolderCount << "/\n";
+                generateFolderTree(entry.path(), level + 4, isLastEntry, totalEntries, currentEntryIndex, parentIsLast, lastFolderCount, output);
             }
             else
             {
-                std::cout << indent;
+                output << indent;
                 if (currentIndex < totalEntries)
                 {
-                    std::cout << "├── ";
+                    output << "├── ";
                 }
                 else
                 {
-                    std::cout << "└── ";
+                    output << "└── ";
                     if (parentIsLast)
                     {
                         lastFolderCount -= 1;
                     }
                 }
-                std::cout << entryStr << " " << lastFolderCount << "\n";
+                output << entryStr << " " << lastFolderCount << "\n";
             }
         }
     }
 }
+
+void JobsCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
+{
+    if (arguments.empty())
+    {
+        Jobs::list(output);
+    }
+    else
+    {
+        std::cerr << "Usage: jobs" << std::endl;
+    }
+}
+
+void WaitCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
+{
+    if (arguments.empty())
+    {
+        Jobs::waitAll(output);
+        return;
+    }
+
+    for (const auto &argument : arguments)
+    {
+        try
+        {
+            if (!Jobs::wait(std::stoul(argument.value), output))
+            {
+                std::cerr << "No such job: " << argument.value << std::endl;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Usage: wait [<job_id> ...]" << std::endl;
+        }
+    }
+}
+
+void FgCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
+{
+    if (arguments.size() > 1)
+    {
+        std::cerr << "Usage: fg [<job_id>]" << std::endl;
+        return;
+    }
+
+    try
+    {
+        size_t id = arguments.empty() ? 0 : std::stoul(arguments[0].value);
+
+        if (!Jobs::foreground(id, output))
+        {
+            std::cerr << "No such job" << std::endl;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Usage: fg [<job_id>]" << std::endl;
+    }
+}
+
+void BenchCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
+{
+    size_t runs = 10;
+    size_t warmup = 1;
+    std::vector<std::string> commandLines;
+
+    if (!parseArguments(arguments, runs, warmup, commandLines))
+    {
+        std::cerr << "Usage: bench [-n <runs>] [-w <warmup_runs>] <command_line> [vs <command_line>]" << std::endl;
+        return;
+    }
+
+    std::vector<Summary> summaries;
+    std::vector<Counters::Sample> counters(commandLines.size());
+    for (size_t i = 0; i < commandLines.size(); ++i)
+    {
+        summaries.push_back(summarize(measure(commandLines[i], runs, warmup, counters[i])));
+    }
+
+    output << runs << " runs after " << warmup << " warmup runs, counters from " << counters[0].source << '\n';
+
+    // Wide enough for the names of the counters
+    constexpr int labelWidth = 18;
+
+    // One column per command line
+    size_t width = 14;
+    for (const auto &commandLine : commandLines)
+    {
+        width = std::max(width, commandLine.size() + 2);
+    }
+
+    output << std::setw(labelWidth) << "";
+    for (const auto &commandLine : commandLines)
+    {
+        output << std::setw(width) << commandLine;
+    }
+    output << '\n';
+
+    const std::pair<const char *, double Summary::*> rows[] = {
+        {"min", &Summary::min},
+        {"mean", &Summary::mean},
+        {"median", &Summary::median},
+        {"p95", &Summary::p95},
+        {"p99", &Summary::p99},
+        {"stddev", &Summary::stddev},
+    };
+
+    for (const auto &row : rows)
+    {
+        output << std::left << std::setw(labelWidth) << row.first << std::right;
+        for (const auto &summary : summaries)
+        {
+            output << std::setw(width) << Metrics::formatDuration(summary.*row.second);
+        }
+        output << '\n';
+    }
+
+    std::ostringstream value;
+    value << std::fixed << std::setprecision(1);
+
+    output << std::left << std::setw(labelWidth) << "runs/s" << std::right;
+    for (const auto &summary : summaries)
+    {
+        value.str("");
+        value << summary.throughput;
+        output << std::setw(width) << value.str();
+    }
+    output << '\n';
+
+    // Mean time of each command line compared to the first one
+    if (summaries.size() > 1)
+    {
+        value << std::defaultfloat << std::setprecision(3);
+
+        output << std::left << std::setw(labelWidth) << "relative" << std::right;
+        for (const auto &summary : summaries)
+        {
+            value.str("");
+            value << summary.mean / summaries[0].mean << "x";
+            output << std::setw(width) << value.str();
+        }
+        output << '\n';
+    }
+
+    // Counters divided by the number of runs, only the ones the system could read
+    for (int event = 0; event < Counters::EVENT_COUNT; ++event)
+    {
+        if (!counters[0].available[event])
+        {
+            continue;
+        }
+
+        output << std::left << std::setw(labelWidth) << Counters::eventName(static_cast<Counters::Event>(event)) << std::right;
+        for (const auto &sample : counters)
+        {
+            value.str("");
+            value << std::fixed << std::setprecision(1) << static_cast<double>(sample.values[event]) / runs;
+            output << std::setw(width) << value.str();
+        }
+        output << '\n';
+    }
+
+    if (counters[0].available[Counters::CYCLES] && counters[0].available[Counters::INSTRUCTIONS])
+    {
+        output << std::left << std::setw(labelWidth) << "IPC" << std::right;
+        for (const auto &sample : counters)
+        {
+            value.str("");
+            value << std::fixed << std::setprecision(2)
+                  << (sample.values[Counters::CYCLES] > 0 ? static_cast<double>(sample.values[Counters::INSTRUCTIONS]) / sample.values[Counters::CYCLES] : 0);
+            output << std::setw(width) << value.str();
+        }
+        output << '\n';
+    }
+}
+
+bool BenchCommand::parseArguments(const std::vector<Token> &arguments, size_t &runs, size_t &warmup, std::vector<std::string> &commandLines)
+{
+    size_t i = 0;
+
+    try
+    {
+        for (; i + 1 < arguments.size(); i += 2)
+        {
+            if (arguments[i].value == "-n")
+            {
+                runs = std::stoul(arguments[i + 1].value);
+            }
+            else if (arguments[i].value == "-w")
+            {
+                warmup = std::stoul(arguments[i + 1].value);
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        return false;
+    }
+
+    // The remaining arguments are the command lines, separated by "vs"
+    std::vector<std::vector<std::string>> groups(1);
+    for (; i < arguments.size(); ++i)
+    {
+        if (arguments[i].value == "vs")
+        {
+            groups.emplace_back();
+        }
+        else
+        {
+            groups.back().push_back(arguments[i].value);
+        }
+    }
+
+    for (const auto &group : groups)
+    {
+        // A single (usually quoted) argument is a whole command line, several ones are joined
+        // and the quotes of an argument with spaces are put back
+        std::string commandLine = group.size() == 1 ? group[0] : "";
+
+        for (size_t j = 0; group.size() > 1 && j < group.size(); ++j)
+        {
+            bool quoted = group[j].find_first_of(" \t") != std::string::npos;
+
+            commandLine += j > 0 ? " " : "";
+            commandLine += quoted ? "\"" + group[j] + "\"" : group[j];
+        }
+
+        commandLines.push_back(commandLine);
+    }
+
+    return runs > 0 && std::none_of(commandLines.begin(), commandLines.end(), [](const std::string &commandLine)
+                                    { return commandLine.empty(); });
+}
+
+std::vector<double> BenchCommand::measure(const std::string &commandLine, size_t runs, size_t warmup, Counters::Sample &counters)
+{
+    // The command lines run in a session of their own, so "exetime" can't print inside the measure
+    Shell::Session session{*commandRegistry};
+
+    Output::NullSink sink;
+    std::ostream discarded(&sink);
+
+    std::vector<double> samples;
+    samples.reserve(runs);
+
+    // Counted over the measured runs only
+    Counters::Group group;
+
+    for (size_t i = 0; i < warmup + runs; ++i)
+    {
+        std::istringstream noInput;
+
+        if (i == warmup)
+        {
+            group.start();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Shell::executeLine(session, commandLine, noInput, discarded);
+        auto end = std::chrono::steady_clock::now();
+
+        if (i >= warmup)
+        {
+            samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+    }
+
+    counters = group.stop();
+    return samples;
+}
+
+BenchCommand::Summary BenchCommand::summarize(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+
+    size_t count = samples.size();
+    double total = 0;
+    for (double sample : samples)
+    {
+        total += sample;
+    }
+
+    // Nearest rank percentile
+    auto percentile = [&samples, count](double fraction)
+    {
+        size_t rank = static_cast<size_t>(std::ceil(fraction * count));
+        return samples[rank > 0 ? rank - 1 : 0];
+    };
+
+    Summary summary;
+    summary.min = samples.front();
+    summary.mean = total / count;
+    summary.median = count % 2 == 1 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    summary.p95 = percentile(0.95);
+    summary.p99 = percentile(0.99);
+
+    double squares = 0;
+    for (double sample : samples)
+    {
+        squares += (sample - summary.mean) * (sample - summary.mean);
+    }
+    summary.stddev = count > 1 ? std::sqrt(squares / (count - 1)) : 0;
+    summary.throughput = total > 0 ? count / (total / 1e9) : 0;
+
+    return summary;
+}
+
+void StatsCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &output)
+{
+    std::string format = arguments.empty() ? "table" : arguments[0].value;
+
+    if (format == "reset" && arguments.size() == 1)
+    {
+        Metrics::reset();
+        return;
+    }
+
+    if ((format != "table" && format != "json" && format != "prometheus") || arguments.size() > 2)
+    {
+        std::cerr << "Usage: stats [table | json | prometheus] [<file_path>] | stats reset" << std::endl;
+        return;
+    }
+
+    std::vector<Metrics::Snapshot> snapshots = Metrics::snapshot();
+
+    auto write = [&](std::ostream &stream)
+    {
+        if (format == "json")
+        {
+            Metrics::writeJson(snapshots, stream);
+        }
+        else if (format == "prometheus")
+        {
+            Metrics::writePrometheus(snapshots, stream);
+        }
+        else
+        {
+            Metrics::writeTable(snapshots, stream);
+        }
+    };
+
+    if (arguments.size() < 2)
+    {
+        write(output);
+        return;
+    }
+
+    // Written next to the destination then renamed, so a collector never reads a partial file
+    std::string filePath = arguments[1].value;
+    std::string temporaryPath = filePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cerr << "Error opening file: " << temporaryPath << std::endl;
+            return;
+        }
+        write(file);
+        if (!file.flush())
+        {
+            std::cerr << "Error writing to file: " << temporaryPath << std::endl;
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, filePath, error);
+    if (error)
+    {
+        std::cerr << "Error writing to file: " << filePath << std::endl;
+    }
+}
+
+void TraceCommand::execute(const std::vector<Token> &arguments, std::istream &, std::ostream &)
+{
+    if (arguments.size() == 2 && arguments[0].value == "on")
+    {
+        if (!Trace::start(arguments[1].value))
+        {
+            std::cerr << "Error opening file: " << arguments[1].value << std::endl;
+        }
+    }
+    else if (arguments.size() == 1 && arguments[0].value == "off")
+    {
+        Trace::stop();
+    }
+    else
+    {
+        std::cerr << "Usage: trace on <file_path> | trace off" << std::endl;
+    }
+}
+
+void ProfileCommand::execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
+{
+    if (arguments.empty() || arguments.size() > 2)
+    {
+        std::cerr << "Usage: profile <file_path.shl> [<folded_stacks_file_path>]" << std::endl;
+        return;
+    }
+
+    Script::Program program;
+    if (!Script::compile(arguments[0].value, *commandRegistry, program))
+    {
+        return;
+    }
+
+    Script::Profile profile(program);
+    Script::run(program, input, output, &profile);
+
+    output << '\n';
+    profile.writeSummary(output);
+
+    if (arguments.size() == 2)
+    {
+        std::ofstream folded(arguments[1].value, std::ios::binary | std::ios::trunc);
+        if (!folded)
+        {
+            std::cerr << "Error opening file: " << arguments[1].value << std::endl;
+            return;
+        }
+
+        profile.writeFolded(folded);
+        if (!folded.flush())
+        {
+            std::cerr << "Error writing to file: " << arguments[1].value << std::endl;
+        }
+    }
+}
+
+void CacheCommand::execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
+{
+    if (arguments.empty() || arguments[0].value == "cache")
+    {
+        std::cerr << "Usage: cache <command> [<arguments>] | cache clear" << std::endl;
+        return;
+    }
+
+    if (arguments.size() == 1 && arguments[0].value == "clear")
+    {
+        size_t removed = Cache::clear();
+        output << "Removed " << removed << " cached result" << (removed == 1 ? "" : "s") << " from " << Cache::directory() << '\n';
+        return;
+    }
+
+    const std::string &name = arguments[0].value;
+    Command *command = commandRegistry->getCommand(name);
+    if (command == nullptr)
+    {
+        std::cerr << "Only built-in commands can be cached: " << name << std::endl;
+        return;
+    }
+
+    std::vector<Token> commandArguments(arguments.begin() + 1, arguments.end());
+    Metrics::executeCommand(name, *command, commandArguments, input, output, true);
+}
@@ -5,9 +5,13 @@
 #include <condition_variable>
 #include <atomic>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <filesystem>
 
+#include "copy.h"
+#include "counters.h"
+#include "process.h"
 #include "tokenizer.h"
 #include "utils.h"
 
@@ -15,29 +19,41 @@ using namespace Tokenizer;
 using namespace Utils;
 using namespace fs;
 
-namespace Exe
-{
-    void executeCommand(const std::wstring &command);
-}
+class CommandRegistry;
 
 class Command
 {
 public:
-    virtual void execute(const std::vector<Token> &arguments) = 0;
+    virtual void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) = 0;
+
+    // Files the output depends on, besides the arguments ; a command whose output only depends on them and on these
+    // files returns true, its results are then replayed from the cache while the files don't change
+    virtual bool cacheInputs(const std::vector<Token> &, std::vector<std::string> &) const
+    {
+        return false;
+    }
+
     // Add other common functions or data members if needed
     virtual ~Command() {}
+
+protected:
+    // Registry which created the command, the one of the session running it : a command running other commands
+    // (bench, profile, cache) runs the instances of this registry, not ones of its own
+    const CommandRegistry *commandRegistry = nullptr;
+
+    friend class CommandRegistry;
 };
 
 class EchoCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 };
 
 class CdCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
     void changeDirectory(const std::string &newDir);
@@ -46,13 +62,13 @@ private:
 class AssocCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 };
 
 class ClsCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
     void clearScreen();
@@ -61,7 +77,7 @@ private:
 class CmdCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
 #ifdef _WIN32
@@ -74,7 +90,7 @@ private:
 class ColorCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
     void changeTextColor(const std::string &color);
@@ -84,31 +100,33 @@ private:
 class CompCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    void compFile(const std::string &filePath1, const std::string &filePath2);
+    void compFile(const std::string &filePath1, const std::string &filePath2, std::ostream &output);
 };
 
 class CopyCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    void copyFile(const std::string &sourcePath, const std::string &destinationPath);
-    void copyFiles(const std::vector<std::string> &sourcePaths, const std::string &destinationDir);
-    void copyDirectory(const std::string &sourceDir, const std::string &destinationDir);
+    void copyPaths(const std::vector<std::string> &sourcePaths, std::string destinationPath, const Copy::Options &options, std::ostream &output);
+    void copyWithProgress(const std::vector<std::string> &sourcePaths, const std::string &destinationPath, Copy::Options options, std::ostream &output);
+    Copy::Result copyFile(const std::string &sourcePath, const std::string &destinationPath, const Copy::Options &options, std::ostream &output);
+    void copyFiles(const std::vector<std::string> &sourcePaths, const std::string &destinationDir, const Copy::Options &options, std::ostream &output);
+    void copyDirectory(const std::string &sourceDir, const std::string &destinationDir, const Copy::Options &options, std::ostream &output);
 };
 
 class TimeCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
     bool keyPressed();
-    void displayTime(std::string currentTime);
+    void displayTime(std::string currentTime, std::ostream &output);
     std::time_t convertToTimeT(const std::string &timeString);
     std::string formatElapsedTime(double elapsedSeconds);
 };
@@ -116,71 +134,77 @@ private:
 class TimerCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    void display_timer(std::chrono::seconds duration);
+    void display_timer(std::chrono::seconds duration, std::ostream &output);
 };
 
 class LsofCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
+#ifdef _WIN32
 private:
-    void listOpenFiles(DWORD processId);
+    void listOpenFiles(DWORD processId, std::ostream &output);
+#endif
 };
 
 class MemadrsCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
+#ifdef _WIN32
 private:
-    void extractMemoryAddresses(DWORD processId, const std::string &outputFilePath);
+    void extractMemoryAddresses(DWORD processId, const std::string &outputFilePath, std::ostream &output);
     HMODULE GetProcessModuleHandle(DWORD processId);
+#endif
 };
 
 class RmaCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
+#ifdef _WIN32
 private:
-    void readMemoryAddresses(DWORD processId, std::string &memoryType, uintptr_t &memoryAddress);
-    void VerifyMemoryAccess(HANDLE hProcess, LPVOID address);
+    void readMemoryAddresses(DWORD processId, std::string &memoryType, uintptr_t &memoryAddress, std::ostream &output);
+    void VerifyMemoryAccess(HANDLE hProcess, LPVOID address, std::ostream &output);
 
     bool CheckMemoryProtection(HANDLE hProcess, uintptr_t address);
     bool CheckAddressAlignment(uintptr_t address, size_t dataSize);
     bool IsMemoryAddressValid(HANDLE hProcess, uintptr_t address);
+#endif
 };
 
 class HexdumpCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    void hexdumpC(const std::string &filePath);                                  // CLI version : Display the hexadecimal representation in the console
-    void hexdumpF(const std::string &filePath, const std::string &saveFilePath); // File version : Save the hexadecimal representation in a file
+    void hexdumpC(const std::string &filePath, std::istream &input, std::ostream &output);                                  // CLI version : Display the hexadecimal representation in the console
+    void hexdumpF(const std::string &filePath, const std::string &saveFilePath, std::istream &input); // File version : Save the hexadecimal representation in a file
 };
 
 class ExtractstrCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    void extractStrings(const std::string &filePath, const std::string &saveFilePath);
+    void extractStrings(const std::string &filePath, const std::string &saveFilePath, std::istream &input, std::ostream &output);
 };
 
 class XmlCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    void processFolder(const std::string &folderPath, const std::string &paramName, const std::string &newValue);
+    void processFolder(const std::string &folderPath, const std::string &paramName, const std::string &newValue, std::ostream &output);
 
     int changeParameterInXML(const std::string &xmlFile, const std::string &paramName, const std::string &newValue);
 };
@@ -188,17 +212,17 @@ private:
 class EncodingCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    void xor_encrypt(const std::string &input_file, const std::string &output_file, const std::string &encryption_key);
-    void xor_decrypt(const std::string &input_file, const std::string &output_file, const std::string &decryption_key);
+    void xor_encrypt(const std::string &input_file, const std::string &output_file, const std::string &encryption_key, std::ostream &output);
+    void xor_decrypt(const std::string &input_file, const std::string &output_file, const std::string &decryption_key, std::ostream &output);
 };
 
 class PasswordCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
     std::string generatePassword(int length);
@@ -207,7 +231,7 @@ private:
 class QuicksearchCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
     std::vector<std::wstring> searchFile(const std::wstring &directory, const std::wstring &fileName, std::vector<std::wstring> &filePaths);
@@ -217,31 +241,31 @@ private:
 class MemstatsCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    std::string formatMemory(ULONGLONG bytes);
+    std::string formatMemory(unsigned long long bytes);
 };
 
 class CalculatorCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    double calculate(std::string expression);
+    double calculate(std::string expression, std::ostream &output);
 };
 
 class KillCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 };
 
 class RandomCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
     std::string generateRandomNumber(int length);
@@ -251,18 +275,20 @@ private:
 class EnvvarCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
-    void setEnvVar(const std::string &name, const std::string &value);
-    void unsetEnvVar(const std::string &name);
-    void getEnvVar(const std::string &name);
+    void setEnvVar(const std::string &name, const std::string &value, std::ostream &output);
+    void unsetEnvVar(const std::string &name, std::ostream &output);
+    void getEnvVar(const std::string &name, std::ostream &output);
+    void exportEnvVar(const std::string &name, std::ostream &output);
 };
 
 class RemCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
+    bool cacheInputs(const std::vector<Token> &arguments, std::vector<std::string> &filePaths) const override;
 
 private:
     int countRegexMatches(const std::string &text, const std::string &pattern);
@@ -271,17 +297,80 @@ private:
 class SchemaCommand : public Command
 {
 public:
-    void execute(const std::vector<Token> &arguments) override;
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
 private:
     // Method for the folder schema
-    size_t functionCallCount;
-    void generateFolderTree(const fs::path &folderPath, int level, bool isLast, size_t totalEntries, size_t currentEntryIndex, bool parentIsLast, size_t lastFolderCount);
+    void generateFolderTree(const fs::path &folderPath, int level, bool isLast, size_t totalEntries, size_t currentEntryIndex, bool parentIsLast, size_t lastFolderCount, std::ostream &output);
+
+    // Method for the dependency schema, the graph is local to each call : the single instance may run on several threads
+    using DependencyGraph = std::unordered_map<std::string, std::unordered_set<std::string>>;
+
+    void parseFile(const std::string &filename, DependencyGraph &dependencyGraph);
+    void dependencyTreeCommand(const std::string &entryFile, std::ostream &output);
+    void generateDependencyTree(const std::string &file, int depth, DependencyGraph &dependencyGraph, std::unordered_set<std::string> &visited, std::ostream &output);
+};
+
+class JobsCommand : public Command
+{
+public:
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
+};
+
+class WaitCommand : public Command
+{
+public:
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
+};
+
+class FgCommand : public Command
+{
+public:
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
+};
+
+class BenchCommand : public Command
+{
+public:
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
 
-    // Method for the dependency schema
-    std::unordered_map<std::string, std::unordered_set<std::string>> dependencyGraph;
+private:
+    struct Summary
+    {
+        double min;
+        double mean;
+        double median;
+        double p95;
+        double p99;
+        double stddev;
+        double throughput; // Runs per second
+    };
+
+    bool parseArguments(const std::vector<Token> &arguments, size_t &runs, size_t &warmup, std::vector<std::string> &commandLines);
+    std::vector<double> measure(const std::string &commandLine, size_t runs, size_t warmup, Counters::Sample &counters);
+    Summary summarize(std::vector<double> samples);
+};
+
+class StatsCommand : public Command
+{
+public:
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
+};
 
-    void parseFile(const std::string &filename);
-    void dependencyTreeCommand(const std::string &entryFile);
-    void generateDependencyTree(const std::string &file, int depth, std::unordered_set<std::string> &visited);
-};
\ No newline at end of file
+class TraceCommand : public Command
+{
+public:
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
+};
+
+class ProfileCommand : public Command
+{
+public:
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
+};
+
+class CacheCommand : public Command
+{
+public:
+    void execute(const std::vector<Token> &arguments, std::istream &input, std::ostream &output) override;
+};
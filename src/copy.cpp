@@ -0,0 +1,1499 @@
+#include "copy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && !defined(_WIN32)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
+#include "utils.h"
+
+namespace
+{
+    void advance(Copy::Progress *progress, uint64_t bytes)
+    {
+        if (progress != nullptr)
+        {
+            progress->done.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+#ifdef _WIN32
+    // Progress of CopyFileExW, which tells the bytes transferred since the start of the copy
+    struct SystemCopy
+    {
+        Copy::Progress *progress;
+        uint64_t transferred = 0;
+    };
+
+    DWORD CALLBACK systemCopyProgress(LARGE_INTEGER, LARGE_INTEGER transferred, LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID data)
+    {
+        SystemCopy *copy = static_cast<SystemCopy *>(data);
+        advance(copy->progress, static_cast<uint64_t>(transferred.QuadPart) - copy->transferred);
+        copy->transferred = static_cast<uint64_t>(transferred.QuadPart);
+        return PROGRESS_CONTINUE;
+    }
+#else
+    // Buffer of the streaming copy, the whole memory a copy uses whatever the size of the file
+    constexpr size_t streamBufferSize = 1024 * 1024;
+    constexpr size_t streamProbeSize = 64 * 1024;
+
+    class Descriptor
+    {
+    public:
+        explicit Descriptor(int descriptor) : descriptor(descriptor) {}
+
+        ~Descriptor()
+        {
+            if (descriptor >= 0)
+            {
+                close(descriptor);
+            }
+        }
+
+        Descriptor(const Descriptor &) = delete;
+        Descriptor &operator=(const Descriptor &) = delete;
+
+        operator int() const
+        {
+            return descriptor;
+        }
+
+    private:
+        int descriptor;
+    };
+
+    enum class Outcome
+    {
+        DONE,
+        UNSUPPORTED, // The next method continues from the offset reached
+        FAILED
+    };
+
+    // Positioned read or write, a sequential one on a pipe or a terminal which can't seek
+    ssize_t transfer(int descriptor, char *data, size_t size, uint64_t offset, bool write)
+    {
+        ssize_t count = write ? pwrite(descriptor, data, size, static_cast<off_t>(offset)) : pread(descriptor, data, size, static_cast<off_t>(offset));
+        if (count < 0 && errno == ESPIPE)
+        {
+            count = write ? ::write(descriptor, data, size) : ::read(descriptor, data, size);
+        }
+        return count;
+    }
+
+    bool writeAt(int descriptor, const char *data, size_t size, uint64_t offset)
+    {
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t count = transfer(descriptor, const_cast<char *>(data) + done, size - done, offset + done, true);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                return false;
+            }
+            done += static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    // Read "size" bytes unless the file ends first
+    ssize_t readAt(int descriptor, char *data, size_t size, uint64_t offset)
+    {
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t count = pread(descriptor, data + done, size - done, static_cast<off_t>(offset + done));
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count < 0)
+            {
+                return -1;
+            }
+            if (count == 0)
+            {
+                break;
+            }
+            done += static_cast<size_t>(count);
+        }
+        return static_cast<ssize_t>(done);
+    }
+
+    // Zeros are only skipped by the block, shorter runs aren't worth a hole
+    constexpr size_t zeroBlockSize = 64 * 1024;
+
+    bool isZero(const char *data, size_t size)
+    {
+        return size == 0 || (data[0] == 0 && std::memcmp(data, data + 1, size - 1) == 0);
+    }
+
+    // O_DIRECT reads and writes whole blocks of the device from aligned buffers, 4 KiB suits every device
+    constexpr size_t directAlignment = 4096;
+
+    // false when the file system doesn't take O_DIRECT (tmpfs...)
+    bool setDirect(int descriptor, bool direct)
+    {
+#ifdef O_DIRECT
+        int flags = fcntl(descriptor, F_GETFL);
+        return flags >= 0 && fcntl(descriptor, F_SETFL, direct ? flags | O_DIRECT : flags & ~O_DIRECT) == 0;
+#else
+        return !direct;
+#endif
+    }
+
+    // Files this large don't stay in the page cache once copied, they would evict what the other programs use
+    constexpr uint64_t uncachedFileSize = 64 * 1024 * 1024;
+
+    // The copied data leaves the page cache by windows : the kernel only drops the pages entirely in a range, and
+    // reads ahead in large pages (folios) which smaller ranges would cut. The source of a complete window is dropped
+    // and the writeback of its destination starts, the destination is dropped once the next window is complete too
+    constexpr uint64_t cacheWindowSize = 8 * 1024 * 1024;
+
+    // A copy of a file, or of a range of it, and what its steps share
+    struct FileCopy
+    {
+        int source = -1;
+        int destination = -1;
+        uint64_t *holes = nullptr; // Blocks of zeros counted there rather than written, nullptr writes them
+        Copy::Progress *progress = nullptr;
+        bool directSource = false;      // Only read by the reader thread of the pipeline
+        bool directDestination = false; // Cleared by the writer to write the end of the file, which isn't a whole block
+        bool dropCache = false;
+
+        uint64_t windowStart = 0; // Copied, still in the page cache
+        uint64_t windowEnd = 0;
+        uint64_t flushingStart = 0; // Being written back
+        uint64_t flushingEnd = 0;
+    };
+
+    void dropFlushed(FileCopy &copy)
+    {
+        if (copy.flushingEnd > copy.flushingStart)
+        {
+            off_t offset = static_cast<off_t>(copy.flushingStart);
+            off_t length = static_cast<off_t>(copy.flushingEnd - copy.flushingStart);
+
+            // Dirty pages can't be dropped
+#if defined(__linux__) && !defined(_WIN32)
+            sync_file_range(copy.destination, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+            fdatasync(copy.destination);
+#endif
+#ifdef POSIX_FADV_DONTNEED
+            posix_fadvise(copy.destination, offset, length, POSIX_FADV_DONTNEED);
+#endif
+        }
+        copy.flushingStart = copy.flushingEnd = 0;
+    }
+
+    void closeWindow(FileCopy &copy)
+    {
+        if (copy.windowEnd > copy.windowStart)
+        {
+            off_t offset = static_cast<off_t>(copy.windowStart);
+            off_t length = static_cast<off_t>(copy.windowEnd - copy.windowStart);
+
+            // The pages of the source were only read, they can go at once
+#ifdef POSIX_FADV_DONTNEED
+            posix_fadvise(copy.source, offset, length, POSIX_FADV_DONTNEED);
+#endif
+#if defined(__linux__) && !defined(_WIN32)
+            sync_file_range(copy.destination, offset, length, SYNC_FILE_RANGE_WRITE);
+#endif
+        }
+        dropFlushed(copy);
+        copy.flushingStart = copy.windowStart;
+        copy.flushingEnd = copy.windowEnd;
+        copy.windowStart = copy.windowEnd;
+    }
+
+    // A range of the source went to the destination, written or left as a hole
+    void copied(FileCopy &copy, uint64_t offset, uint64_t length)
+    {
+        advance(copy.progress, length);
+        if (!copy.dropCache || length == 0)
+        {
+            return;
+        }
+
+        if (offset != copy.windowEnd)
+        {
+            closeWindow(copy);
+            copy.windowStart = offset;
+        }
+        copy.windowEnd = offset + length;
+        if (copy.windowEnd - copy.windowStart >= cacheWindowSize)
+        {
+            closeWindow(copy);
+        }
+    }
+
+    void finishCopy(FileCopy &copy)
+    {
+        if (copy.dropCache)
+        {
+            closeWindow(copy);
+            dropFlushed(copy);
+        }
+    }
+
+    // Write data read from the source at "offset", blocks of zeros are left as holes when the copy counts them
+    bool writeData(FileCopy &copy, const char *data, size_t length, uint64_t offset)
+    {
+        size_t position = 0;
+        while (position < length)
+        {
+            // Consecutive blocks of data are written at once
+            size_t runEnd = position;
+            while (runEnd < length && (copy.holes == nullptr || !isZero(data + runEnd, std::min(zeroBlockSize, length - runEnd))))
+            {
+                runEnd += std::min(copy.holes == nullptr ? length : zeroBlockSize, length - runEnd);
+            }
+
+            if (runEnd > position)
+            {
+                // The end of the file isn't a whole block, it goes through the page cache
+                if (copy.directDestination && (runEnd - position) % directAlignment != 0)
+                {
+                    copy.directDestination = false;
+                    setDirect(copy.destination, false);
+                }
+                if (!writeAt(copy.destination, data + position, runEnd - position, offset + position))
+                {
+                    return false;
+                }
+            }
+
+            if (runEnd < length)
+            {
+                size_t zeros = std::min(zeroBlockSize, length - runEnd);
+                *copy.holes += zeros;
+                runEnd += zeros;
+            }
+            position = runEnd;
+        }
+        return true;
+    }
+
+    // Copy up to "end", UINT64_MAX reads until the end of the source rather than up to its size : it may grow,
+    // or be a special file with no size. With holes counted, the destination already reads zeros from "offset"
+    // to "end" (it was emptied or sized for the copy)
+    Outcome streamCopy(FileCopy &copy, uint64_t end, uint64_t &offset)
+    {
+        // Most calls only find the end of a file the kernel copied : the buffer grows once reads fill it
+        size_t bufferSize = static_cast<size_t>(std::min<uint64_t>(streamProbeSize, end - offset));
+        std::unique_ptr<char[]> buffer(new char[bufferSize]);
+
+        while (offset < end)
+        {
+            ssize_t read = transfer(copy.source, buffer.get(), std::min<uint64_t>(bufferSize, end - offset), offset, false);
+            if (read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (read <= 0)
+            {
+                return read == 0 ? Outcome::DONE : Outcome::FAILED;
+            }
+
+            if (!writeData(copy, buffer.get(), static_cast<size_t>(read), offset))
+            {
+                return Outcome::FAILED;
+            }
+            copied(copy, offset, static_cast<uint64_t>(read));
+            offset += static_cast<uint64_t>(read);
+
+            if (static_cast<size_t>(read) == bufferSize && bufferSize < streamBufferSize && offset < end)
+            {
+                bufferSize = static_cast<size_t>(std::min<uint64_t>(streamBufferSize, end - offset));
+                buffer.reset(new char[bufferSize]);
+            }
+        }
+        return Outcome::DONE;
+    }
+
+    // Buffers of the pipeline, the whole memory it uses : while one is read the others are written or wait
+    constexpr size_t pipelineBufferSize = 1024 * 1024;
+    constexpr size_t pipelineBufferCount = 4;
+
+    // Below this the reader thread costs more than it saves
+    constexpr uint64_t pipelineMinimumSize = 2 * pipelineBufferSize;
+
+    struct AlignedDelete
+    {
+        void operator()(char *data) const
+        {
+            ::operator delete(data, std::align_val_t(directAlignment));
+        }
+    };
+
+    // Read a block of the pipeline, shorter where the source ends. O_DIRECT reads whole blocks : the length is
+    // rounded up, the file ends before or the bytes past "length" are ignored
+    ssize_t readBlock(const FileCopy &copy, char *data, size_t length, uint64_t offset)
+    {
+        if (!copy.directSource)
+        {
+            return readAt(copy.source, data, length, offset);
+        }
+
+        size_t aligned = (length + directAlignment - 1) / directAlignment * directAlignment;
+        ssize_t read;
+        do
+        {
+            read = pread(copy.source, data, aligned, static_cast<off_t>(offset));
+        } while (read < 0 && errno == EINTR);
+        return std::min<ssize_t>(read, static_cast<ssize_t>(length));
+    }
+
+    // Copy from "offset" to "end" of a regular source : a thread reads the next blocks while the calling thread
+    // writes the previous ones, both only wait when the buffers are all full or all empty
+    class Pipeline
+    {
+    public:
+        explicit Pipeline(FileCopy &copy)
+            : copy(copy), memory(static_cast<char *>(::operator new(pipelineBufferCount * pipelineBufferSize, std::align_val_t(directAlignment))))
+        {
+        }
+
+        Outcome run(uint64_t end, uint64_t &offset)
+        {
+            emptyBuffers.clear();
+            fullBuffers.clear();
+            for (size_t i = 0; i < pipelineBufferCount; ++i)
+            {
+                emptyBuffers.push_back(memory.get() + i * pipelineBufferSize);
+            }
+            readDone = writeFailed = false;
+            readError = 0;
+
+            std::thread reader(&Pipeline::read, this, offset, end);
+            int writeError = write(offset);
+            reader.join();
+
+            if (writeError != 0 || readError != 0)
+            {
+                errno = writeError != 0 ? writeError : readError;
+                return Outcome::FAILED;
+            }
+            return Outcome::DONE;
+        }
+
+    private:
+        struct Block
+        {
+            char *data = nullptr;
+            uint64_t offset = 0;
+            size_t length = 0;
+        };
+
+        void read(uint64_t position, uint64_t end)
+        {
+            int error = 0;
+
+            while (position < end)
+            {
+                char *data = nullptr;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [this]
+                                 { return !emptyBuffers.empty() || writeFailed; });
+                    if (writeFailed)
+                    {
+                        break;
+                    }
+                    data = emptyBuffers.back();
+                    emptyBuffers.pop_back();
+                }
+
+                size_t length = static_cast<size_t>(std::min<uint64_t>(pipelineBufferSize, end - position));
+                ssize_t count = readBlock(copy, data, length, position);
+                if (count <= 0)
+                {
+                    error = count < 0 ? errno : 0;
+                    break;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    fullBuffers.push_back({data, position, static_cast<size_t>(count)});
+                }
+                changed.notify_all();
+
+                position += static_cast<uint64_t>(count);
+                if (static_cast<size_t>(count) < length)
+                {
+                    break; // The source got shorter
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            readDone = true;
+            readError = error;
+            changed.notify_all();
+        }
+
+        // The offset reached moves with each block written, the error of the write which failed
+        int write(uint64_t &offset)
+        {
+            while (true)
+            {
+                Block block;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [this]
+                                 { return !fullBuffers.empty() || readDone; });
+                    if (fullBuffers.empty())
+                    {
+                        return 0;
+                    }
+                    block = fullBuffers.front();
+                    fullBuffers.pop_front();
+                }
+
+                bool written = writeData(copy, block.data, block.length, block.offset);
+                int error = written ? 0 : errno;
+                if (written)
+                {
+                    copied(copy, block.offset, block.length);
+                    offset = block.offset + block.length;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    emptyBuffers.push_back(block.data);
+                    writeFailed = !written;
+                }
+                changed.notify_all();
+
+                if (!written)
+                {
+                    return error;
+                }
+            }
+        }
+
+        FileCopy &copy;
+        std::unique_ptr<char, AlignedDelete> memory;
+        std::vector<char *> emptyBuffers;
+        std::deque<Block> fullBuffers;
+        bool readDone = false;
+        bool writeFailed = false;
+        int readError = 0;
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+
+    // Copy through memory what the kernel didn't copy itself
+    Outcome bufferedCopy(FileCopy &copy, uint64_t end, uint64_t &offset, Copy::Method &method)
+    {
+        bool direct = copy.directSource || copy.directDestination;
+        if (!direct && end - offset < pipelineMinimumSize)
+        {
+            method = Copy::Method::STREAM;
+            return streamCopy(copy, end, offset);
+        }
+
+        Pipeline pipeline(copy);
+        Outcome outcome = pipeline.run(end, offset);
+        if (outcome == Outcome::FAILED && errno == EINVAL && direct)
+        {
+            // The file system took O_DIRECT but not these reads or writes, the page cache it is
+            copy.directSource = copy.directDestination = false;
+            setDirect(copy.source, false);
+            setDirect(copy.destination, false);
+            direct = false;
+            outcome = pipeline.run(end, offset);
+        }
+
+        method = direct ? Copy::Method::DIRECT : Copy::Method::PIPELINE;
+        return outcome;
+    }
+
+#if defined(__linux__) && !defined(_WIN32)
+    // Each call copies at most this much, so a signal never waits for a whole large file
+    constexpr size_t kernelChunkSize = 64 * 1024 * 1024;
+
+    // The file systems or the kernel can't copy these files this way
+    bool unsupported(int error)
+    {
+        return error == EXDEV || error == EINVAL || error == ENOSYS || error == EOPNOTSUPP || error == ENOTTY || error == EBADF;
+    }
+
+    Outcome cloneCopy(FileCopy &copy, uint64_t end, uint64_t &offset)
+    {
+        if (ioctl(copy.destination, FICLONE, copy.source) != 0)
+        {
+            return unsupported(errno) || errno == EPERM ? Outcome::UNSUPPORTED : Outcome::FAILED;
+        }
+
+        // Nothing went through the page cache
+        advance(copy.progress, end - offset);
+        offset = end;
+        return Outcome::DONE;
+    }
+
+    Outcome copyFileRange(FileCopy &copy, uint64_t end, uint64_t &offset)
+    {
+        while (offset < end)
+        {
+            loff_t sourceOffset = static_cast<loff_t>(offset);
+            loff_t destinationOffset = static_cast<loff_t>(offset);
+
+            ssize_t copiedBytes = copy_file_range(copy.source, &sourceOffset, copy.destination, &destinationOffset, std::min<uint64_t>(end - offset, kernelChunkSize), 0);
+            if (copiedBytes < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (copiedBytes < 0)
+            {
+                return unsupported(errno) ? Outcome::UNSUPPORTED : Outcome::FAILED;
+            }
+            if (copiedBytes == 0)
+            {
+                break; // The source got shorter, the streaming copy tells where it ends now
+            }
+            copied(copy, offset, static_cast<uint64_t>(copiedBytes));
+            offset += static_cast<uint64_t>(copiedBytes);
+        }
+        return Outcome::DONE;
+    }
+
+    Outcome sendFile(FileCopy &copy, uint64_t end, uint64_t &offset)
+    {
+        // sendfile writes at the position of the destination, a pipe has none
+        if (lseek(copy.destination, static_cast<off_t>(offset), SEEK_SET) < 0 && errno != ESPIPE)
+        {
+            return Outcome::FAILED;
+        }
+
+        while (offset < end)
+        {
+            off_t sourceOffset = static_cast<off_t>(offset);
+
+            ssize_t copiedBytes = sendfile(copy.destination, copy.source, &sourceOffset, std::min<uint64_t>(end - offset, kernelChunkSize));
+            if (copiedBytes < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (copiedBytes < 0)
+            {
+                return unsupported(errno) ? Outcome::UNSUPPORTED : Outcome::FAILED;
+            }
+            if (copiedBytes == 0)
+            {
+                break;
+            }
+            copied(copy, offset, static_cast<uint64_t>(copiedBytes));
+            offset += static_cast<uint64_t>(copiedBytes);
+        }
+        return Outcome::DONE;
+    }
+#endif
+
+    // Fewer blocks allocated than the size needs : the file has holes
+    bool isSparse(const struct stat &status)
+    {
+        return S_ISREG(status.st_mode) && static_cast<uint64_t>(status.st_blocks) * 512 < static_cast<uint64_t>(status.st_size);
+    }
+
+    // Only copy the data extents of the source up to "end", the holes between them stay holes in the destination,
+    // which reads zeros there already. "method" tells how the extents were copied
+    Outcome sparseCopy(FileCopy &copy, uint64_t end, uint64_t &offset, Copy::Method &method)
+    {
+#ifdef SEEK_DATA
+        while (offset < end)
+        {
+            off_t data = lseek(copy.source, static_cast<off_t>(offset), SEEK_DATA);
+            if (data < 0 && errno == ENXIO)
+            {
+                // A hole up to the end of the file
+                *copy.holes += end - offset;
+                advance(copy.progress, end - offset);
+                offset = end;
+                break;
+            }
+            off_t hole = data < 0 ? -1 : lseek(copy.source, data, SEEK_HOLE);
+            if (data < 0 || hole < 0)
+            {
+                return errno == EINVAL || errno == ENOTSUP ? Outcome::UNSUPPORTED : Outcome::FAILED;
+            }
+
+            uint64_t extentEnd = std::min(static_cast<uint64_t>(hole), end);
+            if (static_cast<uint64_t>(data) >= extentEnd)
+            {
+                *copy.holes += end - offset;
+                advance(copy.progress, end - offset);
+                offset = end;
+                break;
+            }
+
+            *copy.holes += static_cast<uint64_t>(data) - offset;
+            advance(copy.progress, static_cast<uint64_t>(data) - offset);
+            offset = static_cast<uint64_t>(data);
+
+            Outcome outcome = Outcome::UNSUPPORTED;
+#if defined(__linux__) && !defined(_WIN32)
+            if (!copy.directSource && !copy.directDestination)
+            {
+                outcome = copyFileRange(copy, extentEnd, offset);
+                method = Copy::Method::COPY_FILE_RANGE;
+            }
+#endif
+            if (outcome == Outcome::UNSUPPORTED)
+            {
+                outcome = bufferedCopy(copy, extentEnd, offset, method);
+            }
+            if (outcome == Outcome::FAILED)
+            {
+                return outcome;
+            }
+            if (offset < extentEnd)
+            {
+                break; // The source got shorter
+            }
+        }
+        return Outcome::DONE;
+#else
+        return Outcome::UNSUPPORTED;
+#endif
+    }
+
+    // Open the source and create or empty the destination, with the permissions of the source
+    bool openFiles(const std::string &sourcePath, const std::string &destinationPath, int &source, int &destination, struct stat &sourceStatus,
+                   struct stat &destinationStatus, std::string &error)
+    {
+        source = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (source < 0 || fstat(source, &sourceStatus) != 0)
+        {
+            error = "Error opening source file: " + sourcePath;
+            return false;
+        }
+        if (S_ISDIR(sourceStatus.st_mode))
+        {
+            error = "Error opening source file: " + sourcePath + " is a directory";
+            return false;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        // A larger read-ahead
+        posix_fadvise(source, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        // Not truncated before it is known to be another file, copying a file onto itself would empty it
+        destination = open(destinationPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, sourceStatus.st_mode & 07777);
+        if (destination < 0 || fstat(destination, &destinationStatus) != 0)
+        {
+            error = "Error opening destination file: " + destinationPath;
+            return false;
+        }
+        if (sourceStatus.st_dev == destinationStatus.st_dev && sourceStatus.st_ino == destinationStatus.st_ino)
+        {
+            error = "Error copying " + sourcePath + ": the source and the destination are the same file";
+            return false;
+        }
+        if (S_ISREG(destinationStatus.st_mode) && ftruncate(destination, 0) != 0)
+        {
+            error = "Error writing to destination file: " + destinationPath;
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    bool copyWholeFile(const std::string &sourcePath, const std::string &destinationPath, const Copy::Options &options, Copy::Result &result, std::string &error)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+#ifdef _WIN32
+        // Unbuffered, CopyFileExW goes around the file cache
+        SystemCopy systemCopy{options.progress};
+        if (!CopyFileExW(Utils::stringToWstring(sourcePath).c_str(), Utils::stringToWstring(destinationPath).c_str(), options.progress != nullptr ? systemCopyProgress : nullptr,
+                         &systemCopy, nullptr, options.direct ? COPY_FILE_NO_BUFFERING : 0))
+        {
+            error = "Error copying " + sourcePath + " to " + destinationPath + ": error " + std::to_string(GetLastError());
+            return false;
+        }
+
+        std::error_code sizeError;
+        result.method = Copy::Method::SYSTEM;
+        result.bytes = std::filesystem::file_size(destinationPath, sizeError);
+#else
+        int sourceDescriptor = -1;
+        int destinationDescriptor = -1;
+        struct stat sourceStatus;
+        struct stat destinationStatus;
+        bool opened = openFiles(sourcePath, destinationPath, sourceDescriptor, destinationDescriptor, sourceStatus, destinationStatus, error);
+
+        Descriptor source(sourceDescriptor);
+        Descriptor destination(destinationDescriptor);
+        if (!opened)
+        {
+            return false;
+        }
+
+        uint64_t size = S_ISREG(sourceStatus.st_mode) ? static_cast<uint64_t>(sourceStatus.st_size) : 0;
+        uint64_t offset = 0;
+        Outcome outcome = Outcome::UNSUPPORTED;
+
+        // The emptied destination reads zeros anywhere, a pipe or a device has to get every byte
+        bool regular = S_ISREG(destinationStatus.st_mode);
+
+        FileCopy copy;
+        copy.source = source;
+        copy.destination = destination;
+        copy.holes = regular ? &result.holeBytes : nullptr;
+        copy.progress = options.progress;
+        copy.dropCache = S_ISREG(sourceStatus.st_mode) && regular && (size >= uncachedFileSize || options.direct);
+
+#if defined(__linux__) && !defined(_WIN32)
+        // A clone shares the holes too
+        if (size > 0)
+        {
+            outcome = cloneCopy(copy, size, offset);
+            if (outcome == Outcome::DONE)
+            {
+                result.method = Copy::Method::CLONE;
+            }
+        }
+#endif
+
+        if (outcome == Outcome::UNSUPPORTED && options.direct && S_ISREG(sourceStatus.st_mode) && regular)
+        {
+            copy.directSource = setDirect(source, true);
+            copy.directDestination = setDirect(destination, true);
+        }
+
+        if (outcome == Outcome::UNSUPPORTED && regular && isSparse(sourceStatus))
+        {
+            outcome = sparseCopy(copy, size, offset, result.method);
+        }
+
+#if defined(__linux__) && !defined(_WIN32)
+        // From the cheapest to the most general, each one continuing where the previous one stopped.
+        // They go through the page cache, not what O_DIRECT asks for
+        typedef Outcome (*KernelCopy)(FileCopy &, uint64_t, uint64_t &);
+        const std::pair<Copy::Method, KernelCopy> kernelCopies[] = {
+            {Copy::Method::COPY_FILE_RANGE, copyFileRange},
+            {Copy::Method::SENDFILE, sendFile},
+        };
+
+        for (const auto &kernelCopy : kernelCopies)
+        {
+            if (outcome != Outcome::UNSUPPORTED || offset >= size || copy.directSource || copy.directDestination)
+            {
+                break;
+            }
+
+            uint64_t before = offset;
+            outcome = kernelCopy.second(copy, size, offset);
+            if (offset > before)
+            {
+                result.method = kernelCopy.first;
+            }
+        }
+#endif
+
+        if (outcome == Outcome::UNSUPPORTED && offset < size)
+        {
+            outcome = bufferedCopy(copy, size, offset, result.method);
+        }
+
+        // Also reads what was appended to the source during the copy, the method stays the one that copied the rest
+        if (copy.directSource || copy.directDestination)
+        {
+            copy.directSource = copy.directDestination = false;
+            setDirect(source, false);
+            setDirect(destination, false);
+        }
+        if (offset == 0)
+        {
+            result.method = Copy::Method::STREAM;
+        }
+        if (outcome != Outcome::FAILED)
+        {
+            outcome = streamCopy(copy, UINT64_MAX, offset);
+        }
+        finishCopy(copy);
+
+        // Holes at the end aren't written, the size makes them
+        if (outcome != Outcome::FAILED && regular && ftruncate(destination, static_cast<off_t>(offset)) != 0)
+        {
+            outcome = Outcome::FAILED;
+        }
+
+        result.bytes = offset - result.holeBytes;
+        if (outcome == Outcome::FAILED)
+        {
+            error = "Error copying " + sourcePath + " to " + destinationPath + ": " + std::strerror(errno);
+            return false;
+        }
+#endif
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+#ifndef _WIN32
+    // Granularity of an update : a block which differs from the previous copy is written again, whole
+    constexpr size_t compareBlockSize = 64 * 1024;
+
+    // Zeros written over data in place become a hole, false when the file system can't make one
+    bool punchHole(int destination, uint64_t offset, uint64_t length)
+    {
+#if defined(__linux__) && !defined(_WIN32)
+        return fallocate(destination, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(length)) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // The copy gets the modification time of the source, the next update recognizes it as unchanged
+    bool keepModificationTime(int destination, const struct stat &sourceStatus)
+    {
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1] = sourceStatus.st_mtim;
+        return futimens(destination, times) == 0;
+    }
+#endif
+
+    // Copy only what changed since the previous copy : nothing when the destination has the size and the modification
+    // time of the source (unless the contents are compared), else the blocks of the destination which differ from the source
+    bool updateFile(const std::string &sourcePath, const std::string &destinationPath, const Copy::Options &options, Copy::Result &result, std::string &error)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+#ifdef _WIN32
+        // CopyFileExW gives the copy the modification time of the source
+        std::error_code statusError;
+        uint64_t size = std::filesystem::file_size(sourcePath, statusError);
+        if (!options.compare && !statusError && std::filesystem::file_size(destinationPath, statusError) == size && !statusError &&
+            std::filesystem::last_write_time(sourcePath, statusError) == std::filesystem::last_write_time(destinationPath, statusError) && !statusError)
+        {
+            result.unchanged = true;
+            result.skippedBytes = size;
+            advance(options.progress, size);
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+        return copyWholeFile(sourcePath, destinationPath, options, result, error);
+#else
+        struct stat sourceStatus;
+        struct stat destinationStatus;
+        if (stat(sourcePath.c_str(), &sourceStatus) != 0)
+        {
+            error = "Error opening source file: " + sourcePath;
+            return false;
+        }
+
+        // Nothing to compare with
+        if (!S_ISREG(sourceStatus.st_mode) || stat(destinationPath.c_str(), &destinationStatus) != 0 || !S_ISREG(destinationStatus.st_mode))
+        {
+            if (!copyWholeFile(sourcePath, destinationPath, options, result, error))
+            {
+                return false;
+            }
+
+            Descriptor destination(open(destinationPath.c_str(), O_WRONLY | O_CLOEXEC));
+            if (S_ISREG(sourceStatus.st_mode) && (destination < 0 || !keepModificationTime(destination, sourceStatus)))
+            {
+                error = "Error writing to destination file: " + destinationPath;
+                return false;
+            }
+            return true;
+        }
+
+        if (sourceStatus.st_dev == destinationStatus.st_dev && sourceStatus.st_ino == destinationStatus.st_ino)
+        {
+            error = "Error copying " + sourcePath + ": the source and the destination are the same file";
+            return false;
+        }
+
+        uint64_t size = static_cast<uint64_t>(sourceStatus.st_size);
+        if (!options.compare && static_cast<uint64_t>(destinationStatus.st_size) == size && destinationStatus.st_mtim.tv_sec == sourceStatus.st_mtim.tv_sec &&
+            destinationStatus.st_mtim.tv_nsec == sourceStatus.st_mtim.tv_nsec)
+        {
+            result.unchanged = true;
+            result.skippedBytes = size;
+            advance(options.progress, size);
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        Descriptor source(open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC));
+        if (source < 0)
+        {
+            error = "Error opening source file: " + sourcePath;
+            return false;
+        }
+        Descriptor destination(open(destinationPath.c_str(), O_RDWR | O_CLOEXEC));
+        if (destination < 0)
+        {
+            error = "Error opening destination file: " + destinationPath;
+            return false;
+        }
+
+        // Both files are read anyway, comparing the blocks costs less than hashing them
+        std::vector<char> sourceBuffer(streamBufferSize);
+        std::vector<char> destinationBuffer(streamBufferSize);
+        uint64_t offset = 0;
+
+        FileCopy copy;
+        copy.source = source;
+        copy.destination = destination;
+        copy.progress = options.progress;
+        copy.dropCache = size >= uncachedFileSize;
+
+        while (offset < size)
+        {
+            ssize_t read = readAt(source, sourceBuffer.data(), std::min<uint64_t>(sourceBuffer.size(), size - offset), offset);
+            ssize_t existing = read > 0 ? readAt(destination, destinationBuffer.data(), static_cast<size_t>(read), offset) : 0;
+            if (read < 0 || existing < 0)
+            {
+                error = "Error copying " + sourcePath + " to " + destinationPath + ": " + std::strerror(errno);
+                return false;
+            }
+            if (read == 0)
+            {
+                break; // The source got shorter since it was examined
+            }
+
+            for (size_t block = 0; block < static_cast<size_t>(read); block += compareBlockSize)
+            {
+                size_t length = std::min<size_t>(compareBlockSize, static_cast<size_t>(read) - block);
+
+                if (block + length <= static_cast<size_t>(existing) && std::memcmp(sourceBuffer.data() + block, destinationBuffer.data() + block, length) == 0)
+                {
+                    result.skippedBytes += length;
+                }
+                else if (isZero(sourceBuffer.data() + block, length) && (block >= static_cast<size_t>(existing) || punchHole(destination, offset + block, length)))
+                {
+                    // Past the end of the previous copy the size given at the end makes the zeros
+                    result.holeBytes += length;
+                }
+                else if (writeAt(destination, sourceBuffer.data() + block, length, offset + block))
+                {
+                    result.bytes += length;
+                }
+                else
+                {
+                    error = "Error writing to destination file: " + destinationPath + ": " + std::strerror(errno);
+                    return false;
+                }
+            }
+
+            copied(copy, offset, static_cast<uint64_t>(read));
+            offset += static_cast<uint64_t>(read);
+        }
+        finishCopy(copy);
+
+        if ((static_cast<uint64_t>(destinationStatus.st_size) != offset && ftruncate(destination, static_cast<off_t>(offset)) != 0) ||
+            fchmod(destination, sourceStatus.st_mode & 07777) != 0 || !keepModificationTime(destination, sourceStatus))
+        {
+            error = "Error writing to destination file: " + destinationPath;
+            return false;
+        }
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+#endif
+    }
+
+    // Files smaller than this are copied whole, several of them by the same task
+    constexpr uint64_t largeFileSize = 64 * 1024 * 1024;
+    constexpr uint64_t rangeSize = 16 * 1024 * 1024;
+    constexpr size_t batchFiles = 64;
+    constexpr uint64_t batchBytes = 8 * 1024 * 1024;
+
+    // Copy of a tree, the folders are created while it is walked then the files are copied by the workers
+    class TreeCopy
+    {
+    public:
+        TreeCopy(const Copy::Options &options, Copy::TreeResult &result) : options(options), result(result) {}
+
+        bool walk(const std::filesystem::path &sourceRoot, const std::filesystem::path &destinationRoot)
+        {
+            std::error_code error;
+
+            // The folders created while walking would be walked too
+            std::filesystem::path source = std::filesystem::weakly_canonical(sourceRoot, error);
+            std::filesystem::path destination = std::filesystem::weakly_canonical(destinationRoot, error);
+            auto mismatch = std::mismatch(source.begin(), source.end(), destination.begin(), destination.end());
+            if (!error && mismatch.first == source.end())
+            {
+                addError("Error copying " + sourceRoot.string() + ": the destination is inside the copied folder");
+                return false;
+            }
+
+            std::filesystem::create_directories(destinationRoot, error);
+            if (error)
+            {
+                addError("Error creating folder: " + destinationRoot.string());
+                return false;
+            }
+
+            std::filesystem::recursive_directory_iterator entry(sourceRoot, std::filesystem::directory_options::skip_permission_denied, error);
+            if (error)
+            {
+                addError("Error opening folder: " + sourceRoot.string());
+                return false;
+            }
+
+            for (; entry != std::filesystem::recursive_directory_iterator(); entry.increment(error))
+            {
+                if (error)
+                {
+                    addError("Error reading folder: " + entry->path().parent_path().string());
+                    break;
+                }
+
+                std::filesystem::path target = destinationRoot / entry->path().lexically_relative(sourceRoot);
+                std::error_code entryError;
+
+                if (entry->is_symlink(entryError))
+                {
+                    // Recreated rather than followed, a link to a parent folder would never end
+                    std::filesystem::remove(target, entryError);
+                    std::filesystem::copy_symlink(entry->path(), target, entryError);
+                    if (entryError)
+                    {
+                        addError("Error copying link: " + entry->path().string());
+                        continue;
+                    }
+                    ++result.links;
+                }
+                else if (entry->is_directory(entryError))
+                {
+                    std::filesystem::create_directory(target, entry->path(), entryError);
+                    if (entryError)
+                    {
+                        addError("Error creating folder: " + target.string());
+                        entry.disable_recursion_pending();
+                        continue;
+                    }
+                    ++result.directories;
+                }
+                else if (entry->is_regular_file(entryError))
+                {
+                    files.push_back({entry->path().string(), target.string(), entry->file_size(entryError)});
+                    if (options.progress != nullptr)
+                    {
+                        options.progress->total.fetch_add(files.back().size, std::memory_order_relaxed);
+                    }
+                }
+                else
+                {
+                    addError("Skipped " + entry->path().string() + ": not a regular file");
+                }
+            }
+
+            planTasks();
+            return true;
+        }
+
+        void run()
+        {
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < std::min(std::max<size_t>(1, options.workers), tasks.size()); ++i)
+            {
+                threads.emplace_back(&TreeCopy::work, this);
+            }
+
+            work();
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+
+            result.files = copiedFiles.load();
+            result.unchangedFiles = unchangedFiles.load();
+            result.bytes = copiedBytes.load();
+            result.skippedBytes = skippedBytes.load();
+            result.holeBytes = holeBytes.load();
+        }
+
+    private:
+        struct File
+        {
+            std::string source;
+            std::string destination;
+            uint64_t size;
+        };
+
+#ifndef _WIN32
+        // Large file copied in ranges : the first range to start opens it and the last one to end closes it,
+        // so only the files being copied hold descriptors
+        struct SplitFile
+        {
+            size_t file;
+            std::once_flag opened;
+            int source = -1;
+            int destination = -1;
+            bool sparse = false;
+            bool done = false;  // Cloned, or copied whole by the range which opened it
+            std::string failed; // Error of the opening
+            std::atomic<size_t> remaining{0};
+            std::atomic<int> error{0};
+        };
+#endif
+
+        // A batch of whole files, or a range of a split file
+        struct Task
+        {
+            size_t first;
+            size_t count;
+            size_t split = SIZE_MAX;
+            uint64_t offset = 0;
+            uint64_t end = 0;
+        };
+
+        void addError(std::string error)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            result.errors.push_back(std::move(error));
+        }
+
+        void planTasks()
+        {
+#ifndef _WIN32
+            // Ranges first, they are the longest tasks and the small files fill the gaps at the end.
+            // An update compares a large file with its copy as a whole, alone in its batch, and a direct copy
+            // keeps the disk busy with its own pipeline
+            std::vector<bool> split(files.size(), false);
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+                if (files[i].size >= largeFileSize && !options.update && !options.direct)
+                {
+                    split[i] = true;
+                    splitFile(i);
+                }
+            }
+#endif
+
+            Task batch{0, 0};
+            uint64_t bytes = 0;
+
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+#ifndef _WIN32
+                if (split[i])
+                {
+                    continue;
+                }
+#endif
+                if (batch.count == 0)
+                {
+                    batch.first = i;
+                }
+                // Consecutive files of the walk : a batch mostly stays in one folder
+                if (batch.count > 0 && batch.first + batch.count != i)
+                {
+                    tasks.push_back(batch);
+                    batch = Task{i, 0};
+                    bytes = 0;
+                }
+
+                ++batch.count;
+                bytes += files[i].size;
+                if (batch.count == batchFiles || bytes >= batchBytes)
+                {
+                    tasks.push_back(batch);
+                    batch = Task{0, 0};
+                    bytes = 0;
+                }
+            }
+
+            if (batch.count > 0)
+            {
+                tasks.push_back(batch);
+            }
+        }
+
+#ifndef _WIN32
+        void splitFile(size_t index)
+        {
+            uint64_t size = files[index].size;
+            size_t ranges = static_cast<size_t>((size + rangeSize - 1) / rangeSize);
+
+            splits.emplace_back();
+            SplitFile &splitFile = splits.back();
+            splitFile.file = index;
+            splitFile.remaining = ranges;
+
+            for (size_t i = 0; i < ranges; ++i)
+            {
+                Task range{index, 1, splits.size() - 1, i * rangeSize, std::min(size, (i + 1) * rangeSize)};
+                tasks.push_back(range);
+            }
+        }
+
+        // Cloned when the file system can, else sized so the ranges are written in place
+        void openSplitFile(SplitFile &splitFile)
+        {
+            const File &file = files[splitFile.file];
+            struct stat status;
+            struct stat destinationStatus;
+
+            if (!openFiles(file.source, file.destination, splitFile.source, splitFile.destination, status, destinationStatus, splitFile.failed))
+            {
+                return;
+            }
+
+            uint64_t size = static_cast<uint64_t>(status.st_size);
+#if defined(__linux__) && !defined(_WIN32)
+            FileCopy copy;
+            copy.source = splitFile.source;
+            copy.destination = splitFile.destination;
+            copy.progress = options.progress;
+
+            uint64_t offset = 0;
+            if (cloneCopy(copy, size, offset) == Outcome::DONE)
+            {
+                splitFile.done = true;
+                copiedBytes.fetch_add(size);
+                return;
+            }
+#endif
+
+            // The ranges were cut when the tree was walked, a file which changed since is copied whole
+            if (size != file.size)
+            {
+                closeFiles(splitFile.source, splitFile.destination);
+                splitFile.source = splitFile.destination = -1;
+
+                Copy::Result copied;
+                if (copyWholeFile(file.source, file.destination, options, copied, splitFile.failed))
+                {
+                    splitFile.done = true;
+                    copiedBytes.fetch_add(copied.bytes);
+                    holeBytes.fetch_add(copied.holeBytes);
+                }
+                return;
+            }
+
+            // The destination reads zeros until the ranges are written
+            if (ftruncate(splitFile.destination, static_cast<off_t>(size)) != 0)
+            {
+                splitFile.failed = "Error writing to destination file: " + file.destination;
+                return;
+            }
+            splitFile.sparse = isSparse(status);
+        }
+
+        void copyRange(const Task &task)
+        {
+            SplitFile &splitFile = splits[task.split];
+            std::call_once(splitFile.opened, &TreeCopy::openSplitFile, this, std::ref(splitFile));
+
+            if (!splitFile.done && splitFile.failed.empty())
+            {
+                uint64_t offset = task.offset;
+                uint64_t holes = 0;
+                Copy::Method method = Copy::Method::STREAM;
+                Outcome outcome = Outcome::UNSUPPORTED;
+
+                // Split files are all too large to stay in the page cache
+                FileCopy copy;
+                copy.source = splitFile.source;
+                copy.destination = splitFile.destination;
+                copy.holes = &holes;
+                copy.progress = options.progress;
+                copy.dropCache = true;
+
+                if (splitFile.sparse)
+                {
+                    outcome = sparseCopy(copy, task.end, offset, method);
+                }
+#if defined(__linux__) && !defined(_WIN32)
+                if (outcome == Outcome::UNSUPPORTED)
+                {
+                    outcome = copyFileRange(copy, task.end, offset);
+                }
+#endif
+                if (outcome == Outcome::UNSUPPORTED)
+                {
+                    outcome = bufferedCopy(copy, task.end, offset, method);
+                }
+                finishCopy(copy);
+
+                copiedBytes.fetch_add(offset - task.offset - holes);
+                holeBytes.fetch_add(holes);
+                if (outcome == Outcome::FAILED)
+                {
+                    splitFile.error = errno;
+                }
+            }
+
+            if (splitFile.remaining.fetch_sub(1) == 1)
+            {
+                closeFiles(splitFile.source, splitFile.destination);
+
+                const File &file = files[splitFile.file];
+                if (!splitFile.failed.empty())
+                {
+                    addError(splitFile.failed);
+                }
+                else if (splitFile.error != 0)
+                {
+                    addError("Error copying " + file.source + " to " + file.destination + ": " + std::strerror(splitFile.error));
+                }
+                else
+                {
+                    copiedFiles.fetch_add(1);
+                }
+            }
+        }
+
+        static void closeFiles(int source, int destination)
+        {
+            if (source >= 0)
+            {
+                close(source);
+            }
+            if (destination >= 0)
+            {
+                close(destination);
+            }
+        }
+#endif
+
+        void work()
+        {
+            for (size_t index = nextTask.fetch_add(1); index < tasks.size(); index = nextTask.fetch_add(1))
+            {
+                const Task &task = tasks[index];
+#ifndef _WIN32
+                if (task.split != SIZE_MAX)
+                {
+                    copyRange(task);
+                    continue;
+                }
+#endif
+                for (size_t i = task.first; i < task.first + task.count; ++i)
+                {
+                    Copy::Result copied;
+                    std::string error;
+
+                    bool done = options.update ? updateFile(files[i].source, files[i].destination, options, copied, error)
+                                               : copyWholeFile(files[i].source, files[i].destination, options, copied, error);
+                    if (done)
+                    {
+                        (copied.unchanged ? unchangedFiles : copiedFiles).fetch_add(1);
+                        copiedBytes.fetch_add(copied.bytes);
+                        skippedBytes.fetch_add(copied.skippedBytes);
+                        holeBytes.fetch_add(copied.holeBytes);
+                    }
+                    else
+                    {
+                        addError(error);
+                    }
+                }
+            }
+        }
+
+        const Copy::Options &options;
+        Copy::TreeResult &result;
+        std::vector<File> files;
+        std::vector<Task> tasks;
+#ifndef _WIN32
+        std::deque<SplitFile> splits; // Never moved, the workers update them
+#endif
+
+        std::atomic<size_t> nextTask{0};
+        std::atomic<uint64_t> copiedFiles{0};
+        std::atomic<uint64_t> unchangedFiles{0};
+        std::atomic<uint64_t> copiedBytes{0};
+        std::atomic<uint64_t> skippedBytes{0};
+        std::atomic<uint64_t> holeBytes{0};
+        std::mutex errorMutex;
+    };
+}
+
+const char *Copy::methodName(Method method)
+{
+    switch (method)
+    {
+    case Method::CLONE:
+        return "reflink";
+    case Method::COPY_FILE_RANGE:
+        return "copy_file_range";
+    case Method::SENDFILE:
+        return "sendfile";
+    case Method::SYSTEM:
+        return "CopyFileEx";
+    case Method::PIPELINE:
+        return "pipelined stream";
+    case Method::DIRECT:
+        return "direct I/O";
+    default:
+        return "buffered stream";
+    }
+}
+
+bool Copy::copyFile(const std::string &sourcePath, const std::string &destinationPath, const Options &options, Result &result)
+{
+    std::string error;
+    bool done = options.update ? updateFile(sourcePath, destinationPath, options, result, error) : copyWholeFile(sourcePath, destinationPath, options, result, error);
+    if (!done)
+    {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+size_t Copy::defaultWorkers()
+{
+    return std::max<size_t>(8, std::thread::hardware_concurrency());
+}
+
+bool Copy::copyTree(const std::string &sourceDir, const std::string &destinationDir, const Options &options, TreeResult &result)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // "dir/" and "dir" name the same folder, the paths of its entries are made relative to it
+    std::filesystem::path sourceRoot = std::filesystem::path(sourceDir).lexically_normal();
+    std::filesystem::path destinationRoot = std::filesystem::path(destinationDir).lexically_normal();
+    if (!sourceRoot.has_filename() && sourceRoot.has_relative_path())
+    {
+        sourceRoot = sourceRoot.parent_path();
+    }
+
+    TreeCopy copy(options, result);
+    if (copy.walk(sourceRoot, destinationRoot))
+    {
+        copy.run();
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result.errors.empty();
+}
@@ -0,0 +1,92 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Copy
+{
+    // How the data of a file went to its copy, the fastest one the file systems allow is used
+    enum class Method
+    {
+        CLONE,           // Reflink : the copy shares the blocks of the source until one of them is written (Btrfs, XFS...)
+        COPY_FILE_RANGE, // Copied by the kernel, or by the file system or storage server when it can do it itself
+        SENDFILE,        // Copied by the kernel from the page cache of the source
+        SYSTEM,          // CopyFileExW, which offloads the copy itself when the volume can
+        PIPELINE,        // Read by one thread and written by another through a few buffers
+        DIRECT,          // The pipeline with O_DIRECT, around the page cache
+        STREAM           // Read and written through a fixed size buffer
+    };
+
+    const char *methodName(Method method);
+
+    struct Result
+    {
+        Method method = Method::STREAM; // The last method that copied data
+        uint64_t bytes = 0;             // Data written to the destination
+        uint64_t skippedBytes = 0;      // Already in the destination, left as they were by an update
+        uint64_t holeBytes = 0;         // Zeros left as holes in the destination rather than written
+        bool unchanged = false;         // Update of a file with the size and modification time of its previous copy
+        double seconds = 0;
+    };
+
+    // Number of threads a tree is copied with when no other is asked for, more than the cores : they mostly wait
+    size_t defaultWorkers();
+
+    // Bytes copied so far out of the bytes to copy, moved by the copying threads and read by another one
+    struct Progress
+    {
+        std::atomic<uint64_t> done{0};
+        std::atomic<uint64_t> total{0}; // Set by the caller for files, copyTree adds the files it finds
+    };
+
+    struct Options
+    {
+        size_t workers = defaultWorkers();
+
+        // Leave alone a destination with the size and modification time of its source, and only rewrite the 64 KiB
+        // blocks which differ in one that changed. The copies get the modification time of their source
+        bool update = false;
+
+        // With update, compare the blocks of a destination even when it has the size and modification time of its
+        // source : a copy edited then given back the time of its source is repaired too
+        bool compare = false;
+
+        // Copy with O_DIRECT (unbuffered on Windows) rather than through the kernel, around the page cache.
+        // A file system which doesn't allow it is copied through the page cache
+        bool direct = false;
+
+        // Updated while the copy runs, nullptr when nobody watches
+        Progress *progress = nullptr;
+    };
+
+    // Copy the content of a file, the destination is created or replaced and keeps the permissions of the source.
+    // Only the data extents of a sparse file are copied (SEEK_DATA / SEEK_HOLE) and blocks of zeros read by the
+    // streaming copy aren't written : the holes stay holes. What the kernel can't copy itself is read and written
+    // by two threads through four 1 MiB buffers, whatever the size of the file ; a file of 64 MiB or more is
+    // dropped from the page cache behind the copy, so it doesn't evict what the other programs use.
+    // false once an error was written to std::cerr
+    bool copyFile(const std::string &sourcePath, const std::string &destinationPath, const Options &options, Result &result);
+
+    struct TreeResult
+    {
+        uint64_t files = 0;          // Copied or updated
+        uint64_t unchangedFiles = 0; // Left alone by an update
+        uint64_t directories = 0;
+        uint64_t links = 0;
+        uint64_t bytes = 0; // Data written
+        uint64_t skippedBytes = 0;
+        uint64_t holeBytes = 0;
+        double seconds = 0;
+        std::vector<std::string> errors; // Collected by the workers, for the caller to display
+    };
+
+    // Copy everything a folder holds into another one, created if needed. The tree is walked once to create the
+    // folders, then its files are copied by "workers" threads : small files in batches, large ones cut in ranges
+    // copied in parallel. Symbolic links are recreated, not followed. false when something couldn't be copied
+    bool copyTree(const std::string &sourceDir, const std::string &destinationDir, const Options &options, TreeResult &result);
+}
+
+#endif
@@ -0,0 +1,305 @@
+#include "counters.h"
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace
+{
+    // Two decimals without changing the format of the stream
+    std::string fixed(double value)
+    {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2) << value;
+        return oss.str();
+    }
+
+    const char *const eventNames[Counters::EVENT_COUNT] = {"cycles", "instructions", "cache misses", "branch misses", "page faults", "context switches"};
+
+#ifdef _WIN32
+    double fileTimeSeconds(const FILETIME &time)
+    {
+        ULARGE_INTEGER value;
+        value.LowPart = time.dwLowDateTime;
+        value.HighPart = time.dwHighDateTime;
+        return value.QuadPart / 1e7;
+    }
+
+    // Cycles and CPU time of the calling thread, page faults of the process ; Windows has no per command
+    // instruction or cache counters without a kernel driver
+    Counters::Sample readSample()
+    {
+        Counters::Sample sample;
+        sample.source = "thread cycle time";
+
+        ULONG64 cycles;
+        if (QueryThreadCycleTime(GetCurrentThread(), &cycles))
+        {
+            sample.values[Counters::CYCLES] = cycles;
+            sample.available[Counters::CYCLES] = true;
+        }
+
+        PROCESS_MEMORY_COUNTERS memory;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory)))
+        {
+            sample.values[Counters::PAGE_FAULTS] = memory.PageFaultCount;
+            sample.available[Counters::PAGE_FAULTS] = true;
+        }
+
+        FILETIME creation, exit, kernel, user;
+        if (GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        {
+            sample.userSeconds = fileTimeSeconds(user);
+            sample.systemSeconds = fileTimeSeconds(kernel);
+        }
+
+        return sample;
+    }
+#else
+    struct EventType
+    {
+        uint32_t type;
+        uint64_t config;
+    };
+
+    const EventType eventTypes[Counters::EVENT_COUNT] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    };
+
+    int openEvent(const EventType &event, bool userOnly)
+    {
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        attributes.type = event.type;
+        attributes.config = event.config;
+        attributes.disabled = 1;
+        attributes.inherit = 1; // Threads of a pipeline and spawned programs are counted too
+        attributes.exclude_hv = 1;
+        attributes.exclude_kernel = userOnly ? 1 : 0;
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    // Count scaled up when the kernel had more events than counters and shared them over time
+    bool readEvent(int descriptor, uint64_t &value)
+    {
+        uint64_t data[3];
+        if (read(descriptor, data, sizeof(data)) != sizeof(data) || data[2] == 0)
+        {
+            return false;
+        }
+
+        value = data[2] < data[1] ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : data[0];
+        return true;
+    }
+
+    double timevalSeconds(const timeval &time)
+    {
+        return time.tv_sec + time.tv_usec / 1e6;
+    }
+
+    // CPU time, faults and context switches of the shell and of the programs it waited for
+    Counters::Sample readUsage()
+    {
+        Counters::Sample sample;
+        sample.source = "getrusage";
+
+        rusage self{};
+        rusage children{};
+        getrusage(RUSAGE_SELF, &self);
+        getrusage(RUSAGE_CHILDREN, &children);
+
+        sample.values[Counters::PAGE_FAULTS] = self.ru_minflt + self.ru_majflt + children.ru_minflt + children.ru_majflt;
+        sample.values[Counters::CONTEXT_SWITCHES] = self.ru_nvcsw + self.ru_nivcsw + children.ru_nvcsw + children.ru_nivcsw;
+        sample.available[Counters::PAGE_FAULTS] = true;
+        sample.available[Counters::CONTEXT_SWITCHES] = true;
+        sample.userSeconds = timevalSeconds(self.ru_utime) + timevalSeconds(children.ru_utime);
+        sample.systemSeconds = timevalSeconds(self.ru_stime) + timevalSeconds(children.ru_stime);
+
+        return sample;
+    }
+#endif
+}
+
+Counters::Group::Group()
+{
+#ifndef _WIN32
+    for (int event = 0; event < EVENT_COUNT; ++event)
+    {
+        descriptors[event] = openEvent(eventTypes[event], false);
+
+        // perf_event_paranoid above 1 only lets unprivileged users count their own code
+        if (descriptors[event] < 0 && errno == EACCES)
+        {
+            descriptors[event] = openEvent(eventTypes[event], true);
+        }
+    }
+#endif
+}
+
+Counters::Group::~Group()
+{
+#ifndef _WIN32
+    for (int descriptor : descriptors)
+    {
+        if (descriptor >= 0)
+        {
+            close(descriptor);
+        }
+    }
+#endif
+}
+
+void Counters::Group::start()
+{
+#ifdef _WIN32
+    before = readSample();
+#else
+    for (int descriptor : descriptors)
+    {
+        if (descriptor >= 0)
+        {
+            ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+            ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    before = readUsage();
+#endif
+}
+
+Counters::Sample Counters::Group::stop()
+{
+#ifdef _WIN32
+    Sample after = readSample();
+    Sample sample = after;
+
+    for (int event = 0; event < EVENT_COUNT; ++event)
+    {
+        sample.values[event] = after.values[event] - before.values[event];
+    }
+#else
+    Sample after = readUsage();
+    Sample sample = after;
+
+    for (int event = 0; event < EVENT_COUNT; ++event)
+    {
+        sample.values[event] = after.values[event] - before.values[event];
+    }
+
+    bool hardware = false;
+    bool software = false;
+
+    for (int event = 0; event < EVENT_COUNT; ++event)
+    {
+        uint64_t value;
+        if (descriptors[event] < 0)
+        {
+            continue;
+        }
+
+        ioctl(descriptors[event], PERF_EVENT_IOC_DISABLE, 0);
+        if (readEvent(descriptors[event], value))
+        {
+            sample.values[event] = value;
+            sample.available[event] = true;
+            (eventTypes[event].type == PERF_TYPE_HARDWARE ? hardware : software) = true;
+        }
+    }
+
+    if (hardware || software)
+    {
+        sample.source = hardware ? "perf_event" : "perf_event software, no hardware counters";
+    }
+#endif
+
+    sample.userSeconds = after.userSeconds - before.userSeconds;
+    sample.systemSeconds = after.systemSeconds - before.systemSeconds;
+    return sample;
+}
+
+const char *Counters::eventName(Event event)
+{
+    return eventNames[event];
+}
+
+void Counters::write(const Sample &sample, uint64_t bytesRead, uint64_t bytesWritten, std::ostream &output)
+{
+    output << "Counters (" << sample.source << "):" << '\n';
+
+    for (int event = 0; event < EVENT_COUNT; ++event)
+    {
+        output << "  " << std::left << std::setw(18) << eventNames[event] << std::right;
+        if (sample.available[event])
+        {
+            output << sample.values[event] << '\n';
+        }
+        else
+        {
+            output << "not available" << '\n';
+        }
+    }
+
+    output << "  " << std::left << std::setw(18) << "user time" << std::right << sample.userSeconds << " s" << '\n';
+    output << "  " << std::left << std::setw(18) << "system time" << std::right << sample.systemSeconds << " s" << '\n';
+
+    bool cycles = sample.available[CYCLES] && sample.values[CYCLES] > 0;
+    bool instructions = sample.available[INSTRUCTIONS];
+
+    if (cycles && instructions)
+    {
+        output << "  " << std::left << std::setw(18) << "IPC" << std::right
+               << fixed(static_cast<double>(sample.values[INSTRUCTIONS]) / sample.values[CYCLES]) << '\n';
+    }
+
+    const std::pair<const char *, uint64_t> transfers[] = {{"per byte read", bytesRead}, {"per byte written", bytesWritten}};
+    for (const auto &transfer : transfers)
+    {
+        if (transfer.second == 0 || (!cycles && !instructions))
+        {
+            continue;
+        }
+
+        output << "  " << std::left << std::setw(18) << transfer.first << std::right;
+        if (cycles)
+        {
+            output << fixed(static_cast<double>(sample.values[CYCLES]) / transfer.second) << " cycles  ";
+        }
+        if (instructions)
+        {
+            output << fixed(static_cast<double>(sample.values[INSTRUCTIONS]) / transfer.second) << " instructions";
+        }
+        output << '\n';
+    }
+}
+
+void Counters::writeUsage(const Exe::Usage &usage, std::ostream &output)
+{
+    output << "Programs:" << '\n';
+    output << "  " << std::left << std::setw(18) << "user time" << std::right << usage.userSeconds << " s" << '\n';
+    output << "  " << std::left << std::setw(18) << "system time" << std::right << usage.systemSeconds << " s" << '\n';
+    output << "  " << std::left << std::setw(18) << "max resident" << std::right << usage.maxResidentBytes / 1024 << " KiB" << '\n';
+    output << "  " << std::left << std::setw(18) << "minor faults" << std::right << usage.minorFaults << '\n';
+    output << "  " << std::left << std::setw(18) << "major faults" << std::right << usage.majorFaults << '\n';
+#ifndef _WIN32
+    output << "  " << std::left << std::setw(18) << "voluntary cs" << std::right << usage.voluntarySwitches << '\n';
+    output << "  " << std::left << std::setw(18) << "involuntary cs" << std::right << usage.involuntarySwitches << '\n';
+#endif
+}
@@ -0,0 +1,63 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <cstdint>
+#include <ostream>
+
+#include "process.h"
+
+namespace Counters
+{
+    enum Event
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        PAGE_FAULTS,
+        CONTEXT_SWITCHES,
+        EVENT_COUNT
+    };
+
+    struct Sample
+    {
+        uint64_t values[EVENT_COUNT] = {};
+        bool available[EVENT_COUNT] = {};
+        double userSeconds = 0;
+        double systemSeconds = 0;
+        const char *source = "none"; // Where the counts come from, shown with them
+    };
+
+    // Performance counters of the shell, and on Linux of the threads and programs it starts while they count.
+    // Hardware counters are read through perf_event_open when the kernel allows it (often not in containers),
+    // otherwise the software ones, otherwise getrusage
+    class Group
+    {
+    public:
+        Group();
+        ~Group();
+
+        Group(const Group &) = delete;
+        Group &operator=(const Group &) = delete;
+
+        void start();
+        Sample stop();
+
+    private:
+#ifndef _WIN32
+        int descriptors[EVENT_COUNT];
+#endif
+        Sample before;
+    };
+
+    // "cycles", "cache misses"...
+    const char *eventName(Event event);
+
+    // Counts with the instructions per cycle, and the cost per byte when the command read or wrote any
+    void write(const Sample &sample, uint64_t bytesRead, uint64_t bytesWritten, std::ostream &output);
+
+    // Resources the operating system accounted to the external programs of a command line
+    void writeUsage(const Exe::Usage &usage, std::ostream &output);
+}
+
+#endif
@@ -0,0 +1,419 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "output.h"
+
+using namespace Tokenizer;
+
+namespace
+{
+    enum class JobState
+    {
+        WAITING, // No worker is free yet
+        RUNNING,
+        DONE
+    };
+
+    // Output of a job, appended to its content each time the buffer is full or flushed
+    class JobBuffer : public Output::Sink
+    {
+    public:
+        JobBuffer(std::mutex &mutex, std::condition_variable &changed, std::string &content)
+            : Output::Sink(4096), mutex(mutex), changed(changed), content(content)
+        {
+        }
+
+    protected:
+        bool writeBlock(std::vector<char> &block, size_t size) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            content.append(block.data(), size);
+            changed.notify_all();
+            return true;
+        }
+
+    private:
+        std::mutex &mutex;
+        std::condition_variable &changed;
+        std::string &content;
+    };
+
+    // Id of the job run by the current thread, 0 outside of the jobs
+    thread_local size_t currentJob = 0;
+
+    struct Job
+    {
+        size_t id;
+        std::string commandLine;
+        JobState state = JobState::WAITING;
+        std::string content;
+    };
+
+    // Jobs and the bounded pool of threads running them, every member is protected by "mutex"
+    class JobTable
+    {
+    public:
+        ~JobTable()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            changed.notify_all();
+
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        size_t start(const std::string &commandLine, std::function<void(std::istream &, std::ostream &)> work)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto job = std::make_shared<Job>();
+            job->id = nextId++;
+            job->commandLine = commandLine;
+            jobs[job->id] = job;
+
+            tasks.push_back([this, job, work = std::move(work)]()
+                            { run(*job, work); });
+
+            // A worker is only created when the idle ones can't take every queued task : an idle worker
+            // not woken up yet already has a task waiting for it
+            if (tasks.size() > idleWorkers && workers.size() < maxWorkers())
+            {
+                workers.emplace_back(&JobTable::workerLoop, this);
+            }
+            changed.notify_all();
+
+            return job->id;
+        }
+
+        void list(std::ostream &output)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            for (const auto &entry : jobs)
+            {
+                const Job &job = *entry.second;
+                output << '[' << job.id << "] " << stateName(job.state) << "  " << job.commandLine << '\n';
+            }
+        }
+
+        bool wait(size_t id, std::ostream &output)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            auto entry = jobs.find(id);
+            if (entry == jobs.end())
+            {
+                return false;
+            }
+            if (!waitable(id))
+            {
+                lock.unlock();
+                printNotWaitable(id);
+                return true;
+            }
+
+            std::shared_ptr<Job> job = entry->second;
+            changed.wait(lock, [&job]
+                         { return job->state == JobState::DONE; });
+            remove(job->id);
+
+            lock.unlock();
+            printJob(*job, output);
+            return true;
+        }
+
+        void waitAll(std::ostream &output)
+        {
+            while (true)
+            {
+                size_t id;
+                {
+                    // A job only waits for the jobs started before it, never for itself
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (jobs.empty() || !waitable(jobs.begin()->first))
+                    {
+                        return;
+                    }
+                    id = jobs.begin()->first;
+                }
+                wait(id, output);
+            }
+        }
+
+        bool foreground(size_t id, std::ostream &output)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            auto entry = id == 0 ? latestWaitable() : jobs.find(id);
+            if (entry == jobs.end())
+            {
+                return false;
+            }
+            if (!waitable(entry->first))
+            {
+                lock.unlock();
+                printNotWaitable(entry->first);
+                return true;
+            }
+
+            std::shared_ptr<Job> job = entry->second;
+            output << job->commandLine << '\n';
+
+            // The content is copied out in chunks and written without holding the lock
+            size_t offset = 0;
+            std::string chunk;
+            while (true)
+            {
+                changed.wait(lock, [&job, offset]
+                             { return job->content.size() > offset || job->state == JobState::DONE; });
+
+                chunk.assign(job->content, offset, std::string::npos);
+                offset = job->content.size();
+                bool done = job->state == JobState::DONE && chunk.empty();
+
+                if (done)
+                {
+                    remove(job->id);
+                    return true;
+                }
+
+                lock.unlock();
+                output << chunk;
+                output.flush();
+                lock.lock();
+            }
+        }
+
+        void reportFinished(std::ostream &output)
+        {
+            if (unreported.load() == 0)
+            {
+                return;
+            }
+
+            std::vector<std::shared_ptr<Job>> finished;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                for (auto entry = jobs.begin(); entry != jobs.end();)
+                {
+                    std::shared_ptr<Job> job = (entry++)->second;
+                    if (job->state == JobState::DONE)
+                    {
+                        finished.push_back(job);
+                        remove(job->id);
+                    }
+                }
+            }
+
+            for (const auto &job : finished)
+            {
+                printJob(*job, output);
+            }
+        }
+
+    private:
+        static size_t maxWorkers()
+        {
+            return std::max<size_t>(2, std::thread::hardware_concurrency());
+        }
+
+        static const char *stateName(JobState state)
+        {
+            switch (state)
+            {
+            case JobState::WAITING:
+                return "Waiting";
+            case JobState::RUNNING:
+                return "Running";
+            default:
+                return "Done";
+            }
+        }
+
+        static void printJob(const Job &job, std::ostream &output)
+        {
+            output << '[' << job.id << "] Done  " << job.commandLine << '\n'
+                   << job.content;
+
+            if (!job.content.empty() && job.content.back() != '\n')
+            {
+                output << '\n';
+            }
+        }
+
+        // A job waiting for itself or for a later job could wait forever : the later job may wait for it
+        // in turn, or stay queued behind it when every worker is busy
+        static bool waitable(size_t id)
+        {
+            return currentJob == 0 || id < currentJob;
+        }
+
+        static void printNotWaitable(size_t id)
+        {
+            std::cerr << "A job can only wait for the jobs started before it: " << id << std::endl;
+        }
+
+        // Called with the lock held
+        std::map<size_t, std::shared_ptr<Job>>::iterator latestWaitable()
+        {
+            auto entry = currentJob == 0 ? jobs.end() : jobs.lower_bound(currentJob);
+            return entry == jobs.begin() ? jobs.end() : std::prev(entry);
+        }
+
+        // Called with the lock held, a job waited for by several callers is only removed once
+        void remove(size_t id)
+        {
+            auto entry = jobs.find(id);
+            if (entry == jobs.end())
+            {
+                return;
+            }
+            if (entry->second->state == JobState::DONE)
+            {
+                --unreported;
+            }
+            jobs.erase(entry);
+        }
+
+        void run(Job &job, const std::function<void(std::istream &, std::ostream &)> &work)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job.state = JobState::RUNNING;
+            }
+
+            JobBuffer buffer(mutex, changed, job.content);
+            std::ostream jobOutput(&buffer);
+
+            // A job never reads the console, the shell keeps it for the next command lines
+            std::istringstream noInput;
+
+            currentJob = job.id;
+            try
+            {
+                work(noInput, jobOutput);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << e.what() << '\n';
+            }
+            jobOutput.flush();
+            currentJob = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job.state = JobState::DONE;
+                ++unreported;
+            }
+            changed.notify_all();
+        }
+
+        void workerLoop()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (true)
+            {
+                ++idleWorkers;
+                changed.wait(lock, [this]
+                             { return !tasks.empty() || stopping; });
+                --idleWorkers;
+
+                if (tasks.empty())
+                {
+                    return;
+                }
+
+                std::function<void()> task = std::move(tasks.front());
+                tasks.pop_front();
+
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+
+        std::map<size_t, std::shared_ptr<Job>> jobs;
+        size_t nextId = 1;
+        std::atomic<size_t> unreported{0};
+
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> workers;
+        size_t idleWorkers = 0;
+        bool stopping = false;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+
+    JobTable &jobTable()
+    {
+        static JobTable table;
+        return table;
+    }
+}
+
+bool Jobs::parseBackground(std::vector<TokenView> &views, bool &background)
+{
+    background = !views.empty() && views.back().type == TokenType::BACKGROUND;
+    if (background)
+    {
+        views.pop_back();
+    }
+
+    bool misplaced = std::any_of(views.begin(), views.end(), [](const TokenView &view)
+                                 { return view.type == TokenType::BACKGROUND; });
+
+    if (misplaced || (background && views.empty()))
+    {
+        std::cerr << "Usage: <command_line> &" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+size_t Jobs::start(const std::string &commandLine, std::function<void(std::istream &, std::ostream &)> work)
+{
+    return jobTable().start(commandLine, std::move(work));
+}
+
+void Jobs::list(std::ostream &output)
+{
+    jobTable().list(output);
+}
+
+bool Jobs::wait(size_t id, std::ostream &output)
+{
+    return jobTable().wait(id, output);
+}
+
+void Jobs::waitAll(std::ostream &output)
+{
+    jobTable().waitAll(output);
+}
+
+bool Jobs::foreground(size_t id, std::ostream &output)
+{
+    return jobTable().foreground(id, output);
+}
+
+void Jobs::reportFinished(std::ostream &output)
+{
+    jobTable().reportFinished(output);
+}
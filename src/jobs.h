@@ -0,0 +1,35 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tokenizer.h"
+
+namespace Jobs
+{
+    // Remove a trailing "&" from the tokens of a line, false if "&" is anywhere else
+    bool parseBackground(std::vector<Tokenizer::TokenView> &views, bool &background);
+
+    // Run "work" on the worker pool and return the id of the job at once
+    // What the job writes is kept in its own buffer until the job is waited for or reported
+    size_t start(const std::string &commandLine, std::function<void(std::istream &, std::ostream &)> work);
+
+    // Print the id, the state and the command line of every job
+    void list(std::ostream &output);
+
+    // Wait for the job and print its output, false if there is no such job
+    // Inside a job, only the jobs started before it are waited for
+    bool wait(size_t id, std::ostream &output);
+    void waitAll(std::ostream &output);
+
+    // Print the output of the job as it is written until the job ends, 0 as id takes the latest job
+    bool foreground(size_t id, std::ostream &output);
+
+    // Print the output of the jobs which ended since the last call
+    void reportFinished(std::ostream &output);
+}
+
+#endif
@@ -4,15 +4,21 @@
 #include <fstream>
 #include <vector>
 #include <string>
-#include <unordered_map>
-#include <map>
-#include <regex>
 #include <memory>
 #include <chrono>
 #include <cstdlib>
+
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 #include "command.h"
+#include "jobs.h"
+#include "output.h"
+#include "registry.h"
+#include "script.h"
+#include "server.h"
+#include "shell.h"
 #include "tokenizer.h"
 #include "utils.h"
 
@@ -21,433 +27,108 @@ using namespace Utils;
 using namespace Exe;
 using namespace fs;
 
-class CommandRegistry
-{
-public:
-    void registerCommand(const std::string &name, std::unique_ptr<Command> command)
-    {
-        commands[name] = std::move(command);
-    }
-
-    Command *getCommand(const std::string &name) const
-    {
-        auto it = commands.find(name);
-        return it != commands.end() ? it->second.get() : nullptr;
-    }
-
-private:
-    std::unordered_map<std::string, std::unique_ptr<Command>> commands;
-};
-
 void showPrompt()
 {
     std::string currentDir = getCurrentDir();
-    std::cout << currentDir << "> ";
-}
-
-bool fileExists(const std::wstring &filePath)
-{
-    DWORD attributes = GetFileAttributesW(filePath.c_str());
-    return (attributes != INVALID_FILE_ATTRIBUTES) && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
-}
-
-bool hasExeExtension(const std::wstring &filePath)
-{
-    size_t dotPosition = filePath.find_last_of(L'.');
-    if (dotPosition != std::wstring::npos)
-    {
-        std::wstring extension = filePath.substr(dotPosition + 1);
-        return extension == L"exe";
-    }
-    return false;
+    std::cout << currentDir << "> " << std::flush;
 }
 
-bool isExecutable(const std::wstring &filePath)
+void showUsage()
 {
-    return fileExists(filePath) && hasExeExtension(filePath);
+    std::cerr << "Usage: cmd++ [-c <command_line> | -f <file_path> | --serve <socket_path> | --client <socket_path> <command_line>]" << std::endl;
 }
 
-void processSectionCommand(std::string li, const CommandRegistry &commandRegistry, std::map<std::string, std::vector<std::string>> sections)
+int main(int argc, char *argv[])
 {
-    try
-    {
-        std::vector<Token> tokens = tokenize(li);
-        std::string commandName = tokens[0].value;
-        tokens.erase(tokens.begin());
-
-        Command *command = commandRegistry.getCommand(commandName);
-        if (command)
-        {
-            command->execute(tokens);
-        }
-        else if (commandName == "goto")
-        {
-            std::string sectionName = tokens[0].value;
-
-            auto section = sections.find(sectionName);
+    // std::cin and std::cerr stay synchronized with stdio : several threads write errors at once, and std::cout
+    // doesn't need it, it is routed through the TerminalSink below
 
-            if (section != sections.end())
-            {
-                // Access the pair using the iterator
-                const std::pair<const std::string, std::vector<std::string>> &specificPair = *section;
-                const std::vector<std::string> &commands = specificPair.second;
-
-                for (const std::string &li : commands)
-                {
-                    processSectionCommand(li, commandRegistry, sections);
-                }
-            }
-            else
-            {
-                std::cout << "Section not found in the file" << std::endl;
-            }
-        }
-        else
-        {
-            std::cerr << "Unknown command: " << commandName << std::endl;
-        }
-    }
-    catch (const std::exception &e)
-    {
-        std::cerr << e.what() << '\n';
-    }
-}
-
-void executeCommandFile(const std::string &commandFilePath, const CommandRegistry &commandRegistry)
-{
-    std::ifstream commandFile(commandFilePath);
-
-    if (!commandFile.is_open())
-    {
-        std::cerr << "Unable to open the file." << std::endl;
-    }
-
-    bool inSection = false;
-
-    std::smatch match;
+    // Built-in commands are created the first time they are used
+    CommandRegistry commandRegistry;
 
-    std::map<std::string, std::vector<std::string>> sections;
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
 
-    // Define the regular expression pattern
-    std::regex sectionStartRegex("/-(\\w+)");
-    std::regex sectionEndRegex("(\\w+)-/");
+    Shell::Session session{commandRegistry};
 
-    std::vector<std::string> sectionLines;
-    std::vector<std::string> commandLines;
+    // Commands read from a file or a pipe run as a batch : no license, no prompt, and the output
+    // is only written by full blocks
+    bool batch = !Exe::isTerminal(Exe::standardInput());
 
-    std::string line;
-    std::string currentSection;
+    // Commands write to a buffered sink, the prompt and interactive output are flushed after each line
+    Output::installTerminal(batch);
 
-    while (std::getline(commandFile, line))
+    // Non interactive modes run a single command line or a command file, without the license or a prompt
+    if (argc > 1)
     {
-        // Check if the line indicates the start of a section
-        if (std::regex_match(line, match, sectionStartRegex))
-        {
-            currentSection = match[1].str();
-            inSection = true;
-            continue; // Skip the line indicating the start of the section
-        }
+        std::string option = argv[1];
 
-        // Check if the line indicates the end of a section
-        if (std::regex_match(line, match, sectionEndRegex) && match[1].str() == currentSection)
+        // A server keeps the registry and the caches warm, a client only forwards one line to it
+        if (option == "--serve" && argc == 3)
         {
-            sections[currentSection] = sectionLines;
-            inSection = false;
-
-            sectionLines.clear();
-            currentSection.clear();
-            continue; // Skip the line indicating the end of the section
+            return Server::serve(commandRegistry, argv[2]);
         }
 
-        // If inside a section, store the line
-        if (!currentSection.empty() && inSection == true)
+        if (option == "--client" && argc == 4)
         {
-            sectionLines.push_back(line);
+            return Server::request(argv[2], argv[3]);
         }
 
-        // Process each line as needed
-        if (inSection == false)
-        {
-            commandLines.push_back(line);
-        }
-    }
-
-    commandFile.close();
-
-    for (const auto &l : commandLines)
-    {
-        try
-        {
-            std::vector<Token> tokens = tokenize(l);
-            std::string commandName = tokens[0].value;
-            tokens.erase(tokens.begin());
-
-            Command *command = commandRegistry.getCommand(commandName);
-            if (command)
-            {
-                command->execute(tokens);
-            }
-            else if (commandName == "goto")
-            {
-                std::string sectionName = tokens[0].value;
-
-                auto section = sections.find(sectionName);
-
-                if (section != sections.end())
-                {
-                    // Access the pair using the iterator
-                    const std::pair<const std::string, std::vector<std::string>> &specificPair = *section;
-                    const std::vector<std::string> &commands = specificPair.second;
-
-                    for (const std::string &li : commands)
-                    {
-                        processSectionCommand(li, commandRegistry, sections);
-                    }
-                }
-                else
-                {
-                    std::cout << "Section not found in the file" << std::endl;
-                }
-            }
-            else
-            {
-                std::cerr << "Unknown command: " << commandName << std::endl;
-            }
-        }
-        catch (const std::exception &e)
+        if (argc != 3 || (option != "-c" && option != "-f"))
         {
-            std::cerr << e.what() << '\n';
+            showUsage();
+            return 1;
         }
-    }
-}
-
-void processCommand(std::string &cmdline, const CommandRegistry &commandRegistry, bool &exetime, std::vector<Token> tokens)
-{
-    try
-    {
-        std::string commandName = cmdline;
-        std::wstring wCommandName = stringToWstring(commandName);
-
-        Command *command = commandRegistry.getCommand(commandName);
-        if (command)
-        {
-            if (exetime)
-            {
-                auto start = std::chrono::high_resolution_clock::now();
-
-                command->execute(tokens);
-
-                auto end = std::chrono::high_resolution_clock::now();
-
-                // Execution time in microseconds
-                auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-
-                // Convert duration to milliseconds
-                auto duration_ms = duration_us / 1000.0;
-
-                // Convert duration to seconds
-                auto duration_s = duration_us / 1000000.0;
-
-                // Convert duration to minutes
-                auto duration_min = duration_us / 60000000.0;
 
-                std::cout << "Execution time: " << std::endl;
-                std::cout << duration_us << " microseconds" << std::endl;
-                std::cout << duration_ms << " milliseconds" << std::endl;
-                std::cout << duration_s << " seconds" << std::endl;
-                std::cout << duration_min << " minutes" << std::endl;
-            }
-            else
-            {
-                command->execute(tokens);
-            }
-        }
-        else if (isExecutable(wCommandName))
-        {
-            executeCommand(wCommandName);
-        }
-        else if (std::filesystem::exists(commandName))
+        if (option == "-c")
         {
-            if (std::filesystem::is_regular_file(commandName))
-            {
-                std::wstring extension = std::filesystem::path(commandName).extension();
-                if (extension == L".shl")
-                {
-                    executeCommandFile(commandName, commandRegistry);
-                }
-                else
-                {
-                    std::cerr << "Unknown command: " << commandName << std::endl;
-                }
-            }
-            else
-            {
-                std::cerr << "Unknown command: " << commandName << std::endl;
-            }
+            Shell::executeLine(session, argv[2], std::cin, std::cout);
         }
-        else if (commandName == "exetime")
-        {
-            exetime = not exetime;
-        }
-        else if (std::getenv(commandName.c_str()) != nullptr)
+        else if (std::filesystem::is_regular_file(argv[2]))
         {
+            Script::executeCommandFile(argv[2], commandRegistry, std::cin, std::cout);
         }
         else
         {
-            std::cerr << "Unknown command: " << commandName << std::endl;
+            std::cerr << "Unable to open the file: " << argv[2] << std::endl;
+            return 1;
         }
+
+        Jobs::waitAll(std::cout);
+        return 0;
     }
-    catch (const std::exception &e)
+
+    if (batch)
     {
-        std::cerr << e.what() << '\n';
+        Shell::executeStream(session, Exe::standardInput(), std::cout);
+        Jobs::waitAll(std::cout);
+        return 0;
     }
-}
-
-int main()
-{
-    CommandRegistry commandRegistry;
 
-    // Register commands
-    commandRegistry.registerCommand("echo", std::make_unique<EchoCommand>());
-    commandRegistry.registerCommand("cd", std::make_unique<CdCommand>());
-    commandRegistry.registerCommand("assoc", std::make_unique<AssocCommand>());
-    commandRegistry.registerCommand("cls", std::make_unique<ClsCommand>());
-    commandRegistry.registerCommand("cmd", std::make_unique<CmdCommand>());
-    commandRegistry.registerCommand("cmd++", std::make_unique<CmdCommand>());
-    commandRegistry.registerCommand("color", std::make_unique<ColorCommand>());
-    commandRegistry.registerCommand("comp", std::make_unique<CompCommand>());
-    commandRegistry.registerCommand("fc", std::make_unique<CompCommand>());
-    commandRegistry.registerCommand("copy", std::make_unique<CopyCommand>());
-    commandRegistry.registerCommand("time", std::make_unique<TimeCommand>());
-    commandRegistry.registerCommand("timer", std::make_unique<TimerCommand>());
-    commandRegistry.registerCommand("lsof", std::make_unique<LsofCommand>());
-    commandRegistry.registerCommand("memadrs", std::make_unique<MemadrsCommand>());
-    commandRegistry.registerCommand("memstats", std::make_unique<MemstatsCommand>());
-    commandRegistry.registerCommand("rma", std::make_unique<RmaCommand>()); // WIP
-    commandRegistry.registerCommand("hexdump", std::make_unique<HexdumpCommand>());
-    commandRegistry.registerCommand("findstr", std::make_unique<ExtractstrCommand>());
-    commandRegistry.registerCommand("xml", std::make_unique<XmlCommand>());
-    commandRegistry.registerCommand("encoding", std::make_unique<EncodingCommand>());
-    commandRegistry.registerCommand("gpw", std::make_unique<PasswordCommand>());
-    commandRegistry.registerCommand("quicksearch", std::make_unique<QuicksearchCommand>());
-    commandRegistry.registerCommand("qs", std::make_unique<QuicksearchCommand>());
-    commandRegistry.registerCommand("clc", std::make_unique<CalculatorCommand>());
-    commandRegistry.registerCommand("kill", std::make_unique<KillCommand>());
-    commandRegistry.registerCommand("random", std::make_unique<RandomCommand>());
-    commandRegistry.registerCommand("envvar", std::make_unique<EnvvarCommand>());
-    commandRegistry.registerCommand("rem", std::make_unique<RemCommand>());
-    commandRegistry.registerCommand("schema", std::make_unique<SchemaCommand>());
-
-    // Use the custom namespace for TokenType
-    Token token1;
-    enum TokenType type1 = TokenType::COMMAND;
-
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    SetConsoleOutputCP(CP_UTF8);
-
-    bool exetime = false;
+    // Reused from one line to the next so reading a command doesn't allocate once it has grown
+    std::string input;
 
     // Print the license at start
     typeText(licensePath, 25);
 
     while (true)
     {
-        showPrompt();
+        // Output of the background jobs which ended while the previous command was running
+        Jobs::reportFinished(std::cout);
 
-        std::string input;
-        std::getline(std::cin, input);
+        showPrompt();
 
-        if (input == "exit")
+        if (!std::getline(std::cin, input) || input == "exit")
         {
             break;
         }
 
-        std::vector<Token> tokens = tokenize(input);
-        std::string commandName = tokens[0].value;
-        std::wstring wCommandName = stringToWstring(commandName);
-        tokens.erase(tokens.begin());
-
-        Command *command = commandRegistry.getCommand(commandName);
-        if (command)
-        {
-            if (exetime)
-            {
-                auto start = std::chrono::high_resolution_clock::now();
-
-                command->execute(tokens);
-
-                auto end = std::chrono::high_resolution_clock::now();
-
-                // Execution time in microseconds
-                auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-
-                // Convert duration to milliseconds
-                auto duration_ms = duration_us / 1000.0;
-
-                // Convert duration to seconds
-                auto duration_s = duration_us / 1000000.0;
-
-                // Convert duration to minutes
-                auto duration_min = duration_us / 60000000.0;
-
-                std::cout << "Execution time: " << std::endl;
-                std::cout << duration_us << " microseconds" << std::endl;
-                std::cout << duration_ms << " milliseconds" << std::endl;
-                std::cout << duration_s << " seconds" << std::endl;
-                std::cout << duration_min << " minutes" << std::endl;
-            }
-            else
-            {
-                command->execute(tokens);
-            }
-        }
-        else if (isExecutable(wCommandName))
-        {
-            executeCommand(wCommandName);
-        }
-        else if (std::filesystem::exists(commandName))
-        {
-            if (std::filesystem::is_regular_file(commandName))
-            {
-                std::wstring extension = std::filesystem::path(commandName).extension();
-                if (extension == L".shl")
-                {
-                    executeCommandFile(commandName, commandRegistry);
-                }
-                else
-                {
-                    std::cerr << "Unknown command: " << commandName << std::endl;
-                }
-            }
-            else
-            {
-                std::cerr << "Unknown command: " << commandName << std::endl;
-            }
-        }
-        else if (commandName == "exetime")
-        {
-            exetime = not exetime;
-        }
-        else if (std::getenv(commandName.c_str()) != nullptr)
-        {
-            try
-            {
-                char *envValue = std::getenv(commandName.c_str());
-
-                std::string cmdLine = envValue;
-
-                processCommand(cmdLine, commandRegistry, exetime, tokens);
-            }
-            catch (const std::exception &e)
-            {
-                std::cerr << e.what() << '\n';
-            }
-        }
-        else
-        {
-            std::cerr << "Unknown command: " << commandName << std::endl;
-        }
+        Shell::executeLine(session, input, std::cin, std::cout);
     }
 
+    // Background jobs still running are waited for before the shell exits
+    Jobs::waitAll(std::cout);
+
     return 0;
 }
@@ -0,0 +1,580 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "cache.h"
+#include "trace.h"
+#include "utils.h"
+
+namespace
+{
+    // Names are never removed, so the table is filled with compare-and-swap and read without a lock
+    constexpr size_t tableCapacity = 1024;
+
+    std::atomic<Metrics::Recorder *> recorders[tableCapacity];
+
+    // Shared by every name once the table is full
+    Metrics::Recorder overflowRecorder;
+
+    unsigned highestBit(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<unsigned>(index);
+#else
+        return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+    }
+
+    void updateMax(std::atomic<uint64_t> &maximum, uint64_t value)
+    {
+        uint64_t current = maximum.load(std::memory_order_relaxed);
+        while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Position reached in a stream, -1 when its buffer can't tell
+    std::streamoff inputPosition(std::istream &input)
+    {
+        return input.rdbuf() != nullptr ? static_cast<std::streamoff>(input.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in)) : -1;
+    }
+
+    std::streamoff outputPosition(std::ostream &output)
+    {
+        return output.rdbuf() != nullptr ? static_cast<std::streamoff>(output.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::out)) : -1;
+    }
+
+    uint64_t distance(std::streamoff before, std::streamoff after)
+    {
+        return before >= 0 && after >= before ? static_cast<uint64_t>(after - before) : 0;
+    }
+
+    std::string escapeLabel(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (c == '\n')
+            {
+                escaped += "\\n";
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+}
+
+size_t Metrics::bucketIndex(uint64_t value)
+{
+    if (value < subBucketCount)
+    {
+        return static_cast<size_t>(value);
+    }
+
+    unsigned exponent = highestBit(value);
+    size_t mantissa = static_cast<size_t>(value >> (exponent - subBucketBits)) & (subBucketCount - 1);
+    return (exponent - subBucketBits + 1) * subBucketCount + mantissa;
+}
+
+uint64_t Metrics::bucketLowerBound(size_t index)
+{
+    if (index < subBucketCount)
+    {
+        return index;
+    }
+
+    unsigned exponent = static_cast<unsigned>(index / subBucketCount) + subBucketBits - 1;
+    uint64_t mantissa = index % subBucketCount;
+    return (subBucketCount + mantissa) << (exponent - subBucketBits);
+}
+
+uint64_t Metrics::bucketUpperBound(size_t index)
+{
+    return index + 1 < bucketCount ? bucketLowerBound(index + 1) : UINT64_MAX;
+}
+
+void Metrics::Recorder::record(uint64_t nanoseconds, uint64_t read, uint64_t written)
+{
+    calls.fetch_add(1, std::memory_order_relaxed);
+    totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    bytesRead.fetch_add(read, std::memory_order_relaxed);
+    bytesWritten.fetch_add(written, std::memory_order_relaxed);
+    buckets[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    updateMax(maxNanoseconds, nanoseconds);
+}
+
+void Metrics::Recorder::recordUsage(const Exe::Usage &usage)
+{
+    programs.fetch_add(1, std::memory_order_relaxed);
+    userMicroseconds.fetch_add(static_cast<uint64_t>(usage.userSeconds * 1e6), std::memory_order_relaxed);
+    systemMicroseconds.fetch_add(static_cast<uint64_t>(usage.systemSeconds * 1e6), std::memory_order_relaxed);
+    minorFaults.fetch_add(usage.minorFaults, std::memory_order_relaxed);
+    majorFaults.fetch_add(usage.majorFaults, std::memory_order_relaxed);
+    voluntarySwitches.fetch_add(usage.voluntarySwitches, std::memory_order_relaxed);
+    involuntarySwitches.fetch_add(usage.involuntarySwitches, std::memory_order_relaxed);
+    updateMax(maxResidentBytes, usage.maxResidentBytes);
+}
+
+double Metrics::Snapshot::mean() const
+{
+    return calls > 0 ? static_cast<double>(totalNanoseconds) / calls : 0;
+}
+
+uint64_t Metrics::Snapshot::percentile(double fraction) const
+{
+    uint64_t rank = static_cast<uint64_t>(fraction * calls + 0.5);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if (seen >= std::max<uint64_t>(rank, 1))
+        {
+            // Middle of the bucket, never above the largest value recorded
+            uint64_t lower = bucketLowerBound(i);
+            return std::min(lower + (bucketUpperBound(i) - lower) / 2, maxNanoseconds);
+        }
+    }
+
+    return maxNanoseconds;
+}
+
+Metrics::Recorder &Metrics::recorder(std::string_view name)
+{
+    size_t slot = std::hash<std::string_view>()(name) % tableCapacity;
+
+    for (size_t probe = 0; probe < tableCapacity; ++probe, slot = (slot + 1) % tableCapacity)
+    {
+        Recorder *existing = recorders[slot].load(std::memory_order_acquire);
+
+        if (existing == nullptr)
+        {
+            auto created = std::make_unique<Recorder>();
+            created->name = std::string(name);
+
+            if (recorders[slot].compare_exchange_strong(existing, created.get(), std::memory_order_acq_rel))
+            {
+                return *created.release();
+            }
+            // Another thread filled the slot first, "existing" now holds its recorder
+        }
+
+        if (existing->name == name)
+        {
+            return *existing;
+        }
+    }
+
+    return overflowRecorder;
+}
+
+Metrics::Transfer Metrics::executeCommand(std::string_view name, Command &command, const std::vector<Token> &arguments, std::istream &input, std::ostream &output, bool cached)
+{
+    Trace::Span span("command", name);
+
+    std::streamoff readBefore = inputPosition(input);
+    std::streamoff writtenBefore = outputPosition(output);
+    auto start = std::chrono::steady_clock::now();
+
+    Cache::Result result = Cache::execute(name, command, arguments, input, output, cached);
+
+    auto end = std::chrono::steady_clock::now();
+    std::streamoff readAfter = inputPosition(input);
+    std::streamoff writtenAfter = outputPosition(output);
+
+    Recorder &commandRecorder = recorder(name);
+    if (result == Cache::Result::HIT)
+    {
+        commandRecorder.cacheHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (result == Cache::Result::MISS)
+    {
+        commandRecorder.cacheMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Transfer transfer{distance(readBefore, readAfter), distance(writtenBefore, writtenAfter)};
+    commandRecorder.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), transfer.bytesRead, transfer.bytesWritten);
+
+    return transfer;
+}
+
+std::vector<Metrics::Snapshot> Metrics::snapshot()
+{
+    std::vector<Snapshot> snapshots;
+
+    for (auto &slot : recorders)
+    {
+        Recorder *recorder = slot.load(std::memory_order_acquire);
+        if (recorder == nullptr || recorder->calls.load() == 0)
+        {
+            continue;
+        }
+
+        Snapshot snapshot{recorder->name, recorder->calls.load(), recorder->totalNanoseconds.load(), recorder->maxNanoseconds.load(),
+                          recorder->bytesRead.load(), recorder->bytesWritten.load(), std::vector<uint64_t>(bucketCount), recorder->programs.load(), Exe::Usage{}};
+
+        snapshot.usage.userSeconds = recorder->userMicroseconds.load() / 1e6;
+        snapshot.usage.systemSeconds = recorder->systemMicroseconds.load() / 1e6;
+        snapshot.usage.maxResidentBytes = recorder->maxResidentBytes.load();
+        snapshot.usage.minorFaults = recorder->minorFaults.load();
+        snapshot.usage.majorFaults = recorder->majorFaults.load();
+        snapshot.usage.voluntarySwitches = recorder->voluntarySwitches.load();
+        snapshot.usage.involuntarySwitches = recorder->involuntarySwitches.load();
+        snapshot.cacheHits = recorder->cacheHits.load();
+        snapshot.cacheMisses = recorder->cacheMisses.load();
+
+        for (size_t i = 0; i < bucketCount; ++i)
+        {
+            snapshot.buckets[i] = recorder->buckets[i].load(std::memory_order_relaxed);
+        }
+        snapshots.push_back(std::move(snapshot));
+    }
+
+    // Commands taking the most time first
+    std::sort(snapshots.begin(), snapshots.end(), [](const Snapshot &a, const Snapshot &b)
+              { return a.totalNanoseconds > b.totalNanoseconds; });
+
+    return snapshots;
+}
+
+void Metrics::reset()
+{
+    for (auto &slot : recorders)
+    {
+        Recorder *recorder = slot.load(std::memory_order_acquire);
+        if (recorder == nullptr)
+        {
+            continue;
+        }
+
+        recorder->calls = 0;
+        recorder->totalNanoseconds = 0;
+        recorder->maxNanoseconds = 0;
+        recorder->bytesRead = 0;
+        recorder->bytesWritten = 0;
+        for (auto &bucket : recorder->buckets)
+        {
+            bucket = 0;
+        }
+
+        recorder->programs = 0;
+        recorder->userMicroseconds = 0;
+        recorder->systemMicroseconds = 0;
+        recorder->maxResidentBytes = 0;
+        recorder->minorFaults = 0;
+        recorder->majorFaults = 0;
+        recorder->voluntarySwitches = 0;
+        recorder->involuntarySwitches = 0;
+        recorder->cacheHits = 0;
+        recorder->cacheMisses = 0;
+    }
+}
+
+std::string Metrics::formatDuration(double nanoseconds)
+{
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2);
+
+    if (nanoseconds >= 1e9)
+    {
+        oss << nanoseconds / 1e9 << " s";
+    }
+    else if (nanoseconds >= 1e6)
+    {
+        oss << nanoseconds / 1e6 << " ms";
+    }
+    else if (nanoseconds >= 1e3)
+    {
+        oss << nanoseconds / 1e3 << " us";
+    }
+    else
+    {
+        oss << nanoseconds << " ns";
+    }
+
+    return oss.str();
+}
+
+std::string Metrics::formatSize(uint64_t bytes)
+{
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1);
+
+    if (bytes >= (uint64_t(1) << 30))
+    {
+        oss << bytes / double(uint64_t(1) << 30) << " GiB";
+    }
+    else if (bytes >= (uint64_t(1) << 20))
+    {
+        oss << bytes / double(uint64_t(1) << 20) << " MiB";
+    }
+    else if (bytes >= 1024)
+    {
+        oss << bytes / 1024.0 << " KiB";
+    }
+    else
+    {
+        oss << bytes << " B";
+    }
+
+    return oss.str();
+}
+
+void Metrics::writeTable(const std::vector<Snapshot> &snapshots, std::ostream &output)
+{
+    size_t width = 12;
+    for (const auto &snapshot : snapshots)
+    {
+        width = std::max(width, snapshot.name.size() + 2);
+    }
+
+    output << std::left << std::setw(width) << "command" << std::right
+           << std::setw(10) << "calls" << std::setw(12) << "total" << std::setw(12) << "mean"
+           << std::setw(12) << "p50" << std::setw(12) << "p90" << std::setw(12) << "p99" << std::setw(12) << "max"
+           << std::setw(14) << "bytes in" << std::setw(14) << "bytes out" << '\n';
+
+    for (const auto &snapshot : snapshots)
+    {
+        output << std::left << std::setw(width) << snapshot.name << std::right
+               << std::setw(10) << snapshot.calls
+               << std::setw(12) << formatDuration(static_cast<double>(snapshot.totalNanoseconds))
+               << std::setw(12) << formatDuration(snapshot.mean())
+               << std::setw(12) << formatDuration(static_cast<double>(snapshot.percentile(0.5)))
+               << std::setw(12) << formatDuration(static_cast<double>(snapshot.percentile(0.9)))
+               << std::setw(12) << formatDuration(static_cast<double>(snapshot.percentile(0.99)))
+               << std::setw(12) << formatDuration(static_cast<double>(snapshot.maxNanoseconds))
+               << std::setw(14) << snapshot.bytesRead << std::setw(14) << snapshot.bytesWritten << '\n';
+    }
+
+    // Commands run through the cache, the share of their calls which were replayed
+    bool cached = std::any_of(snapshots.begin(), snapshots.end(), [](const Snapshot &snapshot)
+                              { return snapshot.cacheHits + snapshot.cacheMisses > 0; });
+    if (cached)
+    {
+        output << '\n'
+               << std::left << std::setw(width) << "cached" << std::right
+               << std::setw(10) << "hits" << std::setw(10) << "misses" << std::setw(12) << "hit ratio" << '\n';
+
+        for (const auto &snapshot : snapshots)
+        {
+            uint64_t lookups = snapshot.cacheHits + snapshot.cacheMisses;
+            if (lookups == 0)
+            {
+                continue;
+            }
+
+            std::ostringstream ratio;
+            ratio << std::fixed << std::setprecision(1) << 100.0 * snapshot.cacheHits / lookups << " %";
+
+            output << std::left << std::setw(width) << snapshot.name << std::right
+                   << std::setw(10) << snapshot.cacheHits << std::setw(10) << snapshot.cacheMisses << std::setw(12) << ratio.str() << '\n';
+        }
+    }
+
+    // Resources of the external programs, from the operating system once each run ended
+    bool programs = std::any_of(snapshots.begin(), snapshots.end(), [](const Snapshot &snapshot)
+                                { return snapshot.programs > 0; });
+    if (!programs)
+    {
+        return;
+    }
+
+    output << '\n'
+           << std::left << std::setw(width) << "program" << std::right
+           << std::setw(10) << "runs" << std::setw(12) << "user" << std::setw(12) << "system" << std::setw(14) << "max rss"
+           << std::setw(14) << "minor faults" << std::setw(14) << "major faults" << std::setw(12) << "vol cs" << std::setw(12) << "invol cs" << '\n';
+
+    for (const auto &snapshot : snapshots)
+    {
+        if (snapshot.programs == 0)
+        {
+            continue;
+        }
+
+        output << std::left << std::setw(width) << snapshot.name << std::right
+               << std::setw(10) << snapshot.programs
+               << std::setw(12) << formatDuration(snapshot.usage.userSeconds * 1e9)
+               << std::setw(12) << formatDuration(snapshot.usage.systemSeconds * 1e9)
+               << std::setw(14) << formatSize(snapshot.usage.maxResidentBytes)
+               << std::setw(14) << snapshot.usage.minorFaults << std::setw(14) << snapshot.usage.majorFaults
+               << std::setw(12) << snapshot.usage.voluntarySwitches << std::setw(12) << snapshot.usage.involuntarySwitches << '\n';
+    }
+}
+
+void Metrics::writeJson(const std::vector<Snapshot> &snapshots, std::ostream &output)
+{
+    output << "{\"commands\":[";
+
+    for (size_t i = 0; i < snapshots.size(); ++i)
+    {
+        const Snapshot &snapshot = snapshots[i];
+
+        output << (i > 0 ? "," : "") << "\n{\"name\":\"" << Utils::escapeJson(snapshot.name) << "\""
+               << ",\"calls\":" << snapshot.calls
+               << ",\"total_ns\":" << snapshot.totalNanoseconds
+               << ",\"mean_ns\":" << static_cast<uint64_t>(snapshot.mean())
+               << ",\"p50_ns\":" << snapshot.percentile(0.5)
+               << ",\"p90_ns\":" << snapshot.percentile(0.9)
+               << ",\"p99_ns\":" << snapshot.percentile(0.99)
+               << ",\"max_ns\":" << snapshot.maxNanoseconds
+               << ",\"bytes_read\":" << snapshot.bytesRead
+               << ",\"bytes_written\":" << snapshot.bytesWritten;
+
+        if (snapshot.programs > 0)
+        {
+            output << ",\"programs\":{\"runs\":" << snapshot.programs
+                   << ",\"user_us\":" << static_cast<uint64_t>(snapshot.usage.userSeconds * 1e6)
+                   << ",\"system_us\":" << static_cast<uint64_t>(snapshot.usage.systemSeconds * 1e6)
+                   << ",\"max_rss_bytes\":" << snapshot.usage.maxResidentBytes
+                   << ",\"minor_faults\":" << snapshot.usage.minorFaults
+                   << ",\"major_faults\":" << snapshot.usage.majorFaults
+                   << ",\"voluntary_switches\":" << snapshot.usage.voluntarySwitches
+                   << ",\"involuntary_switches\":" << snapshot.usage.involuntarySwitches << '}';
+        }
+
+        if (snapshot.cacheHits + snapshot.cacheMisses > 0)
+        {
+            output << ",\"cache\":{\"hits\":" << snapshot.cacheHits << ",\"misses\":" << snapshot.cacheMisses << '}';
+        }
+
+        output << ",\"histogram\":[";
+
+        // Only the buckets holding calls, as [lower bound, upper bound, count]
+        bool first = true;
+        for (size_t j = 0; j < snapshot.buckets.size(); ++j)
+        {
+            if (snapshot.buckets[j] == 0)
+            {
+                continue;
+            }
+            output << (first ? "" : ",") << '[' << bucketLowerBound(j) << ',' << bucketUpperBound(j) << ',' << snapshot.buckets[j] << ']';
+            first = false;
+        }
+
+        output << "]}";
+    }
+
+    output << "\n]}\n";
+}
+
+void Metrics::writePrometheus(const std::vector<Snapshot> &snapshots, std::ostream &output)
+{
+    // Standard Prometheus buckets in seconds, each one counts the calls whose bucket ends below it
+    const double bounds[] = {1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1, 10, 100};
+
+    output << "# HELP cmdpp_command_duration_seconds Time spent in each command\n"
+           << "# TYPE cmdpp_command_duration_seconds histogram\n";
+
+    for (const auto &snapshot : snapshots)
+    {
+        std::string label = "command=\"" + escapeLabel(snapshot.name) + "\"";
+
+        for (double bound : bounds)
+        {
+            uint64_t count = 0;
+            for (size_t i = 0; i < snapshot.buckets.size(); ++i)
+            {
+                if (static_cast<double>(bucketUpperBound(i)) <= bound * 1e9)
+                {
+                    count += snapshot.buckets[i];
+                }
+            }
+            output << "cmdpp_command_duration_seconds_bucket{" << label << ",le=\"" << bound << "\"} " << count << '\n';
+        }
+
+        output << "cmdpp_command_duration_seconds_bucket{" << label << ",le=\"+Inf\"} " << snapshot.calls << '\n'
+               << "cmdpp_command_duration_seconds_sum{" << label << "} " << std::to_string(snapshot.totalNanoseconds / 1e9) << '\n'
+               << "cmdpp_command_duration_seconds_count{" << label << "} " << snapshot.calls << '\n';
+    }
+
+    output << "# HELP cmdpp_command_read_bytes_total Bytes read by each command from its input\n"
+           << "# TYPE cmdpp_command_read_bytes_total counter\n";
+    for (const auto &snapshot : snapshots)
+    {
+        output << "cmdpp_command_read_bytes_total{command=\"" << escapeLabel(snapshot.name) << "\"} " << snapshot.bytesRead << '\n';
+    }
+
+    output << "# HELP cmdpp_command_written_bytes_total Bytes written by each command to its output\n"
+           << "# TYPE cmdpp_command_written_bytes_total counter\n";
+    for (const auto &snapshot : snapshots)
+    {
+        output << "cmdpp_command_written_bytes_total{command=\"" << escapeLabel(snapshot.name) << "\"} " << snapshot.bytesWritten << '\n';
+    }
+
+    output << "# HELP cmdpp_cache_requests_total Calls of each command looked up in the cache\n"
+           << "# TYPE cmdpp_cache_requests_total counter\n";
+    for (const auto &snapshot : snapshots)
+    {
+        if (snapshot.cacheHits + snapshot.cacheMisses > 0)
+        {
+            std::string label = "command=\"" + escapeLabel(snapshot.name) + "\"";
+            output << "cmdpp_cache_requests_total{" << label << ",result=\"hit\"} " << snapshot.cacheHits << '\n'
+                   << "cmdpp_cache_requests_total{" << label << ",result=\"miss\"} " << snapshot.cacheMisses << '\n';
+        }
+    }
+
+    output << "# HELP cmdpp_program_cpu_seconds_total CPU time of each external program\n"
+           << "# TYPE cmdpp_program_cpu_seconds_total counter\n";
+    for (const auto &snapshot : snapshots)
+    {
+        if (snapshot.programs > 0)
+        {
+            std::string label = "program=\"" + escapeLabel(snapshot.name) + "\"";
+            output << "cmdpp_program_cpu_seconds_total{" << label << ",mode=\"user\"} " << std::to_string(snapshot.usage.userSeconds) << '\n'
+                   << "cmdpp_program_cpu_seconds_total{" << label << ",mode=\"system\"} " << std::to_string(snapshot.usage.systemSeconds) << '\n';
+        }
+    }
+
+    output << "# HELP cmdpp_program_max_resident_bytes Largest resident set size of a run of each external program\n"
+           << "# TYPE cmdpp_program_max_resident_bytes gauge\n";
+    for (const auto &snapshot : snapshots)
+    {
+        if (snapshot.programs > 0)
+        {
+            output << "cmdpp_program_max_resident_bytes{program=\"" << escapeLabel(snapshot.name) << "\"} " << snapshot.usage.maxResidentBytes << '\n';
+        }
+    }
+
+    output << "# HELP cmdpp_program_page_faults_total Page faults of each external program\n"
+           << "# TYPE cmdpp_program_page_faults_total counter\n";
+    for (const auto &snapshot : snapshots)
+    {
+        if (snapshot.programs > 0)
+        {
+            std::string label = "program=\"" + escapeLabel(snapshot.name) + "\"";
+            output << "cmdpp_program_page_faults_total{" << label << ",type=\"minor\"} " << snapshot.usage.minorFaults << '\n'
+                   << "cmdpp_program_page_faults_total{" << label << ",type=\"major\"} " << snapshot.usage.majorFaults << '\n';
+        }
+    }
+
+    output << "# HELP cmdpp_program_context_switches_total Context switches of each external program\n"
+           << "# TYPE cmdpp_program_context_switches_total counter\n";
+    for (const auto &snapshot : snapshots)
+    {
+        if (snapshot.programs > 0)
+        {
+            std::string label = "program=\"" + escapeLabel(snapshot.name) + "\"";
+            output << "cmdpp_program_context_switches_total{" << label << ",type=\"voluntary\"} " << snapshot.usage.voluntarySwitches << '\n'
+                   << "cmdpp_program_context_switches_total{" << label << ",type=\"involuntary\"} " << snapshot.usage.involuntarySwitches << '\n';
+        }
+    }
+}
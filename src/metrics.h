@@ -0,0 +1,101 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "command.h"
+#include "process.h"
+
+namespace Metrics
+{
+    // Log-linear buckets : 16 per power of two, so a value is known within 6.25 %
+    constexpr unsigned subBucketBits = 4;
+    constexpr size_t subBucketCount = size_t(1) << subBucketBits;
+    constexpr size_t bucketCount = (64 - subBucketBits + 1) * subBucketCount;
+
+    size_t bucketIndex(uint64_t value);
+    uint64_t bucketLowerBound(size_t index);
+    uint64_t bucketUpperBound(size_t index);
+
+    // Calls of one command, updated with relaxed atomic operations by any thread
+    struct Recorder
+    {
+        std::string name;
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> totalNanoseconds{0};
+        std::atomic<uint64_t> maxNanoseconds{0};
+        std::atomic<uint64_t> bytesRead{0};
+        std::atomic<uint64_t> bytesWritten{0};
+        std::atomic<uint64_t> buckets[bucketCount] = {};
+
+        // Resources of the runs of an external program
+        std::atomic<uint64_t> programs{0};
+        std::atomic<uint64_t> userMicroseconds{0};
+        std::atomic<uint64_t> systemMicroseconds{0};
+        std::atomic<uint64_t> maxResidentBytes{0};
+        std::atomic<uint64_t> minorFaults{0};
+        std::atomic<uint64_t> majorFaults{0};
+        std::atomic<uint64_t> voluntarySwitches{0};
+        std::atomic<uint64_t> involuntarySwitches{0};
+
+        // Calls answered from the cache and cached calls which had to run
+        std::atomic<uint64_t> cacheHits{0};
+        std::atomic<uint64_t> cacheMisses{0};
+
+        void record(uint64_t nanoseconds, uint64_t read, uint64_t written);
+        void recordUsage(const Exe::Usage &usage);
+    };
+
+    // Copy of a recorder taken by "stats"
+    struct Snapshot
+    {
+        std::string name;
+        uint64_t calls;
+        uint64_t totalNanoseconds;
+        uint64_t maxNanoseconds;
+        uint64_t bytesRead;
+        uint64_t bytesWritten;
+        std::vector<uint64_t> buckets;
+        uint64_t programs;
+        Exe::Usage usage; // Total of the runs, largest resident size of one run
+        uint64_t cacheHits = 0;
+        uint64_t cacheMisses = 0;
+
+        double mean() const;
+        uint64_t percentile(double fraction) const;
+    };
+
+    // Recorder of a command name, created on its first use ; lookups don't lock or allocate
+    Recorder &recorder(std::string_view name);
+
+    // Bytes a command read from its input and wrote to its output, 0 when its streams can't tell
+    struct Transfer
+    {
+        uint64_t bytesRead;
+        uint64_t bytesWritten;
+    };
+
+    // Execute a built-in command and record its duration and the bytes it read from its input and wrote to its output.
+    // The command goes through the cache when it declares its inputs, or always when "cached" is set
+    Transfer executeCommand(std::string_view name, Command &command, const std::vector<Token> &arguments, std::istream &input, std::ostream &output, bool cached = false);
+
+    std::vector<Snapshot> snapshot();
+    void reset();
+
+    // Duration with the unit that keeps it readable, "12.34 ms"
+    std::string formatDuration(double nanoseconds);
+
+    // Size with a binary unit, "12.3 MiB"
+    std::string formatSize(uint64_t bytes);
+
+    void writeTable(const std::vector<Snapshot> &snapshots, std::ostream &output);
+    void writeJson(const std::vector<Snapshot> &snapshots, std::ostream &output);
+    void writePrometheus(const std::vector<Snapshot> &snapshots, std::ostream &output);
+}
+
+#endif
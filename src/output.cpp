@@ -0,0 +1,354 @@
+#include "output.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include "utils.h"
+
+using namespace Tokenizer;
+
+namespace
+{
+    bool openOutputFile(const std::string &filePath, bool append, Exe::NativeHandle &handle)
+    {
+#ifdef _WIN32
+        std::wstring wFilePath = Utils::stringToWstring(filePath);
+
+        if (append)
+        {
+            handle = CreateFileW(wFilePath.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        }
+        else
+        {
+            handle = CreateFileW(wFilePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        }
+#else
+        handle = open(filePath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+#endif
+        return handle != Exe::invalidHandle;
+    }
+}
+
+Output::Sink::Sink(size_t bufferSize) : buffer(bufferSize)
+{
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+Exe::NativeHandle Output::Sink::nativeHandle()
+{
+    return Exe::invalidHandle;
+}
+
+Output::Sink::int_type Output::Sink::overflow(int_type ch)
+{
+    if (!flushBuffer())
+    {
+        return traits_type::eof();
+    }
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+}
+
+int Output::Sink::sync()
+{
+    return flushBuffer() ? 0 : -1;
+}
+
+Output::Sink::pos_type Output::Sink::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which)
+{
+    if (offset != 0 || direction != std::ios_base::cur || !(which & std::ios_base::out))
+    {
+        return pos_type(off_type(-1));
+    }
+    return pos_type(off_type(flushed + (pptr() - pbase())));
+}
+
+bool Output::Sink::flushBuffer()
+{
+    size_t size = pptr() - pbase();
+    bool written = size == 0 || writeBlock(buffer, size);
+    flushed += size;
+
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return written;
+}
+
+Output::TerminalSink::TerminalSink(bool batch) : handle(Exe::standardOutput())
+{
+    interactive = !batch && Exe::isTerminal(handle);
+}
+
+Output::TerminalSink::~TerminalSink()
+{
+    flushBuffer();
+}
+
+Exe::NativeHandle Output::TerminalSink::nativeHandle()
+{
+    flushBuffer();
+    return handle;
+}
+
+bool Output::TerminalSink::writeBlock(std::vector<char> &block, size_t size)
+{
+    return Exe::writeHandle(handle, block.data(), size);
+}
+
+int Output::TerminalSink::sync()
+{
+    // Like the C library does for stdout, a file or a pipe is only written when the buffer is full
+    if (!interactive)
+    {
+        return 0;
+    }
+    return Sink::sync();
+}
+
+Output::FileSink::FileSink(const std::string &filePath, bool append)
+{
+    if (openOutputFile(filePath, append, handle))
+    {
+        writer = std::thread(&FileSink::writerLoop, this);
+    }
+}
+
+Output::FileSink::~FileSink()
+{
+    close();
+}
+
+bool Output::FileSink::isOpen() const
+{
+    return handle != Exe::invalidHandle;
+}
+
+bool Output::FileSink::close()
+{
+    if (!writer.joinable())
+    {
+        return !failed;
+    }
+
+    flushBuffer();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+
+    writer.join();
+    Exe::closeHandle(handle);
+
+    return !failed;
+}
+
+Exe::NativeHandle Output::FileSink::nativeHandle()
+{
+    waitIdle();
+    return handle;
+}
+
+bool Output::FileSink::writeBlock(std::vector<char> &block, size_t size)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    changed.wait(lock, [this]
+                 { return pending.size() < maxPendingBlocks || failed; });
+
+    if (failed)
+    {
+        return false;
+    }
+
+    // The full block goes to the writer thread and the command keeps filling a free one
+    Block full{std::move(block), size};
+
+    if (!freeBlocks.empty())
+    {
+        block = std::move(freeBlocks.back());
+        freeBlocks.pop_back();
+    }
+    else
+    {
+        block = std::vector<char>(full.data.size());
+    }
+
+    pending.push_back(std::move(full));
+    changed.notify_all();
+
+    return true;
+}
+
+void Output::FileSink::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        changed.wait(lock, [this]
+                     { return !pending.empty() || stopping; });
+
+        if (pending.empty())
+        {
+            break;
+        }
+
+        Block block = std::move(pending.front());
+        pending.pop_front();
+        writing = true;
+
+        lock.unlock();
+        bool written = Exe::writeHandle(handle, block.data.data(), block.size);
+        lock.lock();
+
+        writing = false;
+        if (!written)
+        {
+            failed = true;
+        }
+
+        freeBlocks.push_back(std::move(block.data));
+        changed.notify_all();
+    }
+}
+
+void Output::FileSink::waitIdle()
+{
+    flushBuffer();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]
+                 { return pending.empty() && !writing; });
+}
+
+Output::MemorySink::MemorySink(size_t limit) : Sink(4096), limit(limit)
+{
+}
+
+const std::string &Output::MemorySink::str()
+{
+    flushBuffer();
+    return content;
+}
+
+bool Output::MemorySink::exceeded() const
+{
+    return overflowed;
+}
+
+bool Output::MemorySink::writeBlock(std::vector<char> &block, size_t size)
+{
+    if (overflowed || size > limit - content.size())
+    {
+        overflowed = true;
+        return false;
+    }
+
+    content.append(block.data(), size);
+    return true;
+}
+
+Output::NullSink::NullSink() : Sink(4096)
+{
+}
+
+bool Output::NullSink::writeBlock(std::vector<char> &, size_t)
+{
+    return true;
+}
+
+Output::PipeSink::PipeSink(std::function<bool(const char *, size_t)> writeData) : Sink(16 * 1024), writeData(std::move(writeData))
+{
+}
+
+bool Output::PipeSink::writeBlock(std::vector<char> &block, size_t size)
+{
+    return writeData(block.data(), size);
+}
+
+bool Output::parseRedirection(std::vector<TokenView> &views, Redirection &redirection)
+{
+    redirection = Redirection();
+
+    for (size_t i = 0; i < views.size(); ++i)
+    {
+        if (views[i].type != TokenType::REDIRECTION)
+        {
+            continue;
+        }
+
+        if (i == 0 || i + 2 != views.size() || views[i + 1].type != TokenType::ARGUMENT)
+        {
+            std::cerr << "Usage: <command> [> | >>] <file_path>" << std::endl;
+            return false;
+        }
+
+        redirection.filePath = std::string(views[i + 1].value);
+        redirection.append = views[i].value == ">>";
+
+        views.resize(i);
+        break;
+    }
+
+    return true;
+}
+
+void Output::withRedirection(const Redirection &redirection, std::ostream &output, const std::function<void(std::ostream &)> &function)
+{
+    if (redirection.filePath.empty())
+    {
+        function(output);
+        return;
+    }
+
+    FileSink sink(redirection.filePath, redirection.append);
+    if (!sink.isOpen())
+    {
+        std::cerr << "Error opening file: " << redirection.filePath << std::endl;
+        return;
+    }
+
+    std::ostream redirected(&sink);
+    function(redirected);
+    redirected.flush();
+
+    if (!sink.close())
+    {
+        std::cerr << "Error writing to file: " << redirection.filePath << std::endl;
+    }
+}
+
+void Output::installTerminal(bool batch)
+{
+    // Restores the original buffer of std::cout before the sink is destroyed at exit
+    static struct Terminal
+    {
+        TerminalSink sink;
+        std::streambuf *previous;
+
+        explicit Terminal(bool batch) : sink(batch), previous(std::cout.rdbuf(&sink)) {}
+        ~Terminal()
+        {
+            std::cout.rdbuf(previous);
+        }
+    } terminal(batch);
+}
+
+Exe::NativeHandle Output::nativeHandle(std::ostream &stream)
+{
+    Sink *sink = dynamic_cast<Sink *>(stream.rdbuf());
+    return sink != nullptr ? sink->nativeHandle() : Exe::invalidHandle;
+}
@@ -0,0 +1,170 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "process.h"
+#include "tokenizer.h"
+
+namespace Output
+{
+    constexpr size_t defaultBufferSize = 64 * 1024;
+
+    // Buffered destination of a command output, the buffer is only written when it is full or flushed
+    class Sink : public std::streambuf
+    {
+    public:
+        explicit Sink(size_t bufferSize = defaultBufferSize);
+
+        // Handle an external program can write to directly, once everything buffered is written
+        // invalidHandle when the destination isn't backed by a file or the console
+        virtual Exe::NativeHandle nativeHandle();
+
+    protected:
+        // Write the first "size" bytes of "block", an implementation may swap it for another block of the same size
+        virtual bool writeBlock(std::vector<char> &block, size_t size) = 0;
+
+        int_type overflow(int_type ch) override;
+        int sync() override;
+
+        // Only tells the current position : the number of bytes written to the sink so far
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override;
+
+        bool flushBuffer();
+
+    private:
+        std::vector<char> buffer;
+        size_t flushed = 0; // Bytes handed to writeBlock
+    };
+
+    // Standard output of the shell, flushed on request only when it is an interactive console
+    // and the shell isn't running a stream of commands (batch)
+    class TerminalSink : public Sink
+    {
+    public:
+        explicit TerminalSink(bool batch = false);
+        ~TerminalSink() override;
+
+        Exe::NativeHandle nativeHandle() override;
+
+    protected:
+        bool writeBlock(std::vector<char> &block, size_t size) override;
+        int sync() override;
+
+    private:
+        Exe::NativeHandle handle;
+        bool interactive;
+    };
+
+    // File written by a background thread, the command only waits when several blocks are pending
+    class FileSink : public Sink
+    {
+    public:
+        FileSink(const std::string &filePath, bool append);
+        ~FileSink() override;
+
+        bool isOpen() const;
+
+        // Write everything and stop the writer thread, false if one of the writes failed
+        bool close();
+
+        Exe::NativeHandle nativeHandle() override;
+
+    protected:
+        bool writeBlock(std::vector<char> &block, size_t size) override;
+
+    private:
+        struct Block
+        {
+            std::vector<char> data;
+            size_t size;
+        };
+
+        static constexpr size_t maxPendingBlocks = 4;
+
+        void writerLoop();
+        void waitIdle();
+
+        Exe::NativeHandle handle;
+        std::deque<Block> pending;
+        std::vector<std::vector<char>> freeBlocks;
+        bool writing = false;
+        bool stopping = false;
+        bool failed = false;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::thread writer;
+    };
+
+    // Output kept in memory, up to "limit" bytes : what comes after is refused and the stream fails
+    class MemorySink : public Sink
+    {
+    public:
+        explicit MemorySink(size_t limit = SIZE_MAX);
+
+        const std::string &str();
+
+        // More than "limit" bytes were written
+        bool exceeded() const;
+
+    protected:
+        bool writeBlock(std::vector<char> &block, size_t size) override;
+
+    private:
+        std::string content;
+        size_t limit;
+        bool overflowed = false;
+    };
+
+    // Output thrown away, used when only the time a command takes matters
+    class NullSink : public Sink
+    {
+    public:
+        NullSink();
+
+    protected:
+        bool writeBlock(std::vector<char> &block, size_t size) override;
+    };
+
+    // Output feeding the next command of a pipeline
+    class PipeSink : public Sink
+    {
+    public:
+        explicit PipeSink(std::function<bool(const char *, size_t)> writeData);
+
+    protected:
+        bool writeBlock(std::vector<char> &block, size_t size) override;
+
+    private:
+        std::function<bool(const char *, size_t)> writeData;
+    };
+
+    struct Redirection
+    {
+        std::string filePath;
+        bool append = false;
+    };
+
+    // Remove a trailing "> file" or ">> file" from the tokens of a line, false if the redirection is malformed
+    bool parseRedirection(std::vector<Tokenizer::TokenView> &views, Redirection &redirection);
+
+    // Run "function" with the stream it has to write to : "output", or the file of the redirection
+    void withRedirection(const Redirection &redirection, std::ostream &output, const std::function<void(std::ostream &)> &function);
+
+    // Route std::cout through a TerminalSink until the end of the program
+    void installTerminal(bool batch = false);
+
+    Exe::NativeHandle nativeHandle(std::ostream &stream);
+}
+
+#endif
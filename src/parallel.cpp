@@ -0,0 +1,221 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    // Tasks of one call to invoke, the caller waits until none of them is left
+    struct Group
+    {
+        std::atomic<size_t> remaining{0};
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    struct Task
+    {
+        const std::function<void()> *function;
+        Group *group;
+    };
+
+    // Each worker takes the newest task of its own queue and steals the oldest task of another
+    // queue when its own is empty, threads outside of the pool push to the queues in turn
+    class WorkStealingPool
+    {
+    public:
+        WorkStealingPool() : queues(std::max(1u, std::thread::hardware_concurrency()))
+        {
+            for (size_t i = 0; i < queues.size(); ++i)
+            {
+                queues[i] = std::make_unique<Queue>();
+            }
+            for (size_t i = 0; i < queues.size(); ++i)
+            {
+                workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+            }
+        }
+
+        ~WorkStealingPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+            wakeUp.notify_all();
+
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        void push(const Task &task)
+        {
+            size_t index = workerIndex != noWorker ? workerIndex : nextQueue++ % queues.size();
+            {
+                std::lock_guard<std::mutex> lock(queues[index]->mutex);
+                queues[index]->tasks.push_back(task);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                ++queued;
+            }
+            wakeUp.notify_one();
+        }
+
+        // Run tasks until every task of the group ended
+        void help(Group &group)
+        {
+            while (group.remaining.load() > 0)
+            {
+                Task task;
+                if (take(task))
+                {
+                    execute(task);
+                    continue;
+                }
+
+                // Every task of the group is already running on another thread
+                std::unique_lock<std::mutex> lock(group.mutex);
+                group.done.wait(lock, [&group]
+                                { return group.remaining.load() == 0; });
+            }
+
+            // The thread which ended the last task may still be notifying
+            std::lock_guard<std::mutex> lock(group.mutex);
+        }
+
+        static void execute(const Task &task)
+        {
+            try
+            {
+                (*task.function)();
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << e.what() << '\n';
+            }
+
+            // Decremented under the lock, the waiting thread takes it before destroying the group
+            std::lock_guard<std::mutex> lock(task.group->mutex);
+            if (--task.group->remaining == 0)
+            {
+                task.group->done.notify_all();
+            }
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        static constexpr size_t noWorker = SIZE_MAX;
+        static thread_local size_t workerIndex;
+
+        bool take(Task &task)
+        {
+            size_t own = workerIndex != noWorker ? workerIndex : 0;
+
+            for (size_t i = 0; i < queues.size(); ++i)
+            {
+                Queue &queue = *queues[(own + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+
+                if (queue.tasks.empty())
+                {
+                    continue;
+                }
+
+                // Newest task of the own queue (still hot in cache), oldest one of the others
+                if (i == 0 && workerIndex != noWorker)
+                {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                }
+
+                std::lock_guard<std::mutex> sleepLock(sleepMutex);
+                --queued;
+                return true;
+            }
+
+            return false;
+        }
+
+        void workerLoop(size_t index)
+        {
+            workerIndex = index;
+
+            while (true)
+            {
+                Task task;
+                if (take(task))
+                {
+                    execute(task);
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wakeUp.wait(lock, [this]
+                            { return queued > 0 || stopping; });
+
+                if (stopping)
+                {
+                    return;
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> nextQueue{0};
+
+        size_t queued = 0;
+        bool stopping = false;
+        std::mutex sleepMutex;
+        std::condition_variable wakeUp;
+    };
+
+    thread_local size_t WorkStealingPool::workerIndex = WorkStealingPool::noWorker;
+
+    WorkStealingPool &pool()
+    {
+        // Only started the first time parallel work is requested
+        static WorkStealingPool instance;
+        return instance;
+    }
+}
+
+void Parallel::invoke(const std::vector<std::function<void()>> &tasks)
+{
+    if (tasks.empty())
+    {
+        return;
+    }
+
+    Group group;
+    group.remaining = tasks.size();
+
+    // The first task runs on the calling thread, the others are offered to the pool
+    for (size_t i = 1; i < tasks.size(); ++i)
+    {
+        pool().push({&tasks[i], &group});
+    }
+
+    WorkStealingPool::execute({&tasks[0], &group});
+    pool().help(group);
+}
@@ -0,0 +1,14 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+#include <vector>
+
+namespace Parallel
+{
+    // Run every task on a shared work-stealing pool and return once all of them ended
+    // The calling thread runs tasks too while it waits, so tasks can call invoke themselves
+    void invoke(const std::vector<std::function<void()>> &tasks);
+}
+
+#endif
@@ -0,0 +1,465 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+#include "metrics.h"
+#include "output.h"
+#include "process.h"
+#include "trace.h"
+
+using namespace Tokenizer;
+
+namespace
+{
+    // Size of the queue between two built-in commands, a writer waits when it is full
+    constexpr size_t channelCapacity = 64 * 1024;
+
+    // Size of the buffers used by a stage to read or write its data
+    constexpr size_t streamBufferSize = 16 * 1024;
+
+    // Bounded byte queue between two built-in commands running at the same time
+    class Channel
+    {
+    public:
+        Channel() : buffer(channelCapacity) {}
+
+        // Block while the queue is full, return false once the reading side is gone
+        bool write(const char *data, size_t size)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (size > 0)
+            {
+                notFull.wait(lock, [this]
+                             { return count < buffer.size() || readerClosed; });
+
+                if (readerClosed)
+                {
+                    return false;
+                }
+
+                size_t tail = (head + count) % buffer.size();
+                size_t chunk = std::min({size, buffer.size() - count, buffer.size() - tail});
+
+                std::memcpy(&buffer[tail], data, chunk);
+                count += chunk;
+                data += chunk;
+                size -= chunk;
+
+                notEmpty.notify_one();
+            }
+
+            return true;
+        }
+
+        // Block while the queue is empty, return 0 at the end of the data
+        size_t read(char *data, size_t size)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            notEmpty.wait(lock, [this]
+                          { return count > 0 || writerClosed; });
+
+            size_t chunk = std::min({size, count, buffer.size() - head});
+
+            std::memcpy(data, &buffer[head], chunk);
+            head = (head + chunk) % buffer.size();
+            count -= chunk;
+
+            notFull.notify_one();
+
+            return chunk;
+        }
+
+        void closeWriter()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writerClosed = true;
+            notEmpty.notify_all();
+        }
+
+        void closeReader()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            readerClosed = true;
+            notFull.notify_all();
+        }
+
+    private:
+        std::vector<char> buffer;
+        size_t head = 0;
+        size_t count = 0;
+        bool writerClosed = false;
+        bool readerClosed = false;
+
+        std::mutex mutex;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+    };
+
+    // Stream buffer filled by a read function each time it is empty
+    class BlockReader : public std::streambuf
+    {
+    public:
+        explicit BlockReader(std::function<size_t(char *, size_t)> readBlock)
+            : readBlock(std::move(readBlock)), buffer(streamBufferSize)
+        {
+            setg(buffer.data(), buffer.data(), buffer.data());
+        }
+
+    protected:
+        int_type underflow() override
+        {
+            if (gptr() < egptr())
+            {
+                return traits_type::to_int_type(*gptr());
+            }
+
+            size_t size = readBlock(buffer.data(), buffer.size());
+            if (size == 0)
+            {
+                return traits_type::eof();
+            }
+
+            consumed += egptr() - eback();
+            setg(buffer.data(), buffer.data(), buffer.data() + size);
+            return traits_type::to_int_type(*gptr());
+        }
+
+        // Only tells the current position : the number of bytes the command read so far
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override
+        {
+            if (offset != 0 || direction != std::ios_base::cur || !(which & std::ios_base::in))
+            {
+                return pos_type(off_type(-1));
+            }
+            return pos_type(off_type(consumed + (gptr() - eback())));
+        }
+
+    private:
+        std::function<size_t(char *, size_t)> readBlock;
+        std::vector<char> buffer;
+        size_t consumed = 0; // Bytes of the blocks already read entirely
+    };
+
+    // Connection between a stage and the next one : an in-memory channel between two built-in
+    // commands, an OS pipe as soon as one of them is an external program
+    struct Link
+    {
+        std::unique_ptr<Channel> channel;
+        Exe::NativeHandle readEnd = Exe::invalidHandle;
+        Exe::NativeHandle writeEnd = Exe::invalidHandle;
+    };
+
+    void ignoreBrokenPipes()
+    {
+#ifndef _WIN32
+        // A stage writing to a program which already exited gets an error instead of killing the shell
+        static bool ignored = []()
+        {
+            signal(SIGPIPE, SIG_IGN);
+            return true;
+        }();
+        (void)ignored;
+#endif
+    }
+
+    void runBuiltin(const Pipeline::Stage &stage, Link *inputLink, Link *outputLink, std::istream &input, std::ostream &output)
+    {
+        std::unique_ptr<BlockReader> reader;
+        std::unique_ptr<Output::PipeSink> writer;
+        std::istream stageInput(nullptr);
+        std::ostream stageOutput(nullptr);
+
+        if (inputLink != nullptr && inputLink->channel)
+        {
+            Channel *channel = inputLink->channel.get();
+            reader = std::make_unique<BlockReader>([channel](char *data, size_t size)
+                                                   { return channel->read(data, size); });
+        }
+        else if (inputLink != nullptr)
+        {
+            Exe::NativeHandle handle = inputLink->readEnd;
+            reader = std::make_unique<BlockReader>([handle](char *data, size_t size)
+                                                   { return Exe::readHandle(handle, data, size); });
+        }
+
+        if (outputLink != nullptr && outputLink->channel)
+        {
+            Channel *channel = outputLink->channel.get();
+            writer = std::make_unique<Output::PipeSink>([channel](const char *data, size_t size)
+                                                        { return channel->write(data, size); });
+        }
+        else if (outputLink != nullptr)
+        {
+            Exe::NativeHandle handle = outputLink->writeEnd;
+            writer = std::make_unique<Output::PipeSink>([handle](const char *data, size_t size)
+                                                        { return Exe::writeHandle(handle, data, size); });
+        }
+
+        stageInput.rdbuf(reader ? static_cast<std::streambuf *>(reader.get()) : input.rdbuf());
+        stageOutput.rdbuf(writer ? static_cast<std::streambuf *>(writer.get()) : output.rdbuf());
+
+        try
+        {
+            if (stage.command != nullptr)
+            {
+                Metrics::executeCommand(stage.name, *stage.command, stage.arguments, stageInput, stageOutput);
+            }
+            else
+            {
+                std::cerr << "Unknown command: " << stage.name << std::endl;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+
+        stageOutput.flush();
+
+        // Closing both sides lets the next stage see the end of the data and the previous one stop writing
+        if (outputLink != nullptr && outputLink->channel)
+        {
+            outputLink->channel->closeWriter();
+        }
+        else if (outputLink != nullptr)
+        {
+            Exe::closeHandle(outputLink->writeEnd);
+        }
+
+        if (inputLink != nullptr && inputLink->channel)
+        {
+            inputLink->channel->closeReader();
+        }
+        else if (inputLink != nullptr)
+        {
+            Exe::closeHandle(inputLink->readEnd);
+        }
+    }
+
+    void closeLinks(std::vector<Link> &links)
+    {
+        for (auto &link : links)
+        {
+            Exe::closeHandle(link.readEnd);
+            Exe::closeHandle(link.writeEnd);
+        }
+    }
+}
+
+bool Pipeline::isPipeline(const std::vector<TokenView> &views)
+{
+    return std::any_of(views.begin(), views.end(), [](const TokenView &view)
+                       { return view.type == TokenType::PIPE; });
+}
+
+bool Pipeline::split(const std::vector<TokenView> &views, const CommandRegistry &commandRegistry, std::vector<Stage> &stages)
+{
+    stages.clear();
+
+    size_t first = 0;
+    for (size_t i = 0; i <= views.size(); ++i)
+    {
+        if (i < views.size() && views[i].type != TokenType::PIPE)
+        {
+            continue;
+        }
+
+        if (i == first)
+        {
+            std::cerr << "Missing command in pipeline" << std::endl;
+            return false;
+        }
+
+        Stage stage;
+        stage.name = std::string(views[first].value);
+        stage.command = commandRegistry.getCommand(stage.name);
+
+        for (size_t j = first + 1; j < i; ++j)
+        {
+            stage.arguments.push_back({views[j].type, std::string(views[j].value)});
+        }
+
+        stages.push_back(std::move(stage));
+        first = i + 1;
+    }
+
+    return true;
+}
+
+Exe::Usage Pipeline::run(const std::vector<Stage> &stages, std::istream &input, std::ostream &output)
+{
+    Exe::Usage usage;
+
+    if (stages.empty())
+    {
+        return usage;
+    }
+
+    ignoreBrokenPipes();
+
+    size_t count = stages.size();
+
+    std::vector<bool> external(count);
+    std::vector<std::string> filePaths(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        external[i] = stages[i].command == nullptr && Exe::resolveExecutable(stages[i].name, filePaths[i]);
+    }
+
+    // links[i] joins stages[i] to stages[i + 1]
+    std::vector<Link> links(count - 1);
+    for (size_t i = 0; i + 1 < count; ++i)
+    {
+        if (!external[i] && !external[i + 1])
+        {
+            links[i].channel = std::make_unique<Channel>();
+        }
+        else if (!Exe::createPipe(links[i].readEnd, links[i].writeEnd))
+        {
+            std::cerr << "Failed to create a pipe between " << stages[i].name << " and " << stages[i + 1].name << std::endl;
+            closeLinks(links);
+            return usage;
+        }
+    }
+
+    // External programs at the ends of the pipeline use the console, or the file or console behind
+    // the output sink, directly ; anything else goes through a pipe
+    Exe::NativeHandle firstInput = Exe::invalidHandle;
+    Exe::NativeHandle feedEnd = Exe::invalidHandle;
+    Exe::NativeHandle lastOutput = Exe::invalidHandle;
+    Exe::NativeHandle drainEnd = Exe::invalidHandle;
+    bool borrowedOutput = false;
+
+    if (external[0] && &input != &std::cin)
+    {
+        Exe::createPipe(firstInput, feedEnd);
+    }
+    if (external[count - 1])
+    {
+        lastOutput = Output::nativeHandle(output);
+        borrowedOutput = lastOutput != Exe::invalidHandle;
+
+        if (!borrowedOutput && &output != &std::cout)
+        {
+            Exe::createPipe(drainEnd, lastOutput);
+        }
+    }
+
+    // Programs are timed from their start to the moment the shell collects them
+    struct Started
+    {
+        Exe::Process process;
+        const Pipeline::Stage *stage;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    std::vector<Started> processes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!external[i])
+        {
+            continue;
+        }
+
+        Exe::NativeHandle &stageInput = i > 0 ? links[i - 1].readEnd : firstInput;
+        Exe::NativeHandle &stageOutput = i + 1 < count ? links[i].writeEnd : lastOutput;
+
+        std::vector<std::string> arguments{filePaths[i]};
+        for (const auto &argument : stages[i].arguments)
+        {
+            arguments.push_back(argument.value);
+        }
+
+        Exe::Process process;
+        if (Exe::spawn(arguments, stageInput, stageOutput, process))
+        {
+            processes.push_back({process, &stages[i], std::chrono::steady_clock::now()});
+        }
+
+        // The child holds its own copy of its ends, a borrowed output stays open for its owner
+        Exe::closeHandle(stageInput);
+        if (i + 1 < count || !borrowedOutput)
+        {
+            Exe::closeHandle(stageOutput);
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (external[i])
+        {
+            continue;
+        }
+
+        Link *inputLink = i > 0 ? &links[i - 1] : nullptr;
+        Link *outputLink = i + 1 < count ? &links[i] : nullptr;
+
+        threads.emplace_back(runBuiltin, std::cref(stages[i]), inputLink, outputLink, std::ref(input), std::ref(output));
+    }
+
+    if (feedEnd != Exe::invalidHandle)
+    {
+        threads.emplace_back([&input, &feedEnd]()
+                             {
+                                 char buffer[streamBufferSize];
+                                 while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0)
+                                 {
+                                     if (!Exe::writeHandle(feedEnd, buffer, static_cast<size_t>(input.gcount())))
+                                     {
+                                         break;
+                                     }
+                                 }
+                                 Exe::closeHandle(feedEnd); });
+    }
+
+    if (drainEnd != Exe::invalidHandle)
+    {
+        std::vector<char> buffer(streamBufferSize);
+        size_t size;
+        while ((size = Exe::readHandle(drainEnd, buffer.data(), buffer.size())) > 0)
+        {
+            // Once the output refuses data the pipe is closed, the program stops on its next write
+            if (!output.write(buffer.data(), size))
+            {
+                break;
+            }
+        }
+        Exe::closeHandle(drainEnd);
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    for (auto &started : processes)
+    {
+        Exe::Usage programUsage;
+        Exe::wait(started.process, &programUsage);
+        usage.add(programUsage);
+
+        auto end = std::chrono::steady_clock::now();
+        Metrics::Recorder &recorder = Metrics::recorder(started.stage->name);
+        recorder.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - started.start).count(), 0, 0);
+        recorder.recordUsage(programUsage);
+        Trace::asyncSpan("process", started.stage->name, started.start, end);
+    }
+
+    closeLinks(links);
+    return usage;
+}
@@ -0,0 +1,30 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "command.h"
+#include "process.h"
+#include "registry.h"
+#include "tokenizer.h"
+
+namespace Pipeline
+{
+    struct Stage
+    {
+        std::string name;
+        Command *command; // nullptr when the stage isn't a built-in command
+        std::vector<Token> arguments;
+    };
+
+    bool isPipeline(const std::vector<TokenView> &views);
+    bool split(const std::vector<TokenView> &views, const CommandRegistry &commandRegistry, std::vector<Stage> &stages);
+
+    // Run every stage at the same time, each one reading what the previous one writes ;
+    // returns the resources used by the external programs of the pipeline
+    Exe::Usage run(const std::vector<Stage> &stages, std::istream &input, std::ostream &output);
+}
+
+#endif
@@ -0,0 +1,584 @@
+#include "process.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <cerrno>
+#endif
+
+#include "utils.h"
+#include "variables.h"
+
+using namespace Utils;
+
+void Exe::Usage::add(const Usage &other)
+{
+    userSeconds += other.userSeconds;
+    systemSeconds += other.systemSeconds;
+    maxResidentBytes = std::max(maxResidentBytes, other.maxResidentBytes);
+    minorFaults += other.minorFaults;
+    majorFaults += other.majorFaults;
+    voluntarySwitches += other.voluntarySwitches;
+    involuntarySwitches += other.involuntarySwitches;
+}
+
+#ifdef _WIN32
+const Exe::NativeHandle Exe::invalidHandle = INVALID_HANDLE_VALUE;
+
+namespace
+{
+    double fileTimeSeconds(const FILETIME &time)
+    {
+        return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+    }
+
+    bool fileExists(const std::wstring &filePath)
+    {
+        DWORD attributes = GetFileAttributesW(filePath.c_str());
+        return (attributes != INVALID_FILE_ATTRIBUTES) && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+    }
+
+    bool hasExeExtension(const std::wstring &filePath)
+    {
+        size_t dotPosition = filePath.find_last_of(L'.');
+        if (dotPosition != std::wstring::npos)
+        {
+            std::wstring extension = filePath.substr(dotPosition + 1);
+            return extension == L"exe";
+        }
+        return false;
+    }
+
+    std::wstring buildCommandLine(const std::vector<std::string> &arguments)
+    {
+        std::wstring commandLine;
+
+        for (const auto &argument : arguments)
+        {
+            std::wstring wArgument = stringToWstring(argument);
+
+            if (!commandLine.empty())
+            {
+                commandLine += L' ';
+            }
+
+            if (wArgument.empty() || wArgument.find_first_of(L" \t\"") != std::wstring::npos)
+            {
+                commandLine += L'"';
+                for (wchar_t c : wArgument)
+                {
+                    if (c == L'"')
+                    {
+                        commandLine += L'\\';
+                    }
+                    commandLine += c;
+                }
+                commandLine += L'"';
+            }
+            else
+            {
+                commandLine += wArgument;
+            }
+        }
+
+        return commandLine;
+    }
+
+    void setInheritable(HANDLE handle, bool inheritable)
+    {
+        if (handle != INVALID_HANDLE_VALUE)
+        {
+            SetHandleInformation(handle, HANDLE_FLAG_INHERIT, inheritable ? HANDLE_FLAG_INHERIT : 0);
+        }
+    }
+}
+
+Exe::NativeHandle Exe::standardInput()
+{
+    return GetStdHandle(STD_INPUT_HANDLE);
+}
+
+Exe::NativeHandle Exe::standardOutput()
+{
+    return GetStdHandle(STD_OUTPUT_HANDLE);
+}
+
+bool Exe::isTerminal(NativeHandle handle)
+{
+    return GetFileType(handle) == FILE_TYPE_CHAR;
+}
+
+bool Exe::isExecutable(const std::string &filePath)
+{
+    std::wstring wFilePath = stringToWstring(filePath);
+    return fileExists(wFilePath) && hasExeExtension(wFilePath);
+}
+
+bool Exe::createPipe(NativeHandle &readEnd, NativeHandle &writeEnd)
+{
+    return CreatePipe(&readEnd, &writeEnd, NULL, 0) != FALSE;
+}
+
+void Exe::closeHandle(NativeHandle &handle)
+{
+    if (handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+size_t Exe::readHandle(NativeHandle handle, char *data, size_t size)
+{
+    DWORD bytesRead = 0;
+
+    // A broken pipe means the writing side is closed, it is reported as the end of the data
+    if (!ReadFile(handle, data, static_cast<DWORD>(size), &bytesRead, NULL))
+    {
+        return 0;
+    }
+    return bytesRead;
+}
+
+bool Exe::writeHandle(NativeHandle handle, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        DWORD bytesWritten = 0;
+        if (!WriteFile(handle, data, static_cast<DWORD>(size), &bytesWritten, NULL))
+        {
+            return false;
+        }
+        data += bytesWritten;
+        size -= bytesWritten;
+    }
+    return true;
+}
+
+bool Exe::spawn(const std::vector<std::string> &arguments, NativeHandle input, NativeHandle output, Process &process)
+{
+    std::wstring commandLine = buildCommandLine(arguments);
+
+    STARTUPINFOW startupInfo = {sizeof(STARTUPINFOW)};
+    PROCESS_INFORMATION processInfo;
+
+    startupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startupInfo.hStdInput = input != INVALID_HANDLE_VALUE ? input : GetStdHandle(STD_INPUT_HANDLE);
+    startupInfo.hStdOutput = output != INVALID_HANDLE_VALUE ? output : GetStdHandle(STD_OUTPUT_HANDLE);
+    startupInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+    // Only the ends given to this child are inheritable while it is created
+    setInheritable(input, true);
+    setInheritable(output, true);
+
+    // Only the exported variables of the console, the block is shared until one of them changes
+    std::shared_ptr<const Variables::Environment> environment = Variables::environment();
+
+    BOOL created = CreateProcessW(NULL, &commandLine[0], NULL, NULL, TRUE, CREATE_UNICODE_ENVIRONMENT,
+                                  const_cast<wchar_t *>(environment->block.data()), NULL, &startupInfo, &processInfo);
+
+    setInheritable(input, false);
+    setInheritable(output, false);
+
+    if (!created)
+    {
+        std::cerr << "Failed to execute command: " << arguments[0] << std::endl;
+        return false;
+    }
+
+    CloseHandle(processInfo.hThread);
+    process.handle = processInfo.hProcess;
+
+    return true;
+}
+
+int Exe::wait(Process &process, Usage *usage)
+{
+    DWORD exitCode = 1;
+
+    if (process.handle != NULL)
+    {
+        WaitForSingleObject(process.handle, INFINITE);
+        GetExitCodeProcess(process.handle, &exitCode);
+
+        if (usage != nullptr)
+        {
+            *usage = Usage();
+
+            FILETIME creation, exit, kernel, user;
+            if (GetProcessTimes(process.handle, &creation, &exit, &kernel, &user))
+            {
+                usage->userSeconds = fileTimeSeconds(user);
+                usage->systemSeconds = fileTimeSeconds(kernel);
+            }
+
+            PROCESS_MEMORY_COUNTERS memory;
+            if (GetProcessMemoryInfo(process.handle, &memory, sizeof(memory)))
+            {
+                usage->maxResidentBytes = memory.PeakWorkingSetSize;
+                usage->minorFaults = memory.PageFaultCount;
+            }
+        }
+
+        CloseHandle(process.handle);
+        process.handle = NULL;
+    }
+
+    return static_cast<int>(exitCode);
+}
+#else
+const Exe::NativeHandle Exe::invalidHandle = -1;
+
+Exe::NativeHandle Exe::standardInput()
+{
+    return STDIN_FILENO;
+}
+
+Exe::NativeHandle Exe::standardOutput()
+{
+    return STDOUT_FILENO;
+}
+
+bool Exe::isTerminal(NativeHandle handle)
+{
+    return isatty(handle) != 0;
+}
+
+bool Exe::isExecutable(const std::string &filePath)
+{
+    struct stat info;
+    return stat(filePath.c_str(), &info) == 0 && S_ISREG(info.st_mode) && access(filePath.c_str(), X_OK) == 0;
+}
+
+bool Exe::createPipe(NativeHandle &readEnd, NativeHandle &writeEnd)
+{
+    int fds[2];
+
+#ifdef __linux__
+    if (pipe2(fds, O_CLOEXEC) != 0)
+    {
+        return false;
+    }
+#else
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+    readEnd = fds[0];
+    writeEnd = fds[1];
+    return true;
+}
+
+void Exe::closeHandle(NativeHandle &handle)
+{
+    if (handle != -1)
+    {
+        close(handle);
+        handle = -1;
+    }
+}
+
+size_t Exe::readHandle(NativeHandle handle, char *data, size_t size)
+{
+    while (true)
+    {
+        ssize_t bytesRead = read(handle, data, size);
+        if (bytesRead >= 0)
+        {
+            return static_cast<size_t>(bytesRead);
+        }
+        if (errno != EINTR)
+        {
+            return 0;
+        }
+    }
+}
+
+bool Exe::writeHandle(NativeHandle handle, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t bytesWritten = write(handle, data, size);
+        if (bytesWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += bytesWritten;
+        size -= static_cast<size_t>(bytesWritten);
+    }
+    return true;
+}
+
+bool Exe::spawn(const std::vector<std::string> &arguments, NativeHandle input, NativeHandle output, Process &process)
+{
+    std::vector<char *> argv;
+    for (const auto &argument : arguments)
+    {
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    // posix_spawn shares the memory of the shell with the child until it executes the program (vfork),
+    // where fork would copy the page tables of the whole shell for every program started
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (input != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, input, STDIN_FILENO);
+    }
+    if (output != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, output, STDOUT_FILENO);
+    }
+
+    // The shell ignores SIGPIPE for its pipelines, the child gets the default behaviour back
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+
+    sigset_t defaultSignals;
+    sigemptyset(&defaultSignals);
+    sigaddset(&defaultSignals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+
+    short flags = POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_setflags(&attributes, flags);
+
+    // Only the exported variables of the console, the block is shared until one of them changes
+    std::shared_ptr<const Variables::Environment> environment = Variables::environment();
+
+    pid_t childPid;
+    int error = posix_spawn(&childPid, argv[0], &actions, &attributes, argv.data(), environment->pointers.data());
+
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (error != 0)
+    {
+        std::cerr << "Failed to execute command: " << arguments[0] << std::endl;
+        return false;
+    }
+
+    process.pid = childPid;
+    return true;
+}
+
+int Exe::wait(Process &process, Usage *usage)
+{
+    int status = 0;
+    struct rusage resources{};
+
+    if (process.pid == -1)
+    {
+        return 1;
+    }
+
+    while (wait4(process.pid, &status, 0, &resources) == -1)
+    {
+        if (errno != EINTR)
+        {
+            process.pid = -1;
+            return 1;
+        }
+    }
+    process.pid = -1;
+
+    if (usage != nullptr)
+    {
+        usage->userSeconds = resources.ru_utime.tv_sec + resources.ru_utime.tv_usec / 1e6;
+        usage->systemSeconds = resources.ru_stime.tv_sec + resources.ru_stime.tv_usec / 1e6;
+        usage->maxResidentBytes = static_cast<uint64_t>(resources.ru_maxrss) * 1024; // Kilobytes on Linux
+        usage->minorFaults = resources.ru_minflt;
+        usage->majorFaults = resources.ru_majflt;
+        usage->voluntarySwitches = resources.ru_nvcsw;
+        usage->involuntarySwitches = resources.ru_nivcsw;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    constexpr char pathSeparator = ';';
+#else
+    constexpr char pathSeparator = ':';
+#endif
+
+    // Time between two checks of the directories, a program added to one of them is found at most this late
+    constexpr std::chrono::milliseconds stampCheckInterval(1000);
+
+    // Executables found in the current directory and the directories of PATH, in the order they are searched.
+    // A directory is modified when a file is added, removed or renamed in it, which is when its lookups can change
+    struct ExecutableCache
+    {
+        std::mutex mutex;
+        bool valid = false;
+        std::string path;          // Value of PATH the directories come from
+        uint64_t variablesVersion = 0; // PATH is only read again once a variable changed
+        std::vector<std::string> directories;
+        std::vector<std::filesystem::file_time_type> stamps;
+        std::unordered_map<std::string, std::string> entries; // Command name -> path of its executable, empty if none
+        std::chrono::steady_clock::time_point checked;
+
+        void reset(const std::string &currentPath)
+        {
+            path = currentPath;
+            directories.assign(1, ".");
+
+            size_t start = 0;
+            while (start <= path.size())
+            {
+                size_t end = path.find(pathSeparator, start);
+                if (end == std::string::npos)
+                {
+                    end = path.size();
+                }
+
+                // An empty entry is the current directory, already searched first
+                if (end > start)
+                {
+                    directories.push_back(path.substr(start, end - start));
+                }
+                start = end + 1;
+            }
+
+            stamps.resize(directories.size());
+            for (size_t i = 0; i < directories.size(); ++i)
+            {
+                stamps[i] = stamp(directories[i]);
+            }
+
+            entries.clear();
+            checked = std::chrono::steady_clock::now();
+            valid = true;
+        }
+
+        // True while none of the directories changed since they were listed
+        bool unchanged() const
+        {
+            for (size_t i = 0; i < directories.size(); ++i)
+            {
+                if (stamp(directories[i]) != stamps[i])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::string search(const std::string &name) const
+        {
+            for (size_t i = 0; i < directories.size(); ++i)
+            {
+                std::string candidate = (std::filesystem::path(directories[i]) / name).string();
+                if (Exe::isExecutable(candidate))
+                {
+                    return candidate;
+                }
+#ifdef _WIN32
+                if (std::filesystem::path(name).extension().empty() && Exe::isExecutable(candidate + ".exe"))
+                {
+                    return candidate + ".exe";
+                }
+#endif
+            }
+            return "";
+        }
+
+        static std::filesystem::file_time_type stamp(const std::string &directory)
+        {
+            std::error_code error;
+            return std::filesystem::last_write_time(directory, error);
+        }
+    };
+
+    ExecutableCache &executableCache()
+    {
+        static ExecutableCache cache;
+        return cache;
+    }
+}
+
+bool Exe::resolveExecutable(const std::string &name, std::string &filePath)
+{
+    if (name.empty())
+    {
+        return false;
+    }
+
+    if (name.find('/') != std::string::npos || name.find('\\') != std::string::npos)
+    {
+        filePath = name;
+        return isExecutable(name);
+    }
+
+    ExecutableCache &cache = executableCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    uint64_t variablesVersion = Variables::version();
+    if (!cache.valid || cache.variablesVersion != variablesVersion)
+    {
+        std::string path;
+        Variables::get("PATH", path);
+        if (!cache.valid || cache.path != path)
+        {
+            cache.reset(path);
+        }
+        cache.variablesVersion = variablesVersion;
+    }
+
+    // Checking every directory costs as much as searching them, it is only done from time to time
+    auto now = std::chrono::steady_clock::now();
+    if (now - cache.checked >= stampCheckInterval)
+    {
+        if (!cache.unchanged())
+        {
+            cache.reset(cache.path);
+        }
+        cache.checked = now;
+    }
+
+    auto entry = cache.entries.find(name);
+    if (entry == cache.entries.end())
+    {
+        entry = cache.entries.emplace(name, cache.search(name)).first;
+    }
+
+    filePath = entry->second;
+    return !filePath.empty();
+}
+
+void Exe::invalidateExecutableCache()
+{
+    ExecutableCache &cache = executableCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.valid = false;
+}
@@ -0,0 +1,78 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+namespace Exe
+{
+#ifdef _WIN32
+    typedef HANDLE NativeHandle;
+#else
+    typedef int NativeHandle;
+#endif
+
+    // Value of a pipe end which is not (or no longer) open
+    extern const NativeHandle invalidHandle;
+
+    struct Process
+    {
+#ifdef _WIN32
+        HANDLE handle = NULL;
+#else
+        pid_t pid = -1;
+#endif
+    };
+
+    // Resources used by a program until it ended
+    struct Usage
+    {
+        double userSeconds = 0;
+        double systemSeconds = 0;
+        uint64_t maxResidentBytes = 0;
+        uint64_t minorFaults = 0; // Every page fault on Windows, which doesn't tell the major ones apart
+        uint64_t majorFaults = 0;
+        uint64_t voluntarySwitches = 0; // Context switches, not available on Windows
+        uint64_t involuntarySwitches = 0;
+
+        // Add the usage of another program running at the same time, the largest resident size is kept
+        void add(const Usage &other);
+    };
+
+    NativeHandle standardInput();
+    NativeHandle standardOutput();
+
+    // True for an interactive console, false for a file or a pipe
+    bool isTerminal(NativeHandle handle);
+
+    bool isExecutable(const std::string &filePath);
+
+    // Path of the executable a command name refers to : the name itself when it contains a directory,
+    // otherwise the first match in the current directory then in the directories of PATH.
+    // Lookups are cached until one of these directories is modified or PATH changes
+    bool resolveExecutable(const std::string &name, std::string &filePath);
+
+    // Forget the cached lookups, needed when the current directory changes
+    void invalidateExecutableCache();
+
+    // Pipes are created non inheritable, spawn only hands the requested ends to the child
+    bool createPipe(NativeHandle &readEnd, NativeHandle &writeEnd);
+    void closeHandle(NativeHandle &handle);
+    size_t readHandle(NativeHandle handle, char *data, size_t size);
+    bool writeHandle(NativeHandle handle, const char *data, size_t size);
+
+    // Start an executable, invalidHandle as input or output keeps the one of the console ;
+    // arguments[0] is the path of the executable
+    bool spawn(const std::vector<std::string> &arguments, NativeHandle input, NativeHandle output, Process &process);
+    // Exit code of the program, and the resources it used when "usage" is given
+    int wait(Process &process, Usage *usage = nullptr);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include "registry.h"
+
+namespace
+{
+    constexpr std::array<CommandEntry, 37> builtinCommands{{
+        {"echo", makeCommand<EchoCommand>},
+        {"cd", makeCommand<CdCommand>},
+        {"assoc", makeCommand<AssocCommand>},
+        {"cls", makeCommand<ClsCommand>},
+        {"cmd", makeCommand<CmdCommand>},
+        {"cmd++", makeCommand<CmdCommand>},
+        {"color", makeCommand<ColorCommand>},
+        {"comp", makeCommand<CompCommand>},
+        {"fc", makeCommand<CompCommand>},
+        {"copy", makeCommand<CopyCommand>},
+        {"time", makeCommand<TimeCommand>},
+        {"timer", makeCommand<TimerCommand>},
+        {"lsof", makeCommand<LsofCommand>},
+        {"memadrs", makeCommand<MemadrsCommand>},
+        {"memstats", makeCommand<MemstatsCommand>},
+        {"rma", makeCommand<RmaCommand>}, // WIP
+        {"hexdump", makeCommand<HexdumpCommand>},
+        {"findstr", makeCommand<ExtractstrCommand>},
+        {"xml", makeCommand<XmlCommand>},
+        {"encoding", makeCommand<EncodingCommand>},
+        {"gpw", makeCommand<PasswordCommand>},
+        {"quicksearch", makeCommand<QuicksearchCommand>},
+        {"qs", makeCommand<QuicksearchCommand>},
+        {"clc", makeCommand<CalculatorCommand>},
+        {"kill", makeCommand<KillCommand>},
+        {"random", makeCommand<RandomCommand>},
+        {"envvar", makeCommand<EnvvarCommand>},
+        {"rem", makeCommand<RemCommand>},
+        {"schema", makeCommand<SchemaCommand>},
+        {"jobs", makeCommand<JobsCommand>},
+        {"wait", makeCommand<WaitCommand>},
+        {"fg", makeCommand<FgCommand>},
+        {"bench", makeCommand<BenchCommand>},
+        {"stats", makeCommand<StatsCommand>},
+        {"trace", makeCommand<TraceCommand>},
+        {"profile", makeCommand<ProfileCommand>},
+        {"cache", makeCommand<CacheCommand>},
+    }};
+
+    constexpr auto builtinTable = Registry::buildPerfectHash(builtinCommands);
+    static_assert(builtinTable.seed != 0, "Every built-in command needs a distinct name");
+}
+
+CommandRegistry::CommandRegistry() : CommandRegistry(builtinTable)
+{
+}
@@ -0,0 +1,141 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "command.h"
+
+// Name of a command and the function creating it the first time it is used
+struct CommandEntry
+{
+    std::string_view name;
+    std::unique_ptr<Command> (*create)();
+};
+
+template <typename T>
+std::unique_ptr<Command> makeCommand()
+{
+    return std::make_unique<T>();
+}
+
+namespace Registry
+{
+    constexpr size_t emptySlot = SIZE_MAX;
+
+    constexpr uint32_t hashName(std::string_view name, uint32_t seed)
+    {
+        // FNV-1a with the seed mixed in the initial state, then a finalizer spreading it to the low bits
+        uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (char character : name)
+        {
+            hash ^= static_cast<unsigned char>(character);
+            hash *= 16777619u;
+        }
+        hash ^= hash >> 15;
+        hash *= 0x2C1B3C6Du;
+        hash ^= hash >> 12;
+        return hash;
+    }
+
+    // Power of two with at least 4 slots per name, so a collision free seed is found quickly
+    constexpr size_t tableSize(size_t count)
+    {
+        size_t size = 1;
+        while (size < count * 4)
+        {
+            size *= 2;
+        }
+        return size;
+    }
+
+    // Names of the entries hashed to their own slot : a lookup is one hash and one comparison
+    template <size_t Count, size_t Size = tableSize(Count)>
+    struct PerfectHash
+    {
+        std::array<CommandEntry, Count> entries{};
+        std::array<size_t, Size> slots{};
+        uint32_t seed = 0; // 0 when no seed separates every name (a duplicated name)
+    };
+
+    template <size_t Count>
+    constexpr PerfectHash<Count> buildPerfectHash(const std::array<CommandEntry, Count> &entries)
+    {
+        constexpr size_t size = tableSize(Count);
+
+        PerfectHash<Count> table;
+        table.entries = entries;
+
+        for (uint32_t seed = 1; seed < 100000; ++seed)
+        {
+            for (auto &slot : table.slots)
+            {
+                slot = emptySlot;
+            }
+
+            bool collision = false;
+            for (size_t i = 0; i < Count && !collision; ++i)
+            {
+                size_t slot = hashName(entries[i].name, seed) & (size - 1);
+                collision = table.slots[slot] != emptySlot;
+                table.slots[slot] = i;
+            }
+
+            if (!collision)
+            {
+                table.seed = seed;
+                return table;
+            }
+        }
+
+        return table;
+    }
+}
+
+class CommandRegistry
+{
+public:
+    // Registry of the built-in commands of the console
+    CommandRegistry();
+
+    template <size_t Count, size_t Size>
+    explicit CommandRegistry(const Registry::PerfectHash<Count, Size> &table)
+        : entries(table.entries.data()), count(Count), slots(table.slots.data()), mask(Size - 1), seed(table.seed),
+          instances(Count), constructed(new std::once_flag[Count])
+    {
+    }
+
+    // nullptr when the name isn't a built-in command, the command is created on its first lookup
+    Command *getCommand(std::string_view name) const
+    {
+        size_t index = slots[Registry::hashName(name, seed) & mask];
+
+        if (index == Registry::emptySlot || entries[index].name != name)
+        {
+            return nullptr;
+        }
+
+        std::call_once(constructed[index], [this, index]()
+                       {
+                           instances[index] = entries[index].create();
+                           instances[index]->commandRegistry = this; });
+
+        return instances[index].get();
+    }
+
+private:
+    const CommandEntry *entries;
+    size_t count;
+    const size_t *slots;
+    size_t mask;
+    uint32_t seed;
+
+    mutable std::vector<std::unique_ptr<Command>> instances;
+    std::unique_ptr<std::once_flag[]> constructed;
+};
+
+#endif
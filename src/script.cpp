@@ -0,0 +1,808 @@
+#include "script.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <regex>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include "jobs.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "shell.h"
+#include "trace.h"
+#include "variables.h"
+
+using namespace Tokenizer;
+
+namespace
+{
+    struct SourceLine
+    {
+        size_t number;
+        std::string text;
+    };
+
+    void emitLine(const SourceLine &source, const CommandRegistry &commandRegistry, Script::Program &program)
+    {
+        std::vector<TokenView> views;
+        scan(source.text, views);
+
+        // Blank lines produce no instruction
+        if (views.empty())
+        {
+            return;
+        }
+
+        bool background;
+        Output::Redirection redirection;
+        if (!Jobs::parseBackground(views, background) || !Output::parseRedirection(views, redirection))
+        {
+            std::cerr << "Line " << source.number << " ignored" << std::endl;
+            return;
+        }
+
+        Script::Instruction instruction{Script::OpCode::CALL, nullptr, {}, 0, source.number, std::string(views[0].value)};
+        instruction.redirection = std::move(redirection);
+
+        instruction.background = background;
+        instruction.commandLine = background ? source.text.substr(0, source.text.rfind('&')) : source.text;
+        instruction.commandLine.erase(instruction.commandLine.find_last_not_of(" \t\r") + 1);
+        instruction.commandLine.erase(0, instruction.commandLine.find_first_not_of(" \t"));
+        instruction.expand = instruction.commandLine.find('$') != std::string::npos;
+
+        // The words of a line with a command substitution are only known once the substitution ran
+        bool isGoto = instruction.name == "goto" || instruction.name == "pgoto";
+        if (!isGoto && instruction.commandLine.find("$(") != std::string::npos)
+        {
+            instruction.substitute = true;
+            program.instructions.push_back(std::move(instruction));
+            return;
+        }
+
+        if (Pipeline::isPipeline(views))
+        {
+            instruction.op = Script::OpCode::PIPELINE;
+
+            if (Pipeline::split(views, commandRegistry, instruction.stages))
+            {
+                program.instructions.push_back(std::move(instruction));
+            }
+            return;
+        }
+
+        toTokens(views, 1, instruction.arguments);
+        instruction.command = commandRegistry.getCommand(instruction.name);
+
+        if (instruction.command == nullptr)
+        {
+            if (isGoto && instruction.background)
+            {
+                std::cerr << "Line " << source.number << " : " << instruction.name << " can't run in the background, \"&\" ignored" << std::endl;
+            }
+
+            if (instruction.name == "goto" && !instruction.arguments.empty())
+            {
+                // The target is resolved once every section has been emitted
+                instruction.op = Script::OpCode::GOTO;
+                instruction.name = instruction.arguments[0].value;
+            }
+            else if (instruction.name == "pgoto" && !instruction.arguments.empty())
+            {
+                // The section names stay in the arguments until they are resolved
+                instruction.op = Script::OpCode::PGOTO;
+            }
+            else if (isGoto)
+            {
+                instruction.op = Script::OpCode::UNKNOWN_SECTION;
+            }
+            else
+            {
+                instruction.op = Script::OpCode::DISPATCH;
+            }
+        }
+
+        program.instructions.push_back(std::move(instruction));
+    }
+
+    void expandToken(Token &token)
+    {
+        if (token.value.find('$') != std::string::npos)
+        {
+            std::string expanded;
+            Variables::expand(token.value, expanded);
+            token.value = std::move(expanded);
+        }
+    }
+
+    // Copy of the instruction with the values its variables have now
+    const Script::Instruction &expandInstruction(const Script::Instruction &instruction, Script::Instruction &expanded)
+    {
+        expanded = instruction;
+
+        for (auto &argument : expanded.arguments)
+        {
+            expandToken(argument);
+        }
+
+        for (auto &stage : expanded.stages)
+        {
+            for (auto &argument : stage.arguments)
+            {
+                expandToken(argument);
+            }
+
+            // A built-in command was found when the file was compiled, a program is looked up when it runs
+            if (stage.command == nullptr && stage.name.find('$') != std::string::npos)
+            {
+                std::string name;
+                Variables::expand(stage.name, name);
+                stage.name = std::move(name);
+            }
+        }
+
+        // A name written with a variable is only known when the line runs
+        if (expanded.op == Script::OpCode::DISPATCH && expanded.name.find('$') != std::string::npos)
+        {
+            std::string name;
+            Variables::expand(expanded.name, name);
+            expanded.name = std::move(name);
+        }
+
+        std::string filePath;
+        Variables::expand(expanded.redirection.filePath, filePath);
+        expanded.redirection.filePath = std::move(filePath);
+
+        return expanded;
+    }
+
+    void executeInstruction(const Script::Instruction &compiled, const CommandRegistry *commandRegistry, std::istream &input, std::ostream &output)
+    {
+        if (compiled.substitute)
+        {
+            // The line keeps its redirection, the shell handles it with the rest of the line
+            Shell::Session session{*commandRegistry};
+            Shell::executeLine(session, compiled.commandLine, input, output);
+            return;
+        }
+
+        Script::Instruction expanded;
+        const Script::Instruction &instruction = compiled.expand ? expandInstruction(compiled, expanded) : compiled;
+
+        Trace::Span span("line", instruction.commandLine, instruction.line);
+
+        Output::withRedirection(instruction.redirection, output, [&](std::ostream &target)
+                                {
+                                    if (instruction.op == Script::OpCode::PIPELINE)
+                                    {
+                                        Pipeline::run(instruction.stages, input, target);
+                                        return;
+                                    }
+
+                                    if (instruction.op == Script::OpCode::DISPATCH)
+                                    {
+                                        Shell::Session session{*commandRegistry};
+                                        Shell::executeCommand(session, instruction.name, instruction.arguments, input, target);
+                                        return;
+                                    }
+
+                                    try
+                                    {
+                                        Metrics::executeCommand(instruction.name, *instruction.command, instruction.arguments, input, target);
+                                    }
+                                    catch (const std::exception &e)
+                                    {
+                                        std::cerr << e.what() << '\n';
+                                    } });
+    }
+
+    void emitReturn(size_t line, Script::Program &program)
+    {
+        program.instructions.push_back({Script::OpCode::RETURN, nullptr, {}, 0, line, ""});
+    }
+}
+
+bool Script::compile(const std::string &commandFilePath, const CommandRegistry &commandRegistry, Program &program)
+{
+    std::ifstream commandFile(commandFilePath);
+
+    if (!commandFile.is_open())
+    {
+        std::cerr << "Unable to open the file." << std::endl;
+        return false;
+    }
+
+    bool inSection = false;
+
+    std::smatch match;
+
+    std::map<std::string, std::vector<SourceLine>> sections;
+
+    // Define the regular expression pattern
+    std::regex sectionStartRegex("/-(\\w+)");
+    std::regex sectionEndRegex("(\\w+)-/");
+
+    std::vector<SourceLine> sectionLines;
+    std::vector<SourceLine> commandLines;
+
+    std::string line;
+    std::string currentSection;
+    size_t lineNumber = 0;
+
+    while (std::getline(commandFile, line))
+    {
+        ++lineNumber;
+
+        // Check if the line indicates the start of a section
+        if (std::regex_match(line, match, sectionStartRegex))
+        {
+            currentSection = match[1].str();
+            inSection = true;
+            continue; // Skip the line indicating the start of the section
+        }
+
+        // Check if the line indicates the end of a section
+        if (std::regex_match(line, match, sectionEndRegex) && match[1].str() == currentSection)
+        {
+            sections[currentSection] = std::move(sectionLines);
+            inSection = false;
+
+            sectionLines.clear();
+            currentSection.clear();
+            continue; // Skip the line indicating the end of the section
+        }
+
+        // If inside a section, store the line
+        if (!currentSection.empty() && inSection == true)
+        {
+            sectionLines.push_back({lineNumber, line});
+        }
+
+        // Process each line as needed
+        if (inSection == false)
+        {
+            commandLines.push_back({lineNumber, line});
+        }
+    }
+
+    commandFile.close();
+
+    program.instructions.clear();
+    program.sections.clear();
+    program.commandRegistry = &commandRegistry;
+
+    // Top level lines come first and end with a RETURN which stops the program
+    for (const auto &source : commandLines)
+    {
+        emitLine(source, commandRegistry, program);
+    }
+    emitReturn(lineNumber, program);
+
+    // Each section is laid out after the top level lines and ends with its own RETURN
+    for (const auto &section : sections)
+    {
+        program.sections[section.first] = program.instructions.size();
+
+        for (const auto &source : section.second)
+        {
+            emitLine(source, commandRegistry, program);
+        }
+        emitReturn(section.second.empty() ? lineNumber : section.second.back().number, program);
+    }
+
+    // Resolve "goto" into instruction indexes, a "goto" followed by a RETURN becomes a plain jump
+    for (size_t i = 0; i < program.instructions.size(); ++i)
+    {
+        Instruction &instruction = program.instructions[i];
+
+        if (instruction.op == OpCode::PGOTO)
+        {
+            for (const auto &argument : instruction.arguments)
+            {
+                auto section = program.sections.find(argument.value);
+                if (section == program.sections.end())
+                {
+                    instruction.op = OpCode::UNKNOWN_SECTION;
+                    break;
+                }
+                instruction.targets.push_back(section->second);
+            }
+            continue;
+        }
+
+        if (instruction.op != OpCode::GOTO)
+        {
+            continue;
+        }
+
+        auto section = program.sections.find(instruction.name);
+        if (section == program.sections.end())
+        {
+            instruction.op = OpCode::UNKNOWN_SECTION;
+            continue;
+        }
+
+        instruction.target = section->second;
+
+        if (program.instructions[i + 1].op == OpCode::RETURN)
+        {
+            instruction.op = OpCode::JUMP;
+        }
+    }
+
+    return true;
+}
+
+namespace
+{
+    // Shared by the sections of a program running at the same time
+    struct RunState
+    {
+        std::atomic<bool> stopped{false};
+        Script::Profile *profile = nullptr;
+
+        // Stop every section of the program, only the first error is shown
+        void stop(const char *reason, size_t line)
+        {
+            if (!stopped.exchange(true))
+            {
+                std::cerr << reason << " (line " << line << "), stopping the command file" << std::endl;
+            }
+        }
+    };
+
+    // Sections entered by "goto" appear as nested spans in a trace : a "goto" opens a span closed when its
+    // section returns, a tail "goto" replaces the span of the section it leaves
+    class SectionSpans
+    {
+    public:
+        ~SectionSpans()
+        {
+            // Program stopped or ended inside sections
+            while (!frames.empty())
+            {
+                leave();
+            }
+        }
+
+        void call(const std::string &section)
+        {
+            frames.emplace_back();
+            open(section);
+        }
+
+        void jump(const std::string &section)
+        {
+            if (frames.empty())
+            {
+                frames.emplace_back();
+            }
+            close();
+            open(section);
+        }
+
+        void leave()
+        {
+            close();
+            frames.pop_back();
+        }
+
+    private:
+        void open(const std::string &section)
+        {
+            if (Trace::enabled())
+            {
+                Trace::begin("section", section);
+                frames.back() = section;
+            }
+        }
+
+        void close()
+        {
+            if (!frames.back().empty())
+            {
+                Trace::end("section", frames.back());
+                frames.back().clear();
+            }
+        }
+
+        std::vector<std::string> frames; // Section traced in each frame, empty when it isn't
+    };
+
+    // Frames of the sections entered by one runFrom when the program is profiled : a "goto" pushes a frame
+    // closed when its section returns, a tail "goto" replaces the frame of the section it leaves
+    class SectionProfiler
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // "stack" is the folded stack of the section runFrom starts in, "main" for the whole program
+        SectionProfiler(Script::Profile *profile, const std::string &stack) : profile(profile)
+        {
+            if (profile != nullptr)
+            {
+                frames.push_back({stack, stack.substr(stack.rfind(';') + 1), noLine, Clock::now()});
+            }
+        }
+
+        ~SectionProfiler()
+        {
+            while (!frames.empty())
+            {
+                leave();
+            }
+        }
+
+        const std::string &stack() const
+        {
+            return frames.back().stack;
+        }
+
+        // Start time of a line, not read when the program isn't profiled
+        Clock::time_point now() const
+        {
+            return profile != nullptr ? Clock::now() : Clock::time_point();
+        }
+
+        void command(size_t pc, const Script::Instruction &instruction, Clock::time_point start)
+        {
+            if (profile == nullptr)
+            {
+                return;
+            }
+
+            uint64_t duration = elapsed(start);
+            profile->addLine(pc, duration, duration);
+
+            std::string name = instruction.name;
+            if (instruction.op == Script::OpCode::PIPELINE)
+            {
+                name.clear();
+                for (const auto &stage : instruction.stages)
+                {
+                    name += (name.empty() ? "" : " | ") + stage.name;
+                }
+            }
+            std::replace(name.begin(), name.end(), ';', ':');
+
+            profile->addStack(frames.back().stack + ';' + name, duration);
+            frames.back().commands += duration;
+        }
+
+        void parallel(size_t pc, Clock::time_point start)
+        {
+            if (profile == nullptr)
+            {
+                return;
+            }
+
+            // The sections record their own time
+            uint64_t duration = elapsed(start);
+            profile->addLine(pc, duration, 0);
+            frames.back().children += duration;
+        }
+
+        void call(size_t pc, const std::string &section)
+        {
+            if (profile != nullptr)
+            {
+                frames.push_back({frames.back().stack + ';' + section, section, pc, Clock::now()});
+            }
+        }
+
+        void jump(size_t pc, const std::string &section)
+        {
+            // A tail "goto" of the top level enters a section which never returns to it
+            if (profile != nullptr && frames.size() > 1)
+            {
+                leave();
+            }
+            call(pc, section);
+        }
+
+        void leave()
+        {
+            if (profile == nullptr)
+            {
+                return;
+            }
+
+            Frame frame = std::move(frames.back());
+            frames.pop_back();
+
+            uint64_t duration = elapsed(frame.start);
+            uint64_t exclusive = duration - std::min(duration, frame.children);
+
+            profile->addSection(frame.section, duration, exclusive);
+            profile->addStack(frame.stack, exclusive - std::min(exclusive, frame.commands));
+            if (frame.pc != noLine)
+            {
+                profile->addLine(frame.pc, duration, 0);
+            }
+            if (!frames.empty())
+            {
+                frames.back().children += duration;
+            }
+        }
+
+    private:
+        static constexpr size_t noLine = static_cast<size_t>(-1);
+
+        struct Frame
+        {
+            std::string stack;
+            std::string section;
+            size_t pc; // "goto" which entered the section
+            Clock::time_point start;
+            uint64_t children = 0; // Time spent in the sections entered from this one
+            uint64_t commands = 0; // Time spent in the commands of the section
+        };
+
+        static uint64_t elapsed(Clock::time_point start)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        }
+
+        Script::Profile *profile;
+        std::vector<Frame> frames;
+    };
+
+    void runFrom(const Script::Program &program, size_t pc, size_t parallelDepth, RunState &state, std::istream &input, std::ostream &output, const std::string &stack);
+
+    // Run the sections of a PGOTO at the same time, each one writes to its own buffer and the buffers
+    // are written in the order of the line once every section ended
+    void runSections(const Script::Program &program, const Script::Instruction &instruction, size_t parallelDepth, RunState &state, std::ostream &output, const std::string &stack)
+    {
+        std::vector<std::unique_ptr<Output::MemorySink>> sinks;
+        std::vector<std::function<void()>> tasks;
+
+        for (size_t target : instruction.targets)
+        {
+            sinks.push_back(std::make_unique<Output::MemorySink>());
+            Output::MemorySink *sink = sinks.back().get();
+
+            tasks.push_back([&program, &instruction, target, parallelDepth, &state, sink, &stack, index = tasks.size()]()
+                            {
+                                const std::string &section = instruction.arguments[index].value;
+                                Trace::Span span("section", section);
+
+                                // Sections running together can't share an input
+                                std::istringstream noInput;
+                                std::ostream sectionOutput(sink);
+
+                                runFrom(program, target, parallelDepth + 1, state, noInput, sectionOutput, stack + ';' + section);
+                                sectionOutput.flush(); });
+        }
+
+        Parallel::invoke(tasks);
+
+        for (auto &sink : sinks)
+        {
+            output << sink->str();
+        }
+    }
+
+    void runFrom(const Script::Program &program, size_t pc, size_t parallelDepth, RunState &state, std::istream &input, std::ostream &output, const std::string &stack)
+    {
+        using namespace Script;
+
+        // Return addresses of the sections entered with a non tail "goto"
+        std::vector<size_t> returnStack;
+
+        // Trace spans of the sections entered, one entry per return address plus the top level
+        SectionSpans spans;
+        SectionProfiler profiler(state.profile, stack);
+
+        while (pc < program.instructions.size() && !state.stopped.load(std::memory_order_relaxed))
+        {
+            const Instruction &instruction = program.instructions[pc];
+
+            switch (instruction.op)
+            {
+            case OpCode::CALL:
+            case OpCode::PIPELINE:
+            case OpCode::DISPATCH:
+                if (instruction.background)
+                {
+                    // The job owns a copy of the instruction, the program may end before it does
+                    const CommandRegistry *commandRegistry = program.commandRegistry;
+                    size_t id = Jobs::start(instruction.commandLine, [instruction, commandRegistry](std::istream &jobInput, std::ostream &jobOutput)
+                                            { executeInstruction(instruction, commandRegistry, jobInput, jobOutput); });
+                    output << '[' << id << "] " << instruction.commandLine << '\n';
+                }
+                else
+                {
+                    auto start = profiler.now();
+                    executeInstruction(instruction, program.commandRegistry, input, output);
+                    profiler.command(pc, instruction, start);
+                }
+                output.flush();
+                ++pc;
+                break;
+
+            case OpCode::GOTO:
+                if (returnStack.size() >= maxCallDepth)
+                {
+                    state.stop("Too many nested goto", instruction.line);
+                    return;
+                }
+                returnStack.push_back(pc + 1);
+                spans.call(instruction.name);
+                profiler.call(pc, instruction.name);
+                pc = instruction.target;
+                break;
+
+            case OpCode::JUMP:
+                spans.jump(instruction.name);
+                profiler.jump(pc, instruction.name);
+                pc = instruction.target;
+                break;
+
+            case OpCode::PGOTO:
+                if (parallelDepth >= maxParallelDepth)
+                {
+                    state.stop("Too many nested pgoto", instruction.line);
+                    return;
+                }
+                {
+                    auto start = profiler.now();
+                    Output::withRedirection(instruction.redirection, output, [&](std::ostream &target)
+                                            {
+                                                Trace::Span span("line", instruction.commandLine, instruction.line);
+                                                runSections(program, instruction, parallelDepth, state, target, profiler.stack()); });
+                    profiler.parallel(pc, start);
+                }
+                output.flush();
+                ++pc;
+                break;
+
+            case OpCode::RETURN:
+                if (returnStack.empty())
+                {
+                    return;
+                }
+                spans.leave();
+                profiler.leave();
+                pc = returnStack.back();
+                returnStack.pop_back();
+                break;
+
+            case OpCode::UNKNOWN_SECTION:
+                output << "Section not found in the file" << '\n';
+                ++pc;
+                break;
+            }
+        }
+    }
+}
+
+void Script::run(const Program &program, std::istream &input, std::ostream &output, Profile *profile)
+{
+    RunState state;
+    state.profile = profile;
+    runFrom(program, 0, 0, state, input, output, "main");
+}
+
+void Script::executeCommandFile(const std::string &commandFilePath, const CommandRegistry &commandRegistry, std::istream &input, std::ostream &output)
+{
+    Program program;
+
+    if (compile(commandFilePath, commandRegistry, program))
+    {
+        run(program, input, output);
+    }
+}
+
+Script::Profile::Profile(const Program &program) : program(program), lines(program.instructions.size())
+{
+}
+
+void Script::Profile::addLine(size_t instruction, uint64_t inclusive, uint64_t exclusive)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Counters &counters = lines[instruction];
+    ++counters.hits;
+    counters.inclusive += inclusive;
+    counters.exclusive += exclusive;
+}
+
+void Script::Profile::addSection(const std::string &section, uint64_t inclusive, uint64_t exclusive)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Counters &counters = sections[section];
+    ++counters.hits;
+    counters.inclusive += inclusive;
+    counters.exclusive += exclusive;
+}
+
+void Script::Profile::addStack(const std::string &stack, uint64_t nanoseconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stacks[stack] += nanoseconds;
+}
+
+void Script::Profile::writeSummary(std::ostream &output)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Time of the whole program, the inclusive time of the top level
+    double total = 0;
+    auto topLevel = sections.find("main");
+    if (topLevel != sections.end())
+    {
+        total = static_cast<double>(topLevel->second.inclusive);
+    }
+
+    auto percent = [total](uint64_t nanoseconds)
+    {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(1) << (total > 0 ? 100.0 * nanoseconds / total : 0) << " %";
+        return oss.str();
+    };
+
+    std::vector<size_t> hotLines;
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        if (lines[i].hits > 0)
+        {
+            hotLines.push_back(i);
+        }
+    }
+    std::stable_sort(hotLines.begin(), hotLines.end(), [this](size_t a, size_t b)
+                     { return lines[a].exclusive > lines[b].exclusive || (lines[a].exclusive == lines[b].exclusive && lines[a].inclusive > lines[b].inclusive); });
+
+    output << std::right << std::setw(6) << "line" << std::setw(10) << "hits" << std::setw(14) << "inclusive"
+           << std::setw(14) << "exclusive" << std::setw(10) << "self" << "  text" << '\n';
+
+    for (size_t i : hotLines)
+    {
+        const Counters &counters = lines[i];
+        output << std::setw(6) << program.instructions[i].line << std::setw(10) << counters.hits
+               << std::setw(14) << Metrics::formatDuration(static_cast<double>(counters.inclusive))
+               << std::setw(14) << Metrics::formatDuration(static_cast<double>(counters.exclusive))
+               << std::setw(10) << percent(counters.exclusive) << "  " << program.instructions[i].commandLine << '\n';
+    }
+
+    std::vector<std::pair<std::string, Counters>> hotSections(sections.begin(), sections.end());
+    std::stable_sort(hotSections.begin(), hotSections.end(), [](const auto &a, const auto &b)
+                     { return a.second.exclusive > b.second.exclusive; });
+
+    size_t width = 10;
+    for (const auto &section : hotSections)
+    {
+        width = std::max(width, section.first.size() + 2);
+    }
+
+    output << '\n'
+           << std::left << std::setw(width) << "section" << std::right << std::setw(10) << "hits" << std::setw(14) << "inclusive"
+           << std::setw(14) << "exclusive" << std::setw(10) << "self" << '\n';
+
+    for (const auto &section : hotSections)
+    {
+        output << std::left << std::setw(width) << section.first << std::right << std::setw(10) << section.second.hits
+               << std::setw(14) << Metrics::formatDuration(static_cast<double>(section.second.inclusive))
+               << std::setw(14) << Metrics::formatDuration(static_cast<double>(section.second.exclusive))
+               << std::setw(10) << percent(section.second.exclusive) << '\n';
+    }
+}
+
+void Script::Profile::writeFolded(std::ostream &output)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (const auto &stack : stacks)
+    {
+        uint64_t microseconds = stack.second / 1000;
+        if (microseconds > 0)
+        {
+            output << stack.first << ' ' << microseconds << '\n';
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "command.h"
+#include "output.h"
+#include "pipeline.h"
+#include "registry.h"
+
+namespace Script
+{
+    enum class OpCode
+    {
+        CALL,            // Execute a built-in command with its pre-tokenized arguments
+        PIPELINE,        // Execute commands joined with "|" at the same time
+        GOTO,            // Enter a section and come back to the next instruction afterwards
+        JUMP,            // "goto" as last line of a section : enter the target without keeping a return address
+        PGOTO,           // Run several sections at the same time and continue once all of them ended
+        RETURN,          // Leave the current section, or stop the program at top level
+        DISPATCH,        // Command name resolved when the line runs, like at the prompt : a program, a .shl file or a variable
+        UNKNOWN_SECTION  // "goto" to a section which is not defined in the file
+    };
+
+    struct Instruction
+    {
+        OpCode op;
+        Command *command;
+        std::vector<Token> arguments;
+        size_t target; // Index of the first instruction of the section for GOTO/JUMP
+        size_t line;   // Line number in the source file
+        std::string name;
+        std::vector<Pipeline::Stage> stages{}; // Commands of a PIPELINE
+        std::vector<size_t> targets{};         // Index of the first instruction of each section of a PGOTO
+        Output::Redirection redirection{};     // File receiving the output of a CALL or a PIPELINE
+        bool background = false;               // CALL or PIPELINE started as a job, the line ended with "&"
+        std::string commandLine{};             // Text of the line without "&", shown by "jobs" and in traces
+        bool expand = false;                   // The arguments have variables, they are replaced each time the line runs
+        bool substitute = false;               // The line has a $(...), the shell splits it again each time it runs
+    };
+
+    struct Program
+    {
+        std::vector<Instruction> instructions;
+        std::unordered_map<std::string, size_t> sections; // Section name -> index of its first instruction
+        const CommandRegistry *commandRegistry = nullptr; // Registry the file was compiled with
+    };
+
+    // Hits and time of the lines and sections of a program, filled by run when it is given one
+    // Inclusive time counts the sections entered from a line or a section, exclusive time doesn't
+    class Profile
+    {
+    public:
+        explicit Profile(const Program &program);
+
+        void addLine(size_t instruction, uint64_t inclusive, uint64_t exclusive);
+        void addSection(const std::string &section, uint64_t inclusive, uint64_t exclusive);
+
+        // Time spent in a "main;section;command" stack, for flame graphs
+        void addStack(const std::string &stack, uint64_t nanoseconds);
+
+        // Lines then sections, the ones with the most exclusive time first
+        void writeSummary(std::ostream &output);
+
+        // One "main;section;command microseconds" line per stack, the format of flamegraph.pl and speedscope
+        void writeFolded(std::ostream &output);
+
+    private:
+        struct Counters
+        {
+            uint64_t hits = 0;
+            uint64_t inclusive = 0;
+            uint64_t exclusive = 0;
+        };
+
+        const Program &program;
+        std::vector<Counters> lines; // Indexed like the instructions
+        std::map<std::string, Counters> sections;
+        std::map<std::string, uint64_t> stacks;
+        std::mutex mutex; // Sections of a "pgoto" record at the same time
+    };
+
+    // Maximum number of nested (non tail) "goto" before the program is stopped
+    constexpr size_t maxCallDepth = 4096;
+
+    // Maximum number of nested "pgoto", each level can multiply the number of running sections
+    constexpr size_t maxParallelDepth = 16;
+
+    bool compile(const std::string &commandFilePath, const CommandRegistry &commandRegistry, Program &program);
+    void run(const Program &program, std::istream &input, std::ostream &output, Profile *profile = nullptr);
+    void executeCommandFile(const std::string &commandFilePath, const CommandRegistry &commandRegistry, std::istream &input, std::ostream &output);
+}
+
+#endif
@@ -0,0 +1,842 @@
+#include "server.h"
+
+#include <iostream>
+
+#if defined(__linux__) && !defined(_WIN32)
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <csignal>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "shell.h"
+#include "tokenizer.h"
+#elif !defined(_WIN32)
+#include <cstring>
+#include <vector>
+
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace
+{
+    constexpr size_t frameHeaderSize = 5;
+
+    bool socketAddress(const std::string &socketPath, sockaddr_un &address)
+    {
+        address = sockaddr_un();
+        address.sun_family = AF_UNIX;
+
+        if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+        {
+            std::cerr << "Invalid socket path: " << socketPath << std::endl;
+            return false;
+        }
+
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+        return true;
+    }
+
+    bool sendAll(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    bool receiveAll(int fd, char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t received = recv(fd, data, size, 0);
+            if (received < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (received <= 0)
+            {
+                return false;
+            }
+
+            data += received;
+            size -= received;
+        }
+        return true;
+    }
+}
+#endif
+
+#if defined(__linux__) && !defined(_WIN32)
+namespace
+{
+    // Output a slow client hasn't read yet before the command writing it waits
+    constexpr size_t maxPendingBytes = 1024 * 1024;
+
+    // Written by the signal handler to wake the event loop up
+    int signalWakeFd = -1;
+    volatile std::sig_atomic_t stopRequested = 0;
+
+    void requestStop(int)
+    {
+        stopRequested = 1;
+
+        uint64_t one = 1;
+        ssize_t ignored = write(signalWakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // Buffer of std::cerr while the server runs : the errors of a request go to the client which sent
+    // it, the ones written outside of a request to the original buffer. Only the worker running the
+    // request is known to write for it : the other threads of a pipeline, of "pgoto" or of "copy"
+    // write their errors to the standard error of the server
+    thread_local std::streambuf *errorTarget = nullptr;
+
+    class ErrorRouter : public std::streambuf
+    {
+    public:
+        explicit ErrorRouter(std::streambuf *fallback) : fallback(fallback) {}
+
+    protected:
+        int_type overflow(int_type ch) override
+        {
+            if (traits_type::eq_int_type(ch, traits_type::eof()))
+            {
+                return traits_type::not_eof(ch);
+            }
+
+            char character = traits_type::to_char_type(ch);
+            return xsputn(&character, 1) == 1 ? ch : traits_type::eof();
+        }
+
+        std::streamsize xsputn(const char *data, std::streamsize size) override
+        {
+            return target()->sputn(data, size);
+        }
+
+        int sync() override
+        {
+            return target()->pubsync();
+        }
+
+    private:
+        std::streambuf *target() const
+        {
+            return errorTarget != nullptr ? errorTarget : fallback;
+        }
+
+        std::streambuf *fallback;
+    };
+
+    struct Connection
+    {
+        int fd;
+        std::string request; // Read by the event loop until the end of the line
+        bool started = false;
+
+        // Shared by the event loop and the worker executing the request
+        std::mutex mutex;
+        std::condition_variable drained;
+        std::string outgoing; // Frames not sent yet, from "sent"
+        size_t sent = 0;
+        bool finished = false; // The end frame is in "outgoing"
+        bool gone = false;     // The client disconnected, what the request writes is thrown away
+    };
+
+    void appendFrame(std::string &outgoing, char type, const char *data, size_t size)
+    {
+        char header[frameHeaderSize] = {type, static_cast<char>(size >> 24), static_cast<char>(size >> 16),
+                                        static_cast<char>(size >> 8), static_cast<char>(size)};
+        outgoing.append(header, frameHeaderSize);
+        outgoing.append(data, size);
+    }
+
+    class EventLoop
+    {
+    public:
+        EventLoop(const CommandRegistry &commandRegistry, int listener, int epoll, int wake)
+            : commandRegistry(commandRegistry), listener(listener), epoll(epoll), wake(wake)
+        {
+        }
+
+        ~EventLoop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            changed.notify_all();
+
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        // Serve the clients until a stop is requested and every accepted request is answered
+        void run(const std::string &socketPath)
+        {
+            std::vector<epoll_event> events(64);
+
+            while (listener != -1 || !connections.empty())
+            {
+                int count = epoll_wait(epoll, events.data(), static_cast<int>(events.size()), -1);
+                if (count < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    std::cerr << "Error waiting for clients: " << std::strerror(errno) << std::endl;
+                    break;
+                }
+
+                for (int i = 0; i < count; ++i)
+                {
+                    int fd = events[i].data.fd;
+
+                    if (fd == listener)
+                    {
+                        acceptClients();
+                    }
+                    else if (fd == wake)
+                    {
+                        uint64_t value;
+                        ssize_t ignored = read(wake, &value, sizeof(value));
+                        (void)ignored;
+
+                        if (stopRequested && listener != -1)
+                        {
+                            // Requests already accepted are still answered, clients which haven't sent
+                            // a whole line yet are closed : an idle one would keep the server running
+                            close(listener);
+                            listener = -1;
+                            unlink(socketPath.c_str());
+                            closeIdleClients();
+                        }
+                        flushReady();
+                    }
+                    else
+                    {
+                        handleClient(fd, events[i].events);
+                    }
+                }
+            }
+        }
+
+        // Queue a frame for the client, false once it disconnected ; waits while it is too far behind
+        bool send(const std::shared_ptr<Connection> &connection, char type, const char *data, size_t size)
+        {
+            {
+                std::unique_lock<std::mutex> lock(connection->mutex);
+                connection->drained.wait(lock, [&connection]
+                                         { return connection->outgoing.size() - connection->sent < maxPendingBytes || connection->gone; });
+
+                if (connection->gone)
+                {
+                    return false;
+                }
+
+                bool idle = connection->sent == connection->outgoing.size();
+                appendFrame(connection->outgoing, type, data, size);
+                connection->finished = type == Server::endFrame;
+
+                // Pending frames are sent by the event loop when the socket becomes writable again
+                if (!idle)
+                {
+                    return true;
+                }
+            }
+
+            markReady(connection);
+            return true;
+        }
+
+    private:
+        // Command output sent to the client as frames of one type
+        class ConnectionSink : public Output::Sink
+        {
+        public:
+            ConnectionSink(EventLoop &server, std::shared_ptr<Connection> connection, char type)
+                : Output::Sink(16 * 1024), server(server), connection(std::move(connection)), type(type)
+            {
+            }
+
+        protected:
+            bool writeBlock(std::vector<char> &block, size_t size) override
+            {
+                return server.send(connection, type, block.data(), size);
+            }
+
+        private:
+            EventLoop &server;
+            std::shared_ptr<Connection> connection;
+            char type;
+        };
+
+        static size_t maxWorkers()
+        {
+            // Most requests wait for a program, more of them than cores can run at the same time
+            return std::max<size_t>(8, 2 * std::thread::hardware_concurrency());
+        }
+
+        void acceptClients()
+        {
+            while (true)
+            {
+                int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0)
+                {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                    {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    {
+                        std::cerr << "Error accepting a client: " << std::strerror(errno) << std::endl;
+                    }
+                    return;
+                }
+
+                // Edge triggered : the socket is read until EAGAIN, and written again once it drained
+                epoll_event event{};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+                event.data.fd = fd;
+
+                if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+                {
+                    close(fd);
+                    continue;
+                }
+
+                auto connection = std::make_shared<Connection>();
+                connection->fd = fd;
+                connections[fd] = connection;
+            }
+        }
+
+        void closeIdleClients()
+        {
+            std::vector<std::shared_ptr<Connection>> idle;
+            for (const auto &entry : connections)
+            {
+                if (!entry.second->started)
+                {
+                    idle.push_back(entry.second);
+                }
+            }
+
+            for (const auto &connection : idle)
+            {
+                disconnect(connection);
+            }
+        }
+
+        void handleClient(int fd, uint32_t events)
+        {
+            auto entry = connections.find(fd);
+            if (entry == connections.end())
+            {
+                return;
+            }
+            std::shared_ptr<Connection> connection = entry->second;
+
+            if (events & (EPOLLERR | EPOLLHUP))
+            {
+                disconnect(connection);
+                return;
+            }
+
+            if (events & EPOLLIN)
+            {
+                readRequest(connection);
+            }
+
+            if ((events & EPOLLOUT) && connection->fd != -1)
+            {
+                flush(connection);
+            }
+        }
+
+        void readRequest(const std::shared_ptr<Connection> &connection)
+        {
+            char buffer[4096];
+
+            while (true)
+            {
+                ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+                if (received < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    {
+                        disconnect(connection);
+                    }
+                    return;
+                }
+
+                if (received == 0)
+                {
+                    // A client may shut its side down once the line is sent, it still reads the answer
+                    if (!connection->started)
+                    {
+                        disconnect(connection);
+                    }
+                    return;
+                }
+
+                // Requests have no input, what follows the line is ignored
+                if (connection->started)
+                {
+                    continue;
+                }
+
+                connection->request.append(buffer, received);
+                size_t end = connection->request.find('\n');
+
+                if (end != std::string::npos)
+                {
+                    connection->request.resize(end);
+                    if (!connection->request.empty() && connection->request.back() == '\r')
+                    {
+                        connection->request.pop_back();
+                    }
+                    if (isBackground(connection->request))
+                    {
+                        // The job would outlive the session of the request, and its output would reach no client
+                        static const std::string message = "Background jobs (&) can't be sent to a server\n";
+
+                        connection->started = true;
+                        send(connection, Server::errorFrame, message.data(), message.size());
+                        send(connection, Server::endFrame, nullptr, 0);
+                    }
+                    else
+                    {
+                        start(connection);
+                    }
+                }
+                else if (connection->request.size() > Server::maxRequestSize)
+                {
+                    static const std::string message = "Command line too long\n";
+
+                    connection->started = true;
+                    send(connection, Server::errorFrame, message.data(), message.size());
+                    send(connection, Server::endFrame, nullptr, 0);
+                }
+            }
+        }
+
+        static bool isBackground(const std::string &line)
+        {
+            std::vector<Tokenizer::TokenView> views;
+            Tokenizer::scan(line, views);
+            return !views.empty() && views.back().type == Tokenizer::TokenType::BACKGROUND;
+        }
+
+        void start(const std::shared_ptr<Connection> &connection)
+        {
+            connection->started = true;
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            tasks.push_back([this, connection]()
+                            { execute(connection); });
+
+            // A worker is only created when the idle ones can't take every queued task : an idle worker
+            // not woken up yet already has a task waiting for it
+            if (tasks.size() > idleWorkers && workers.size() < maxWorkers())
+            {
+                workers.emplace_back(&EventLoop::workerLoop, this);
+            }
+            changed.notify_all();
+        }
+
+        void execute(const std::shared_ptr<Connection> &connection)
+        {
+            ConnectionSink outputSink(*this, connection, Server::outputFrame);
+            ConnectionSink errorSink(*this, connection, Server::errorFrame);
+            std::ostream output(&outputSink);
+
+            // Each request has its own session, like a "cmd++ -c" launch, but shares the caches of the process
+            Shell::Session session{commandRegistry};
+            std::istringstream noInput;
+
+            errorTarget = &errorSink;
+            try
+            {
+                Shell::executeLine(session, connection->request, noInput, output);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << e.what() << '\n';
+            }
+            output.flush();
+            errorSink.pubsync();
+            errorTarget = nullptr;
+
+            send(connection, Server::endFrame, nullptr, 0);
+        }
+
+        void workerLoop()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (true)
+            {
+                ++idleWorkers;
+                changed.wait(lock, [this]
+                             { return !tasks.empty() || stopping; });
+                --idleWorkers;
+
+                if (tasks.empty())
+                {
+                    return;
+                }
+
+                std::function<void()> task = std::move(tasks.front());
+                tasks.pop_front();
+
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+
+        // Called by the workers : the event loop sends the frames of the connection when it wakes up
+        void markReady(const std::shared_ptr<Connection> &connection)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.push_back(connection);
+            }
+
+            uint64_t one = 1;
+            ssize_t ignored = write(wake, &one, sizeof(one));
+            (void)ignored;
+        }
+
+        void flushReady()
+        {
+            std::vector<std::shared_ptr<Connection>> connectionsToFlush;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                connectionsToFlush.swap(ready);
+            }
+
+            for (const auto &connection : connectionsToFlush)
+            {
+                // The connection may have been closed since it was marked
+                if (connection->fd != -1)
+                {
+                    flush(connection);
+                }
+            }
+        }
+
+        // Send as much as the socket takes, and close the connection once the end frame is sent
+        void flush(const std::shared_ptr<Connection> &connection)
+        {
+            bool done;
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+
+                while (connection->sent < connection->outgoing.size())
+                {
+                    ssize_t sent = ::send(connection->fd, connection->outgoing.data() + connection->sent,
+                                          connection->outgoing.size() - connection->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+                    if (sent < 0)
+                    {
+                        if (errno == EINTR)
+                        {
+                            continue;
+                        }
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        {
+                            connection->gone = true;
+                        }
+                        break;
+                    }
+                    connection->sent += sent;
+                }
+
+                // The sent frames are dropped once they are a large part of the buffer
+                if (connection->sent == connection->outgoing.size())
+                {
+                    connection->outgoing.clear();
+                    connection->sent = 0;
+                }
+                else if (connection->sent > maxPendingBytes / 2)
+                {
+                    connection->outgoing.erase(0, connection->sent);
+                    connection->sent = 0;
+                }
+
+                done = connection->gone || (connection->finished && connection->outgoing.empty());
+            }
+            connection->drained.notify_all();
+
+            if (done)
+            {
+                disconnect(connection);
+            }
+        }
+
+        // Close the socket, a request still running sees the client as gone and its output is thrown away
+        void disconnect(const std::shared_ptr<Connection> &connection)
+        {
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                connection->gone = true;
+            }
+            connection->drained.notify_all();
+
+            connections.erase(connection->fd);
+            close(connection->fd);
+            connection->fd = -1;
+        }
+
+        const CommandRegistry &commandRegistry;
+        int listener;
+        int epoll;
+        int wake;
+
+        // Only used by the event loop
+        std::unordered_map<int, std::shared_ptr<Connection>> connections;
+
+        // Shared with the workers, protected by "mutex"
+        std::vector<std::shared_ptr<Connection>> ready;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> workers;
+        size_t idleWorkers = 0;
+        bool stopping = false;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+
+    // Socket file left behind by a server which didn't stop cleanly : nothing accepts connections on it
+    bool isStale(const sockaddr_un &address)
+    {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe < 0)
+        {
+            return false;
+        }
+
+        bool stale = connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 && errno == ECONNREFUSED;
+        close(probe);
+        return stale;
+    }
+
+    // Bind the socket, replacing the file a crashed server left behind but not one a server listens to
+    int listenTo(const std::string &socketPath)
+    {
+        sockaddr_un address;
+        if (!socketAddress(socketPath, address))
+        {
+            return -1;
+        }
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            std::cerr << "Error creating the socket: " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+
+        if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            if (errno != EADDRINUSE)
+            {
+                std::cerr << "Error binding the socket: " << std::strerror(errno) << std::endl;
+                close(fd);
+                return -1;
+            }
+
+            if (!isStale(address))
+            {
+                std::cerr << "A server already listens to: " << socketPath << std::endl;
+                close(fd);
+                return -1;
+            }
+
+            unlink(socketPath.c_str());
+            if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+            {
+                std::cerr << "Error binding the socket: " << std::strerror(errno) << std::endl;
+                close(fd);
+                return -1;
+            }
+        }
+
+        if (listen(fd, SOMAXCONN) != 0)
+        {
+            std::cerr << "Error listening to the socket: " << std::strerror(errno) << std::endl;
+            close(fd);
+            unlink(socketPath.c_str());
+            return -1;
+        }
+
+        return fd;
+    }
+}
+
+int Server::serve(const CommandRegistry &commandRegistry, const std::string &socketPath)
+{
+    int listener = listenTo(socketPath);
+    if (listener < 0)
+    {
+        return 1;
+    }
+
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    int wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll < 0 || wake < 0)
+    {
+        std::cerr << "Error creating the event loop: " << std::strerror(errno) << std::endl;
+        close(listener);
+        unlink(socketPath.c_str());
+        return 1;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+    event.data.fd = wake;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, wake, &event);
+
+    signalWakeFd = wake;
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    ErrorRouter errorRouter(std::cerr.rdbuf());
+    std::streambuf *previousError = std::cerr.rdbuf(&errorRouter);
+
+    {
+        EventLoop loop(commandRegistry, listener, epoll, wake);
+        loop.run(socketPath);
+    }
+
+    std::cerr.rdbuf(previousError);
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+
+    close(wake);
+    close(epoll);
+    return 0;
+}
+#else
+int Server::serve(const CommandRegistry &, const std::string &)
+{
+    std::cerr << "The server needs epoll, it is only available on Linux" << std::endl;
+    return 1;
+}
+#endif
+
+#ifdef _WIN32
+int Server::request(const std::string &, const std::string &)
+{
+    std::cerr << "The client is not available on Windows" << std::endl;
+    return 1;
+}
+#else
+int Server::request(const std::string &socketPath, const std::string &commandLine)
+{
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address))
+    {
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        std::cerr << "Unable to connect to the server: " << socketPath << std::endl;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+
+    std::string line = commandLine + '\n';
+    bool ended = false;
+
+    if (sendAll(fd, line.data(), line.size()))
+    {
+        char header[frameHeaderSize];
+        std::vector<char> data;
+
+        while (!ended && receiveAll(fd, header, frameHeaderSize))
+        {
+            size_t size = (static_cast<size_t>(static_cast<unsigned char>(header[1])) << 24) |
+                          (static_cast<size_t>(static_cast<unsigned char>(header[2])) << 16) |
+                          (static_cast<size_t>(static_cast<unsigned char>(header[3])) << 8) |
+                          static_cast<size_t>(static_cast<unsigned char>(header[4]));
+
+            data.resize(size);
+            if (!receiveAll(fd, data.data(), size))
+            {
+                break;
+            }
+
+            if (header[0] == outputFrame)
+            {
+                std::cout.write(data.data(), size);
+            }
+            else if (header[0] == errorFrame)
+            {
+                std::cerr.write(data.data(), size);
+            }
+            else if (header[0] == endFrame)
+            {
+                ended = true;
+            }
+        }
+    }
+    close(fd);
+
+    std::cout.flush();
+    if (!ended)
+    {
+        std::cerr << "Connection to the server lost" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,32 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+
+#include "registry.h"
+
+namespace Server
+{
+    // The server answers each command line with frames : one type byte, the size of the data on 4 bytes
+    // (big endian) and the data. The end frame comes last and has no data
+    constexpr char outputFrame = 'o';
+    constexpr char errorFrame = 'e';
+    constexpr char endFrame = 'x';
+
+    // Longest command line a client can send
+    constexpr size_t maxRequestSize = 64 * 1024;
+
+    // Execute the command lines sent to a Unix domain socket until SIGINT or SIGTERM, with the registry
+    // and the caches of this process kept warm from one request to the next. A client sends one line
+    // ended by '\n' per connection, every connection is served by one epoll loop and the lines run on
+    // a pool of workers ; exit code of the server. A line ending with "&" is refused. Errors written by
+    // the threads a request starts (pipeline stages, "pgoto", "copy") go to the standard error of
+    // the server rather than to the client
+    int serve(const CommandRegistry &commandRegistry, const std::string &socketPath);
+
+    // Send a command line to a server and write what it returns to std::cout and std::cerr ; exit code
+    // of the client, 1 when the server can't be reached or closes the connection before the end frame
+    int request(const std::string &socketPath, const std::string &commandLine);
+}
+
+#endif
@@ -0,0 +1,343 @@
+#include "shell.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+
+#include "counters.h"
+#include "jobs.h"
+#include "metrics.h"
+#include "output.h"
+#include "pipeline.h"
+#include "process.h"
+#include "script.h"
+#include "trace.h"
+#include "variables.h"
+
+using namespace Tokenizer;
+
+namespace
+{
+    // Size of the blocks read from a stream of commands, doubled while a single line doesn't fit
+    constexpr size_t streamBlockSize = 64 * 1024;
+
+    void writeExecutionTime(std::chrono::high_resolution_clock::duration duration, std::ostream &output)
+    {
+        // Execution time in microseconds
+        auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+        // Convert duration to milliseconds
+        auto duration_ms = duration_us / 1000.0;
+
+        // Convert duration to seconds
+        auto duration_s = duration_us / 1000000.0;
+
+        // Convert duration to minutes
+        auto duration_min = duration_us / 60000000.0;
+
+        output << "Execution time: " << '\n';
+        output << duration_us << " microseconds" << '\n';
+        output << duration_ms << " milliseconds" << '\n';
+        output << duration_s << " seconds" << '\n';
+        output << duration_min << " minutes" << '\n';
+    }
+
+    void timeCommand(std::string_view commandName, Command *command, const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
+    {
+        Counters::Group counters;
+        counters.start();
+        auto start = std::chrono::high_resolution_clock::now();
+
+        Metrics::Transfer transfer = Metrics::executeCommand(commandName, *command, arguments, input, output);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        Counters::Sample sample = counters.stop();
+
+        writeExecutionTime(end - start, output);
+        Counters::write(sample, transfer.bytesRead, transfer.bytesWritten, output);
+    }
+
+    // Same as timeCommand for an external program or a pipeline, with the resources the system accounted to its programs
+    void timeProgram(const std::vector<Pipeline::Stage> &stages, std::istream &input, std::ostream &output)
+    {
+        Counters::Group counters;
+        counters.start();
+        auto start = std::chrono::high_resolution_clock::now();
+
+        Exe::Usage usage = Pipeline::run(stages, input, output);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        Counters::Sample sample = counters.stop();
+
+        writeExecutionTime(end - start, output);
+        Counters::write(sample, 0, 0, output);
+        Counters::writeUsage(usage, output);
+    }
+
+    size_t substitutionLimit()
+    {
+        std::string value;
+        if (!Variables::get("CMDPP_SUBSTITUTION_LIMIT", value))
+        {
+            return Shell::defaultSubstitutionLimit;
+        }
+
+        try
+        {
+            return static_cast<size_t>(std::stoull(value));
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid CMDPP_SUBSTITUTION_LIMIT: " << value << std::endl;
+            return Shell::defaultSubstitutionLimit;
+        }
+    }
+
+    // Run the command line of a $(...) in memory : a built-in command writes to a growing buffer and a program
+    // to a pipe drained into it ; false when the output is larger than the limit
+    bool substitute(Shell::Session &session, std::string_view commandLine, std::string &captured)
+    {
+        size_t limit = substitutionLimit();
+
+        Output::MemorySink sink(limit);
+        std::ostream output(&sink);
+        std::istringstream noInput;
+
+        Shell::executeLine(session, commandLine, noInput, output);
+        output.flush();
+
+        if (sink.exceeded())
+        {
+            std::cerr << "Output of $(" << commandLine << ") is larger than " << limit << " bytes" << std::endl;
+            return false;
+        }
+
+        captured = sink.str();
+        return true;
+    }
+
+    void executeBuiltin(Shell::Session &session, std::string_view commandName, Command *command, const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
+    {
+        if (session.exetime)
+        {
+            timeCommand(commandName, command, arguments, input, output);
+        }
+        else
+        {
+            Metrics::executeCommand(commandName, *command, arguments, input, output);
+        }
+    }
+
+    void dispatch(Shell::Session &session, const std::string &commandName, const std::vector<Token> &arguments, std::istream &input, std::ostream &output, bool expandVariable)
+    {
+        Command *command = session.commandRegistry.getCommand(commandName);
+        std::string filePath;
+
+        if (command)
+        {
+            executeBuiltin(session, commandName, command, arguments, input, output);
+        }
+        else if (Exe::resolveExecutable(commandName, filePath))
+        {
+            // A single stage pipeline hands the console or the redirection file to the program directly
+            std::vector<Pipeline::Stage> stages{{commandName, nullptr, arguments}};
+            if (session.exetime)
+            {
+                timeProgram(stages, input, output);
+            }
+            else
+            {
+                Pipeline::run(stages, input, output);
+            }
+        }
+        else if (std::filesystem::exists(commandName))
+        {
+            if (std::filesystem::is_regular_file(commandName) && std::filesystem::path(commandName).extension() == ".shl")
+            {
+                Script::executeCommandFile(commandName, session.commandRegistry, input, output);
+            }
+            else
+            {
+                std::cerr << "Unknown command: " << commandName << std::endl;
+            }
+        }
+        else if (commandName == "exetime")
+        {
+            session.exetime = not session.exetime;
+        }
+        else
+        {
+            // The value of a variable is run as a command, only once
+            std::string value;
+            if (expandVariable && Variables::get(commandName, value))
+            {
+                dispatch(session, value, arguments, input, output, false);
+            }
+            else
+            {
+                std::cerr << "Unknown command: " << commandName << std::endl;
+            }
+        }
+    }
+}
+
+void Shell::executeCommand(Session &session, std::string_view commandName, const std::vector<Token> &arguments, std::istream &input, std::ostream &output)
+{
+    try
+    {
+        // Built-in commands are looked up without building a string, anything else needs one
+        Command *command = session.commandRegistry.getCommand(commandName);
+        if (command)
+        {
+            executeBuiltin(session, commandName, command, arguments, input, output);
+        }
+        else
+        {
+            dispatch(session, std::string(commandName), arguments, input, output, true);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+}
+
+void Shell::executeLine(Session &session, std::string_view line, std::istream &input, std::ostream &output)
+{
+    std::vector<TokenView> views;
+    scan(line, views);
+    if (views.empty())
+    {
+        return;
+    }
+
+    Trace::Span span("line", line);
+
+    bool background;
+    if (!Jobs::parseBackground(views, background))
+    {
+        return;
+    }
+
+    if (background)
+    {
+        // The job keeps its own copy of the line, without the "&"
+        std::string commandLine(line.substr(0, line.rfind('&')));
+        commandLine.erase(commandLine.find_last_not_of(" \t") + 1);
+
+        // The session is copied, the job may outlive a session local to a request, a script line or a substitution
+        size_t id = Jobs::start(commandLine, [session, commandLine](std::istream &jobInput, std::ostream &jobOutput) mutable
+                                { executeLine(session, commandLine, jobInput, jobOutput); });
+
+        output << '[' << id << "] " << commandLine << '\n';
+        output.flush();
+        return;
+    }
+
+    // Variables and substitutions are replaced once for the whole line, a background job does it when it starts
+    std::string expanded;
+    if (std::memchr(line.data(), '$', line.size()) != nullptr)
+    {
+        auto substitution = [&session](std::string_view commandLine, std::string &captured)
+        {
+            return substitute(session, commandLine, captured);
+        };
+
+        // A substitution giving nothing may leave no word at all
+        if (!expand(views, expanded, substitution) || views.empty())
+        {
+            return;
+        }
+    }
+
+    Output::Redirection redirection;
+    if (!Output::parseRedirection(views, redirection))
+    {
+        return;
+    }
+
+    Output::withRedirection(redirection, output, [&](std::ostream &target)
+                            {
+                                if (Pipeline::isPipeline(views))
+                                {
+                                    std::vector<Pipeline::Stage> stages;
+                                    if (Pipeline::split(views, session.commandRegistry, stages))
+                                    {
+                                        if (session.exetime)
+                                        {
+                                            timeProgram(stages, input, target);
+                                        }
+                                        else
+                                        {
+                                            Pipeline::run(stages, input, target);
+                                        }
+                                    }
+                                    return;
+                                }
+
+                                std::vector<Token> tokens;
+                                toTokens(views, 1, tokens);
+                                executeCommand(session, views[0].value, tokens, input, target); });
+
+    output.flush();
+}
+
+void Shell::executeStream(Session &session, Exe::NativeHandle inputHandle, std::ostream &output)
+{
+    // The command lines come from the standard input, so commands reading an input get none
+    std::istringstream noInput;
+
+    std::vector<char> buffer(streamBlockSize);
+    size_t begin = 0;
+    size_t end = 0;
+    bool finished = false;
+
+    while (true)
+    {
+        const char *first = buffer.data() + begin;
+        const char *newline = static_cast<const char *>(std::memchr(first, '\n', end - begin));
+
+        if (newline == nullptr && !finished)
+        {
+            // Keep the incomplete line at the start of the buffer and read the next block after it
+            std::memmove(buffer.data(), first, end - begin);
+            end -= begin;
+            begin = 0;
+
+            if (end == buffer.size())
+            {
+                buffer.resize(buffer.size() * 2);
+            }
+
+            size_t size = Exe::readHandle(inputHandle, buffer.data() + end, buffer.size() - end);
+            finished = size == 0;
+            end += size;
+            continue;
+        }
+
+        if (newline == nullptr && begin == end)
+        {
+            break;
+        }
+
+        // The last line may have no newline
+        const char *last = newline != nullptr ? newline : buffer.data() + end;
+        std::string_view line(first, last - first);
+        begin = newline != nullptr ? begin + line.size() + 1 : end;
+
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+
+        if (line == "exit")
+        {
+            break;
+        }
+
+        executeLine(session, line, noInput, output);
+        Jobs::reportFinished(output);
+    }
+}
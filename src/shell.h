@@ -0,0 +1,36 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "process.h"
+#include "registry.h"
+#include "tokenizer.h"
+
+namespace Shell
+{
+    // Largest output a $(...) substitution keeps, the variable CMDPP_SUBSTITUTION_LIMIT (in bytes) replaces it
+    constexpr size_t defaultSubstitutionLimit = 1024 * 1024;
+
+    // State shared by the lines typed at the prompt
+    struct Session
+    {
+        const CommandRegistry &commandRegistry;
+        bool exetime = false;
+    };
+
+    // Execute one command line : a built-in command, an executable, a .shl file or a pipeline,
+    // with its output redirected to a file when the line ends with "> file" or ">> file"
+    void executeLine(Session &session, std::string_view line, std::istream &input, std::ostream &output);
+
+    // Execute every line read from "inputHandle" until its end or an "exit" line, without prompt ;
+    // the handle is read by large blocks and the lines are executed in place
+    void executeStream(Session &session, Exe::NativeHandle inputHandle, std::ostream &output);
+
+    void executeCommand(Session &session, std::string_view commandName, const std::vector<Token> &arguments, std::istream &input, std::ostream &output);
+}
+
+#endif
@@ -1,50 +1,278 @@
-#include "Tokenizer.h"
-#include <sstream>
-#include <iomanip>
+#include "tokenizer.h"
+#include <array>
+#include <cstring>
+#include <iostream>
 
-namespace Tokenizer
+#include "variables.h"
+
+namespace
 {
-    std::vector<Token> tokenize(const std::string &input)
+    // Characters separating two tokens, same set as std::isspace in the "C" locale
+    constexpr std::array<bool, 256> spaceTable = []()
     {
-        std::vector<Token> tokens;
-        std::istringstream stream(input);
-        std::string token;
+        std::array<bool, 256> table{};
+        table[' '] = table['\t'] = table['\n'] = table['\v'] = table['\f'] = table['\r'] = true;
+        return table;
+    }();
 
-        bool inQuotes = false;
+    inline bool isSpace(char c)
+    {
+        return spaceTable[static_cast<unsigned char>(c)];
+    }
 
-        while (stream >> std::ws)
+    inline Tokenizer::TokenType classify(std::string_view word)
+    {
+        if (word == "|")
+        {
+            return Tokenizer::TokenType::PIPE;
+        }
+        else if (word == ">" || word == ">>")
         {
-            if (stream.peek() == '"')
+            return Tokenizer::TokenType::REDIRECTION;
+        }
+        else if (word == "&")
+        {
+            return Tokenizer::TokenType::BACKGROUND;
+        }
+        return Tokenizer::TokenType::ARGUMENT;
+    }
+
+    // Position of the ")" closing the "(" at "open", npos when it is missing
+    size_t closingParenthesis(std::string_view text, size_t open)
+    {
+        size_t depth = 0;
+        for (size_t i = open; i < text.size(); ++i)
+        {
+            if (text[i] == '(')
+            {
+                ++depth;
+            }
+            else if (text[i] == ')' && --depth == 0)
             {
-                stream.ignore();
-                std::getline(stream, token, '"');
-                inQuotes = true;
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    struct ExpandedWord
+    {
+        Tokenizer::TokenType type;
+        bool quoted;
+        bool stored;     // In the storage at "start", otherwise the view is kept as it is
+        size_t start;
+        size_t size;
+        std::string_view original;
+    };
+
+    // Expand one word into the storage, the output of an unquoted substitution may end it and start others
+    bool expandWord(const Tokenizer::TokenView &view, std::string &storage, std::vector<ExpandedWord> &words, const Tokenizer::Substitution &substitute)
+    {
+        std::string_view word = view.value;
+        std::string output;
+
+        size_t start = storage.size();
+        size_t literal = 0;
+        bool substituted = false;
+        bool split = false;
+
+        auto endWord = [&]()
+        {
+            words.push_back({view.type, view.quoted, true, start, storage.size() - start, std::string_view()});
+            start = storage.size();
+            split = true;
+        };
+
+        for (size_t i = 0; i + 1 < word.size(); ++i)
+        {
+            // "$$" is an escaped "$", it is replaced with the variables
+            if (word[i] != '$' || word[i + 1] == '$')
+            {
+                i += word[i] == '$' ? 1 : 0;
+                continue;
+            }
+            if (word[i + 1] != '(' || !substitute)
+            {
+                continue;
+            }
+
+            size_t close = closingParenthesis(word, i + 1);
+            if (close == std::string_view::npos)
+            {
+                std::cerr << "Missing ) in: " << word << std::endl;
+                return false;
+            }
+
+            Variables::expand(word.substr(literal, i - literal), storage);
+
+            output.clear();
+            if (!substitute(word.substr(i + 2, close - i - 2), output))
+            {
+                return false;
+            }
+
+            // "echo" ends its output with a space and a newline, neither belongs to the value
+            while (!output.empty() && isSpace(output.back()))
+            {
+                output.pop_back();
+            }
+
+            if (view.quoted)
+            {
+                storage += output;
             }
             else
             {
-                stream >> token;
-                inQuotes = false;
+                // Spaces of the output separate words, the first and the last one stick to the text around
+                size_t position = 0;
+                while (position < output.size())
+                {
+                    if (isSpace(output[position]))
+                    {
+                        if (storage.size() > start)
+                        {
+                            endWord();
+                        }
+                        while (position < output.size() && isSpace(output[position]))
+                        {
+                            ++position;
+                        }
+                        continue;
+                    }
+
+                    size_t next = position;
+                    while (next < output.size() && !isSpace(output[next]))
+                    {
+                        ++next;
+                    }
+                    storage.append(output, position, next - position);
+                    position = next;
+                }
+            }
+
+            substituted = true;
+            literal = close + 1;
+            i = close;
+        }
+
+        Variables::expand(word.substr(literal), storage);
+
+        // An unquoted substitution giving nothing leaves no word, like in other shells
+        if (storage.size() > start || (!split && (view.quoted || !substituted)))
+        {
+            words.push_back({view.type, view.quoted, true, start, storage.size() - start, std::string_view()});
+        }
+        return true;
+    }
+}
+
+namespace Tokenizer
+{
+    // Split a line into views of its words, a quoted word is always an argument
+    // The vector is cleared first so it can be reused from one line to the next without allocating
+    void scan(std::string_view input, std::vector<TokenView> &tokens)
+    {
+        tokens.clear();
+
+        const char *position = input.data();
+        const char *end = position + input.size();
+
+        while (true)
+        {
+            while (position != end && isSpace(*position))
+            {
+                ++position;
             }
 
-            if (token == "|")
+            if (position == end)
             {
-                tokens.push_back({TokenType::PIPE, token});
+                break;
             }
-            else if (token == ">")
+
+            if (*position == '"')
             {
-                tokens.push_back({TokenType::REDIRECTION, token});
+                const char *start = position + 1;
+                const char *closingQuote = static_cast<const char *>(std::memchr(start, '"', end - start));
+
+                // An unterminated quote takes the rest of the line
+                if (closingQuote == nullptr)
+                {
+                    closingQuote = end;
+                }
+
+                tokens.push_back({TokenType::ARGUMENT, std::string_view(start, closingQuote - start), true});
+                position = closingQuote == end ? end : closingQuote + 1;
             }
             else
             {
-                tokens.push_back({TokenType::ARGUMENT, token});
+                const char *start = position;
+                while (position != end && !isSpace(*position))
+                {
+                    // A command substitution belongs to the word, spaces included
+                    if (*position == '$' && position + 1 != end && position[1] == '(')
+                    {
+                        size_t close = closingParenthesis(std::string_view(position + 1, end - position - 1), 0);
+                        position = close == std::string_view::npos ? end : position + 2 + close;
+                        continue;
+                    }
+                    position += *position == '$' && position + 1 != end && position[1] == '$' ? 2 : 1;
+                }
+
+                std::string_view word(start, position - start);
+                tokens.push_back({classify(word), word});
             }
+        }
+    }
+
+    // Copy the views starting at "first" into owned tokens, reusing the strings already held by "tokens"
+    void toTokens(const std::vector<TokenView> &views, size_t first, std::vector<Token> &tokens)
+    {
+        size_t count = views.size() > first ? views.size() - first : 0;
+        tokens.resize(count);
 
-            if (inQuotes)
+        for (size_t i = 0; i < count; ++i)
+        {
+            tokens[i].type = views[first + i].type;
+            tokens[i].value.assign(views[first + i].value.data(), views[first + i].value.size());
+        }
+    }
+
+    bool expand(std::vector<TokenView> &views, std::string &storage, const Substitution &substitute)
+    {
+        // Every word is expanded first, the views are moved to the storage once it no longer grows
+        std::vector<ExpandedWord> words;
+        words.reserve(views.size());
+        storage.clear();
+
+        for (const auto &view : views)
+        {
+            if (view.type != TokenType::ARGUMENT || view.value.find('$') == std::string_view::npos)
             {
-                stream.ignore(); // Skip the closing quote
+                words.push_back({view.type, view.quoted, false, 0, 0, view.value});
             }
+            else if (!expandWord(view, storage, words, substitute))
+            {
+                return false;
+            }
+        }
+
+        views.resize(words.size());
+        for (size_t i = 0; i < words.size(); ++i)
+        {
+            const ExpandedWord &word = words[i];
+            views[i] = {word.type, word.stored ? std::string_view(storage.data() + word.start, word.size) : word.original, word.quoted};
         }
+        return true;
+    }
+
+    std::vector<Token> tokenize(const std::string &input)
+    {
+        std::vector<TokenView> views;
+        scan(input, views);
+
+        std::vector<Token> tokens;
+        toTokens(views, 0, tokens);
 
         return tokens;
     }
-}
\ No newline at end of file
+}
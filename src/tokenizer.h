@@ -1,4 +1,6 @@
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #ifndef TOKENIZER
@@ -11,7 +13,8 @@ namespace Tokenizer
         COMMAND,
         ARGUMENT,
         PIPE,
-        REDIRECTION
+        REDIRECTION,
+        BACKGROUND
     };
 
     struct Token
@@ -20,7 +23,27 @@ namespace Tokenizer
         std::string value;
     };
 
+    // Token pointing into the scanned line, only valid as long as the line is
+    struct TokenView
+    {
+        TokenType type;
+        std::string_view value;
+        bool quoted = false; // The word was written between quotes
+    };
+
+    void scan(std::string_view input, std::vector<TokenView> &tokens);
+    void toTokens(const std::vector<TokenView> &views, size_t first, std::vector<Token> &tokens);
+
+    // Run the command line of a $(...) substitution and give its output, false when the line can't go on
+    typedef std::function<bool(std::string_view commandLine, std::string &output)> Substitution;
+
+    // Replace the variables ($name, ${name}) of the arguments by their value, each one stays in its word,
+    // and the command substitutions ($(command line)) by the output of the command without its trailing spaces and newlines.
+    // The output of a substitution is split into words, unless the word was written between quotes.
+    // The expanded words are written to "storage", which has to outlive the views ; false when a substitution failed
+    bool expand(std::vector<TokenView> &views, std::string &storage, const Substitution &substitute = nullptr);
+
     std::vector<Token> tokenize(const std::string &input);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,269 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "output.h"
+#include "utils.h"
+
+namespace
+{
+    // Events of a thread are gathered in its own buffer and only written once it is large
+    constexpr size_t threadBufferSize = 64 * 1024;
+
+    struct ThreadBuffer
+    {
+        std::mutex mutex;
+        std::string events;
+        unsigned id;
+    };
+
+    struct Tracer
+    {
+        std::mutex mutex; // Guards the file and the list of buffers
+        std::unique_ptr<Output::FileSink> sink;
+        std::unique_ptr<std::ostream> file;
+        std::vector<ThreadBuffer *> buffers;
+        std::chrono::steady_clock::time_point origin;
+        bool firstEvent = true;
+        unsigned nextThreadId = 1;
+
+        // Called with "mutex" held
+        void write(std::string &events)
+        {
+            if (file && !events.empty())
+            {
+                if (!firstEvent)
+                {
+                    *file << ",\n";
+                }
+                *file << events;
+                firstEvent = false;
+            }
+            events.clear();
+        }
+    };
+
+    Tracer &tracer()
+    {
+        static Tracer instance;
+        return instance;
+    }
+
+    // Registered on the first event of a thread, its remaining events are written when the thread ends
+    class LocalBuffer
+    {
+    public:
+        ThreadBuffer &get()
+        {
+            if (!buffer)
+            {
+                buffer = std::make_unique<ThreadBuffer>();
+
+                std::lock_guard<std::mutex> lock(tracer().mutex);
+                buffer->id = tracer().nextThreadId++;
+                tracer().buffers.push_back(buffer.get());
+            }
+            return *buffer;
+        }
+
+        ~LocalBuffer()
+        {
+            if (!buffer)
+            {
+                return;
+            }
+
+            Tracer &instance = tracer();
+            std::lock_guard<std::mutex> lock(instance.mutex);
+            {
+                std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+                instance.write(buffer->events);
+            }
+
+            auto &buffers = instance.buffers;
+            buffers.erase(std::remove(buffers.begin(), buffers.end(), buffer.get()), buffers.end());
+        }
+
+    private:
+        std::unique_ptr<ThreadBuffer> buffer;
+    };
+
+    thread_local LocalBuffer localBuffer;
+
+    // Microseconds since the trace started, with the nanoseconds as decimals
+    void appendMicroseconds(std::string &events, std::chrono::steady_clock::duration duration)
+    {
+        long long nanoseconds = std::max<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0);
+        char text[32];
+        std::snprintf(text, sizeof(text), "%lld.%03lld", nanoseconds / 1000, nanoseconds % 1000);
+        events += text;
+    }
+
+    // Ids pairing the begin and end events of asynchronous spans
+    std::atomic<unsigned long long> nextAsyncId{1};
+
+    void record(char phase, const char *category, std::string_view name, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::duration duration, size_t line, unsigned long long asyncId = 0)
+    {
+        ThreadBuffer &buffer = localBuffer.get();
+        std::unique_lock<std::mutex> lock(buffer.mutex);
+
+        // Checked again under the lock : stop writes every buffer after turning tracing off
+        if (!Trace::enabled())
+        {
+            return;
+        }
+
+        std::string &events = buffer.events;
+        if (!events.empty())
+        {
+            events += ",\n";
+        }
+
+        events += "{\"name\":\"";
+        events += Utils::escapeJson(std::string(name));
+        events += "\",\"cat\":\"";
+        events += category;
+        events += "\",\"ph\":\"";
+        events += phase;
+        events += "\",\"ts\":";
+        appendMicroseconds(events, start - tracer().origin);
+        if (phase == 'X')
+        {
+            events += ",\"dur\":";
+            appendMicroseconds(events, duration);
+        }
+        if (asyncId != 0)
+        {
+            events += ",\"id\":";
+            events += std::to_string(asyncId);
+        }
+        events += ",\"pid\":1,\"tid\":";
+        events += std::to_string(buffer.id);
+        if (line > 0)
+        {
+            events += ",\"args\":{\"line\":";
+            events += std::to_string(line);
+            events += '}';
+        }
+        events += '}';
+
+        if (events.size() >= threadBufferSize)
+        {
+            // The tracer lock is always taken first
+            lock.unlock();
+            std::lock_guard<std::mutex> tracerLock(tracer().mutex);
+            std::lock_guard<std::mutex> bufferLock(buffer.mutex);
+            tracer().write(events);
+        }
+    }
+}
+
+bool Trace::start(const std::string &filePath)
+{
+    stop();
+
+    Tracer &instance = tracer();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    auto sink = std::make_unique<Output::FileSink>(filePath, false);
+    if (!sink->isOpen())
+    {
+        return false;
+    }
+
+    instance.sink = std::move(sink);
+    instance.file = std::make_unique<std::ostream>(instance.sink.get());
+    instance.firstEvent = true;
+    instance.origin = std::chrono::steady_clock::now();
+
+    // The file is completed when the shell exits without "trace off"
+    static bool stopAtExit = []()
+    {
+        std::atexit(stop);
+        return true;
+    }();
+    (void)stopAtExit;
+
+    *instance.file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    active.store(true, std::memory_order_release);
+    return true;
+}
+
+void Trace::stop()
+{
+    if (!active.exchange(false))
+    {
+        return;
+    }
+
+    Tracer &instance = tracer();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    for (ThreadBuffer *buffer : instance.buffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        instance.write(buffer->events);
+    }
+
+    *instance.file << "\n]}\n";
+    instance.file->flush();
+    instance.file.reset();
+
+    if (!instance.sink->close())
+    {
+        std::cerr << "Error writing the trace file" << std::endl;
+    }
+    instance.sink.reset();
+}
+
+void Trace::begin(const char *category, std::string_view name)
+{
+    if (enabled())
+    {
+        record('B', category, name, std::chrono::steady_clock::now(), {}, 0);
+    }
+}
+
+void Trace::end(const char *category, std::string_view name)
+{
+    if (enabled())
+    {
+        record('E', category, name, std::chrono::steady_clock::now(), {}, 0);
+    }
+}
+
+void Trace::asyncSpan(const char *category, std::string_view name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    if (enabled())
+    {
+        unsigned long long id = nextAsyncId.fetch_add(1, std::memory_order_relaxed);
+        record('b', category, name, start, {}, 0, id);
+        record('e', category, name, end, {}, 0, id);
+    }
+}
+
+Trace::Span::Span(const char *category, std::string_view name, size_t line) : category(category), line(line), recording(enabled())
+{
+    if (recording)
+    {
+        this->name = name;
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+Trace::Span::~Span()
+{
+    if (recording && enabled())
+    {
+        record('X', category, name, start, std::chrono::steady_clock::now() - start, line);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace Trace
+{
+    // Write Chrome trace events (https://ui.perfetto.dev opens the file) until stop is called
+    bool start(const std::string &filePath);
+    void stop();
+
+    inline std::atomic<bool> active{false};
+
+    inline bool enabled()
+    {
+        return active.load(std::memory_order_acquire);
+    }
+
+    // Begin and end of a span which doesn't follow the scope of a C++ block, on the calling thread
+    void begin(const char *category, std::string_view name);
+    void end(const char *category, std::string_view name);
+
+    // Span measured by the caller which may overlap others of the thread, like a program the shell waits for
+    void asyncSpan(const char *category, std::string_view name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    // Span covering the lifetime of the object, nothing is recorded when tracing is off
+    class Span
+    {
+    public:
+        Span(const char *category, std::string_view name, size_t line = 0);
+        ~Span();
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+    private:
+        const char *category;
+        std::string name;
+        size_t line;
+        bool recording;
+        std::chrono::steady_clock::time_point start;
+    };
+}
+
+#endif
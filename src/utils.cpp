@@ -7,8 +7,13 @@
 #include <iostream>
 #include <string>
 #include <cctype>
+#include <codecvt>
+#include <cstdio>
+#include <locale>
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 using namespace fs;
 
@@ -26,7 +31,7 @@ std::wstring Utils::stringToWstring(const std::string &narrowStr)
     return wss.str();
 }
 
-std::wstring Utils::charToWchar(const WCHAR *str)
+std::wstring Utils::charToWchar(const wchar_t *str)
 {
     // Create a wide string stream
     std::wstringstream wss;
@@ -38,10 +43,15 @@ std::wstring Utils::charToWchar(const WCHAR *str)
 
 std::wstring Utils::getProgramPath()
 {
+#ifdef _WIN32
     wchar_t buffer[MAX_PATH];
     GetModuleFileNameW(NULL, buffer, MAX_PATH);
     std::wstring path(buffer);
     return path;
+#else
+    std::error_code error;
+    return fs::read_symlink("/proc/self/exe", error).wstring();
+#endif
 }
 
 std::wstring Utils::getParentFolderPath(const std::wstring &path)
@@ -64,7 +74,7 @@ std::string Utils::wstringToString(const std::wstring &wstr)
 const std::string Utils::licensePath = []()
 {
     std::ostringstream oss;
-    oss << wstringToString(getParentFolderPath(getProgramPath())) << "\\LICENSE.md";
+    oss << wstringToString(getParentFolderPath(getProgramPath())) << static_cast<char>(fs::path::preferred_separator) << "LICENSE.md";
     return oss.str();
 }();
 
@@ -86,6 +96,30 @@ bool Utils::containsSpace(const std::string &str)
     return false; // No space found
 }
 
+std::string Utils::escapeJson(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
 int Utils::detectNumberBase(const std::string &str)
 {
     if (str.empty())
@@ -127,6 +161,7 @@ int Utils::detectNumberBase(const std::string &str)
 
 void Utils::EnableDebugPrivileges()
 {
+#ifdef _WIN32
     HANDLE hToken;
     if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES, &hToken))
     {
@@ -164,6 +199,9 @@ void Utils::EnableDebugPrivileges()
     {
         std::cerr << "OpenProcessToken failed: " << GetLastError() << std::endl;
     }
+#else
+    std::cerr << "Debug privileges are only available on Windows" << std::endl;
+#endif
 }
 
 void Utils::typeText(const std::string &filePath, int speed)
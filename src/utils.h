@@ -6,7 +6,9 @@
 #include <cwchar>
 #include <string>
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -21,7 +23,7 @@ namespace Utils
 
     std::wstring stringToWstring(const std::string &narrowStr);
     std::wstring getParentFolderPath(const std::wstring &path);
-    std::wstring charToWchar(const WCHAR *str);
+    std::wstring charToWchar(const wchar_t *str);
     std::wstring getProgramPath();
 
     std::string getCurrentDir();
@@ -30,6 +32,9 @@ namespace Utils
     bool startsWithPeriod(const std::wstring &filename);
     bool containsSpace(const std::string &str);
 
+    // Text with quotes, backslashes and control characters escaped for a JSON string
+    std::string escapeJson(const std::string &text);
+
     int detectNumberBase(const std::string &str);
 }
 
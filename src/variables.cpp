@@ -0,0 +1,444 @@
+#include "variables.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "utils.h"
+
+#ifndef _WIN32
+extern char **environ;
+#endif
+
+namespace
+{
+    inline char foldCase(char c)
+    {
+#ifdef _WIN32
+        return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+#else
+        return c;
+#endif
+    }
+
+    struct NameHash
+    {
+        size_t operator()(std::string_view name) const
+        {
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ull;
+            for (char c : name)
+            {
+                hash ^= static_cast<unsigned char>(foldCase(c));
+                hash *= 1099511628211ull;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    struct NameEqual
+    {
+        bool operator()(std::string_view left, std::string_view right) const
+        {
+            if (left.size() != right.size())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < left.size(); ++i)
+            {
+                if (foldCase(left[i]) != foldCase(right[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    // Blocks the names and values are copied to, a string is never moved once it is stored
+    class Arena
+    {
+    public:
+        std::string_view store(std::string_view text)
+        {
+            if (text.empty())
+            {
+                return std::string_view();
+            }
+
+            // A string larger than a block gets a block of its own, the current one stays in use
+            if (text.size() > blockSize)
+            {
+                blocks.push_back(std::make_unique<char[]>(text.size()));
+                std::memcpy(blocks.back().get(), text.data(), text.size());
+                return std::string_view(blocks.back().get(), text.size());
+            }
+
+            if (text.size() > blockSize - used)
+            {
+                blocks.push_back(std::make_unique<char[]>(blockSize));
+                current = blocks.back().get();
+                used = 0;
+            }
+
+            char *destination = current + used;
+            std::memcpy(destination, text.data(), text.size());
+            used += text.size();
+            return std::string_view(destination, text.size());
+        }
+
+    private:
+        static constexpr size_t blockSize = 16 * 1024;
+
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char *current = nullptr;
+        size_t used = blockSize; // The first string allocates the first block
+    };
+
+    struct Entry
+    {
+        std::string_view value;
+        bool exported;
+    };
+
+    class Table
+    {
+    public:
+        Table()
+        {
+            // The environment of the console is the first set of variables, every one of them exported
+#ifdef _WIN32
+            LPWCH strings = GetEnvironmentStringsW();
+            for (LPWCH entry = strings; entry != nullptr && *entry != L'\0'; entry += wcslen(entry) + 1)
+            {
+                importEntry(Utils::wstringToString(entry));
+            }
+            FreeEnvironmentStringsW(strings);
+#else
+            for (char **entry = environ; entry != nullptr && *entry != nullptr; ++entry)
+            {
+                importEntry(*entry);
+            }
+#endif
+        }
+
+        bool get(std::string_view name, std::string &value) const
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+
+            auto entry = entries.find(name);
+            if (entry == entries.end())
+            {
+                return false;
+            }
+            value.assign(entry->second.value.data(), entry->second.value.size());
+            return true;
+        }
+
+        bool append(std::string_view name, std::string &text) const
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+
+            auto entry = entries.find(name);
+            if (entry == entries.end())
+            {
+                return false;
+            }
+            text.append(entry->second.value.data(), entry->second.value.size());
+            return true;
+        }
+
+        void set(std::string_view name, std::string_view value, bool exported)
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+
+            auto entry = entries.find(name);
+            if (entry == entries.end())
+            {
+                entries.emplace(store(name), Entry{store(value), exported});
+                liveBytes += name.size() + value.size();
+            }
+            else
+            {
+                liveBytes += value.size() - entry->second.value.size();
+                entry->second.value = store(value);
+                entry->second.exported = entry->second.exported || exported;
+                exported = entry->second.exported;
+            }
+
+            changed(exported);
+            compactIfWasted();
+        }
+
+        bool unset(std::string_view name)
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+
+            auto entry = entries.find(name);
+            if (entry == entries.end())
+            {
+                return false;
+            }
+
+            bool exported = entry->second.exported;
+            liveBytes -= entry->first.size() + entry->second.value.size();
+            entries.erase(entry);
+
+            changed(exported);
+            compactIfWasted();
+            return true;
+        }
+
+        bool exportVariable(std::string_view name)
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+
+            auto entry = entries.find(name);
+            if (entry == entries.end())
+            {
+                return false;
+            }
+
+            if (!entry->second.exported)
+            {
+                entry->second.exported = true;
+                changed(true);
+            }
+            return true;
+        }
+
+        uint64_t version() const
+        {
+            return currentVersion.load(std::memory_order_acquire);
+        }
+
+        std::shared_ptr<const Variables::Environment> environment()
+        {
+            std::lock_guard<std::mutex> environmentLock(environmentMutex);
+
+            uint64_t current = exportedVersion.load(std::memory_order_acquire);
+            if (cachedEnvironment && cachedVersion == current)
+            {
+                return cachedEnvironment;
+            }
+
+            auto built = std::make_shared<Variables::Environment>();
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex);
+
+                // Windows wants the block sorted by name
+                std::map<std::string_view, std::string_view> exported;
+                for (const auto &entry : entries)
+                {
+                    if (entry.second.exported)
+                    {
+                        exported.emplace(entry.first, entry.second.value);
+                    }
+                }
+
+#ifdef _WIN32
+                for (const auto &entry : exported)
+                {
+                    built->block += Utils::stringToWstring(std::string(entry.first) + '=' + std::string(entry.second));
+                    built->block += L'\0';
+                }
+                built->block += L'\0';
+#else
+                built->entries.reserve(exported.size());
+                for (const auto &entry : exported)
+                {
+                    std::string text;
+                    text.reserve(entry.first.size() + entry.second.size() + 1);
+                    text.append(entry.first).append(1, '=').append(entry.second);
+                    built->entries.push_back(std::move(text));
+                }
+                for (auto &entry : built->entries)
+                {
+                    built->pointers.push_back(&entry[0]);
+                }
+                built->pointers.push_back(nullptr);
+#endif
+            }
+
+            cachedEnvironment = std::move(built);
+            cachedVersion = current;
+            return cachedEnvironment;
+        }
+
+    private:
+        // Replaced values stay in the arena, it is rebuilt once they take more room than the live ones
+        static constexpr size_t minimumWaste = 64 * 1024;
+
+        void importEntry(std::string_view text)
+        {
+            // Windows has hidden "=C:=C:\dir" entries, their name starts with "="
+            size_t separator = text.find('=', 1);
+            if (separator != std::string_view::npos)
+            {
+                std::string_view name = text.substr(0, separator);
+                std::string_view value = text.substr(separator + 1);
+
+                if (entries.emplace(store(name), Entry{store(value), true}).second)
+                {
+                    liveBytes += name.size() + value.size();
+                }
+            }
+        }
+
+        // Called with the lock held
+        std::string_view store(std::string_view text)
+        {
+            storedBytes += text.size();
+            return arena.store(text);
+        }
+
+        void changed(bool exported)
+        {
+            currentVersion.fetch_add(1, std::memory_order_release);
+            if (exported)
+            {
+                exportedVersion.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        void compactIfWasted()
+        {
+            if (storedBytes - liveBytes < minimumWaste || storedBytes - liveBytes < liveBytes)
+            {
+                return;
+            }
+
+            Arena compacted;
+            std::unordered_map<std::string_view, Entry, NameHash, NameEqual> moved;
+            moved.reserve(entries.size());
+
+            for (const auto &entry : entries)
+            {
+                moved.emplace(compacted.store(entry.first), Entry{compacted.store(entry.second.value), entry.second.exported});
+            }
+
+            arena = std::move(compacted);
+            entries = std::move(moved);
+            storedBytes = liveBytes;
+        }
+
+        Arena arena;
+        std::unordered_map<std::string_view, Entry, NameHash, NameEqual> entries;
+        size_t liveBytes = 0;   // Names and values of the defined variables
+        size_t storedBytes = 0; // Everything copied to the arena
+        mutable std::shared_mutex mutex;
+
+        std::atomic<uint64_t> currentVersion{0};
+        std::atomic<uint64_t> exportedVersion{0};
+
+        std::mutex environmentMutex;
+        std::shared_ptr<const Variables::Environment> cachedEnvironment;
+        uint64_t cachedVersion = 0;
+    };
+
+    Table &table()
+    {
+        static Table variables;
+        return variables;
+    }
+
+    inline bool isNameStart(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    inline bool isNameCharacter(char c)
+    {
+        return isNameStart(c) || (c >= '0' && c <= '9');
+    }
+}
+
+bool Variables::get(std::string_view name, std::string &value)
+{
+    return table().get(name, value);
+}
+
+void Variables::set(std::string_view name, std::string_view value)
+{
+    table().set(name, value, false);
+}
+
+bool Variables::unset(std::string_view name)
+{
+    return table().unset(name);
+}
+
+bool Variables::exportVariable(std::string_view name)
+{
+    return table().exportVariable(name);
+}
+
+uint64_t Variables::version()
+{
+    return table().version();
+}
+
+void Variables::expand(std::string_view word, std::string &expanded)
+{
+    Table &variables = table();
+    size_t position = 0;
+
+    while (position < word.size())
+    {
+        size_t dollar = word.find('$', position);
+        if (dollar == std::string_view::npos || dollar + 1 == word.size())
+        {
+            break;
+        }
+
+        expanded.append(word.data() + position, dollar - position);
+        position = dollar + 1;
+
+        if (word[position] == '$')
+        {
+            expanded += '$';
+            ++position;
+            continue;
+        }
+
+        // ${name} or $name, anything else after the $ is left as it is
+        bool braces = word[position] == '{';
+        size_t nameStart = braces ? position + 1 : position;
+        size_t nameEnd = nameStart;
+
+        if (nameEnd < word.size() && isNameStart(word[nameEnd]))
+        {
+            while (nameEnd < word.size() && isNameCharacter(word[nameEnd]))
+            {
+                ++nameEnd;
+            }
+        }
+
+        bool complete = nameEnd > nameStart && (!braces || (nameEnd < word.size() && word[nameEnd] == '}'));
+        size_t next = braces ? nameEnd + 1 : nameEnd;
+
+        if (complete && variables.append(word.substr(nameStart, nameEnd - nameStart), expanded))
+        {
+            position = next;
+        }
+        else
+        {
+            expanded += '$';
+        }
+    }
+
+    expanded.append(word.data() + position, word.size() - position);
+}
+
+std::shared_ptr<const Variables::Environment> Variables::environment()
+{
+    return table().environment();
+}
@@ -0,0 +1,50 @@
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Variables
+{
+    // Variables of the running console, filled from the environment of the process the first time it is used.
+    // Names and values live in an arena and are found through a hash table, names ignore case on Windows
+    // like its environment does
+
+    // false when the variable isn't defined
+    bool get(std::string_view name, std::string &value);
+
+    // Define or replace a variable, a replaced variable stays exported if it was
+    void set(std::string_view name, std::string_view value);
+
+    // false when the variable isn't defined
+    bool unset(std::string_view name);
+
+    // Hand the variable to the programs started from now on, false when it isn't defined
+    bool exportVariable(std::string_view name);
+
+    // Changes each time a variable is set or removed
+    uint64_t version();
+
+    // Append "word" to "expanded" with $name and ${name} replaced by the value of the variable, and $$ by a
+    // single $ ; an undefined variable or a $ followed by something else stays as written
+    void expand(std::string_view word, std::string &expanded);
+
+    // Environment of a child process : the exported variables only
+    struct Environment
+    {
+#ifdef _WIN32
+        std::wstring block; // NAME=value strings ended by a null character, then an empty one
+#else
+        std::vector<std::string> entries; // NAME=value
+        std::vector<char *> pointers;     // Point into "entries", ended by nullptr
+#endif
+    };
+
+    // Built again only after an exported variable changed, every spawn in between shares the same one
+    std::shared_ptr<const Environment> environment();
+}
+
+#endif